@@ -6,13 +6,18 @@
 #include "emulator.h"
 #include "nes/nes.h"
 #include <allegro5/allegro.h>
-#include <allegro5/allegro_primitives.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EMU_SCALE_DEFAULT 2
+#define EMU_SCALE_MAX     8
 
 ALLEGRO_EVENT_QUEUE *nes_event_queue;
 ALLEGRO_TIMER *nes_timer = NULL;
-static ALLEGRO_VERTEX vtx[1000000];
-ALLEGRO_COLOR color_map[64];
-int vtx_sz = 0;
+static ALLEGRO_BITMAP *nes_screen;  // 256 x 240 的纹理, 每帧更新一次, 显示时缩放
+static uint32_t nes_rgb_buffer[SCREEN_HEIGHT * SCREEN_WIDTH];  // PPU 的 RGB 输出 (ARGB8888)
+static int nes_scale = EMU_SCALE_DEFAULT;
 
 /* 等待一帧结束, (allegro timer event) */
 void wait_for_frame() {
@@ -23,37 +28,79 @@ void wait_for_frame() {
     }
 }
 
-/* 设置背景颜色，具体的 RGB 色彩在 ppu.h 中定义 */
-void set_bg_color(int c) {
-    al_clear_to_color(color_map[c]);
+/* 把 PPU 输出的画面 (nes_rgb_buffer) 复制到纹理中, 锁定的纹理每行的长度 (pitch) 可能与画面宽度不同 */
+void flush_framebuffer(struct nes_machine *m) {
+    ALLEGRO_LOCKED_REGION *region;
+    int y;
+    (void)m;
+    region = al_lock_bitmap(nes_screen, ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_LOCK_WRITEONLY);
+    if(region == NULL) { return; }
+    for(y = 0; y < SCREEN_HEIGHT; y++) {
+        memcpy((uint8_t *)region->data + y * region->pitch, &nes_rgb_buffer[y * SCREEN_WIDTH], SCREEN_WIDTH * sizeof(uint32_t));
+    }
+    al_unlock_bitmap(nes_screen);
 }
 
-/* 把 ppu.c 中 PPU 的图像输出，转移到 allegro 的缓冲区中 */
-void flush_buf(PixelBuf *buf) {
-    int i;
-    for (i = 0; i < buf->size; i ++) {
-        Pixel *p = &buf->buf[i];
-        int x = p->x, y = p->y;
-        ALLEGRO_COLOR c = color_map[p->color];
-
-        vtx[vtx_sz].x = x*2; vtx[vtx_sz].y = y*2;
-        vtx[vtx_sz ++].color = c;
-        vtx[vtx_sz].x = x*2+1; vtx[vtx_sz].y = y*2;
-        vtx[vtx_sz ++].color = c;
-        vtx[vtx_sz].x = x*2; vtx[vtx_sz].y = y*2+1;
-        vtx[vtx_sz ++].color = c;
-        vtx[vtx_sz].x = x*2+1; vtx[vtx_sz].y = y*2+1;
-        vtx[vtx_sz ++].color = c;
-    }
+/* 将纹理一次缩放到整个窗口 */
+void flip_display() {
+    al_draw_scaled_bitmap(nes_screen, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT,
+                          0, 0, SCREEN_WIDTH * nes_scale, SCREEN_HEIGHT * nes_scale, 0);
+    al_flip_display();
 }
 
-void emu_init() {
-    nes_init();
+/* 以下为 struct nes_frontend 的回调 */
+
+static void emu_frame_ready(void *user, struct nes_machine *m) {
+    (void)user;
+    flush_framebuffer(m);
+    flip_display();
+}
+
+static int emu_input(void *user, int button) {
+    (void)user;
+    return get_key_state(button);
+}
+
+static void emu_wait_frame(void *user) {
+    (void)user;
+    wait_for_frame();
+}
+
+/* 初始化 Allegro 的显示与键盘
+ * 环境变量 BEMU_SCALE 设置画面放大的倍数 (1 ~ 8, 默认为 2),
+ * BEMU_FILTER 为 linear 时放大时使用线性插值, 否则 (nearest) 保持像素的边缘清晰
+ */
+void emu_init(struct nes_machine *m) {
+    const char *scale = getenv("BEMU_SCALE");
+    const char *filter = getenv("BEMU_FILTER");
+    int flags = ALLEGRO_VIDEO_BITMAP;
+
+    nes_init(m);
+
+    if(scale != NULL) {
+        nes_scale = atoi(scale);
+        if(nes_scale < 1 || nes_scale > EMU_SCALE_MAX) {
+            printf("Invalid BEMU_SCALE: %s, using %d\n", scale, EMU_SCALE_DEFAULT);
+            nes_scale = EMU_SCALE_DEFAULT;
+        }
+    }
+    if(filter != NULL && strcmp(filter, "linear") == 0) { flags |= ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR; }
 
     al_init();
-    al_init_primitives_addon();
     al_install_keyboard();
-    al_create_display(SCREEN_WIDTH * 2, SCREEN_HEIGHT * 2);
+    al_create_display(SCREEN_WIDTH * nes_scale, SCREEN_HEIGHT * nes_scale);
+
+    al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ARGB_8888);
+    al_set_new_bitmap_flags(flags);
+    nes_screen = al_create_bitmap(SCREEN_WIDTH, SCREEN_HEIGHT);
+    if(nes_screen == NULL) {
+        printf("Failed to create the screen bitmap\n");
+        exit(-1);
+    }
+    ppu_set_rgb_output(m, nes_rgb_buffer, PPU_PIXEL_ARGB8888);
+
+    struct nes_frontend frontend = { NULL, emu_frame_ready, emu_input, NULL, emu_wait_frame };
+    nes_set_frontend(m, &frontend);
 
     nes_timer = al_create_timer(1.0 / FPS);
     nes_event_queue = al_create_event_queue();
@@ -61,17 +108,6 @@ void emu_init() {
     al_start_timer(nes_timer);
 }
 
-void flip_display() {
-    al_draw_prim(vtx, NULL, NULL, 0, vtx_sz, ALLEGRO_PRIM_POINT_LIST);
-    al_flip_display();
-    vtx_sz = 0;
-    int i;
-    for(i = 0; i < 64; i++) {
-        color_rgb color = palette[i];
-        color_map[i] = al_map_rgb(color.r, color.g, color.b);
-    }
-}
-
 int get_key_state(int b) {
     ALLEGRO_KEYBOARD_STATE state;
     al_get_keyboard_state(&state);
@@ -99,35 +135,7 @@ int get_key_state(int b) {
     }
 }
 
-void emu_run() {
-    for(;;) {
-        wait_for_frame();
-        int scanlines = 262;
-        while(scanlines-- > 0) {
-            // TODO: 能否用多线程进行优化？
-            ppu_run(1);
-            cpu_run(1364 / 12);
-        }
-    }
-}
-
-void emu_update_screen()
-{
-    int idx = ppu_ram_read(0x3f00);
-    set_bg_color(idx);
-
-    if (ppu_show_sprites())
-        flush_buf(&bbg);
-
-    if (ppu_show_background())
-        flush_buf(&bg);
-
-    if (ppu_show_sprites())
-        flush_buf(&fg);
-
-    flip_display();
-
-    pixelbuf_clean(bbg);
-    pixelbuf_clean(bg);
-    pixelbuf_clean(fg);
+/* 按照 FPS 运行, 不会返回 */
+void emu_run(struct nes_machine *m) {
+    nes_run(m, -1);
 }
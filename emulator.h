@@ -1,11 +1,10 @@
 #ifndef BEMU_EMULATOR_H
 #define BEMU_EMULATOR_H
 
+struct nes_machine;
 
-void emu_init();
-void emu_run();
-void emu_update_screen();
-void set_bg_color(int c);
+void emu_init(struct nes_machine *m);
+void emu_run(struct nes_machine *m);
 int get_key_state(int b);
 
 #endif
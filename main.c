@@ -16,19 +16,32 @@
 #include <allegro5/allegro.h>
 #include "nes/disassembler.h"
 #include "nes/nes.h"
+#include "nes/cpu_profile.h"
+#include "nes/cpu_trace.h"
 #include "emulator.h"
 #include <time.h>
 
 void arg_error(char *app_name);
 static void sig_info();
+#ifdef BEMU_CPU_TRACE
+static void sig_crash(int sig);
+#endif
+
+static struct nes_machine *machine;
 
 int main(int argc, char *argv[]) {
     /* 判断 Arguments 的数量是否正确 */
     if(argc != 3) { arg_error(argv[0]); }
 
+    machine = nes_create();
+    if(machine == NULL) {
+        printf("Out of memory\n");
+        exit(-1);
+    }
+
     /* 读入 NES ROM */
     int tmp;
-    tmp = nes_load_rom(argv[2]);
+    tmp = nes_load_rom(machine, argv[2]);
     if(tmp != 0) {
         printf("NES rom load failed, error code: %d\n", tmp);
         exit(tmp);
@@ -39,21 +52,28 @@ int main(int argc, char *argv[]) {
     c = getopt(argc, argv, "rdi");
     switch(c) {
         case 'r':  // 运行
-            emu_init();
+            emu_init(machine);
             signal(SIGINFO, sig_info);
-            emu_run();
-            nes_exit(); // 其实这一句永远不会执行
+#ifdef BEMU_CPU_TRACE
+            signal(SIGSEGV, sig_crash);
+            signal(SIGBUS, sig_crash);
+            signal(SIGFPE, sig_crash);
+            signal(SIGABRT, sig_crash);
+#endif
+            emu_run(machine);
+            nes_exit(machine); // 其实这一句永远不会执行
             break;
         case 'd':  // 反汇编
-            disasm(cartridge.prg_rom, cartridge.prg_rom_size);
+            disasm(machine->cartridge.prg_rom, machine->cartridge.prg_rom_size);
             break;
         case 'i':  // 显示 ROM 信息
-            nes_print_rom_metadata();
+            nes_print_rom_metadata(machine);
             break;
         default:
             arg_error(argv[0]);
     }
 
+    nes_destroy(machine);
     return 0;
 }
 
@@ -65,7 +85,21 @@ void arg_error(char *app_name) {
     printf("  -d\tRun disassembler\n");
     printf("  -i\tShow NES ROM metadata\n");
     printf("\n");
-    printf("While NES emulator is running, press Ctrl + T to show debug information.\n\n");
+    printf("While NES emulator is running, press Ctrl + T to show debug information.\n");
+#ifdef BEMU_CPU_PROFILE
+    printf("The 6502 profile is saved at the same time and when the emulator exits.\n");
+#endif
+#ifdef BEMU_CPU_TRACE
+    printf("The 6502 trace is saved to %s at the same time and on crash.\n", CPU_TRACE_DUMP_FILE);
+#endif
+    printf("Environment variables:\n");
+    printf("  BEMU_SCALE\t\tWindow scale factor, 1 to 8 (default: 2)\n");
+    printf("  BEMU_FILTER\t\tScaling filter, nearest or linear (default: nearest)\n");
+#ifdef BEMU_CPU_TRACE
+    printf("  BEMU_TRACE_TRIGGER\tSave the trace when this address (hex) is reached\n");
+    printf("  BEMU_TRACE_FILE\tStream the whole trace to this file\n");
+#endif
+    printf("\n");
     printf("https://github.com/blanboom/bEMU\nhttp://blanboom.org\n");
     exit(0);
 }
@@ -80,7 +114,32 @@ static void sig_info() {
     timeinfo = localtime(&timer);
     printf("%s\n", asctime(timeinfo));
 
-    cpu_debugger();
-    ppu_debugger();
+    cpu_debugger(machine);
+    ppu_debugger(machine);
+#ifdef BEMU_CPU_PROFILE
+    if(cpu_profile_save(machine) == 0) {
+        printf("Profile saved to %s and %s\n", CPU_PROFILE_REPORT_FILE, CPU_PROFILE_FOLDED_FILE);
+    }
+#endif
+#ifdef BEMU_CPU_TRACE
+    if(cpu_trace_dump(machine, CPU_TRACE_DUMP_FILE) == 0) {
+        printf("Trace saved to %s\n", CPU_TRACE_DUMP_FILE);
+    }
+#endif
     printf("--------------------------------------------\n\n");
 }
+
+#ifdef BEMU_CPU_TRACE
+/* 程序崩溃时保存指令跟踪, 然后按默认方式处理该信号
+ * 崩溃可能发生在 malloc 或 stdio 中, 因此只使用 async-signal-safe 的函数
+ */
+static void sig_crash(int sig) {
+    static const char message[] = "Crashed, trace saved to " CPU_TRACE_DUMP_FILE "\n";
+    if(cpu_trace_crash_dump(machine) == 0) {
+        ssize_t written = write(STDERR_FILENO, message, sizeof(message) - 1);
+        (void)written;
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+#endif
@@ -2,104 +2,75 @@
  */
 
 #include "cpu.h"
+#include "cpu_internal.h"
+#include "cpu_jit.h"
+#include "cpu_trace.h"
 #include "memory.h"
 #include "nes.h"
 #include "stdio.h"
-
-uint64_t cpu_cycles;
-
-/* 用于获得 CPU 状态寄存器中的指定状态, 具体内容见后面的注释 */
-#define FLAG_CARRY     0x01
-#define FLAG_ZERO      0x02
-#define FLAG_INTERRUPT 0x04
-#define FLAG_DECIMAL   0x08
-#define FLAG_BREAK     0x10
-#define FLAG_UNUSED    0x20
-#define FLAG_OVERFLOW  0x40
-#define FLAG_NEGATIVE  0x80
-
-/* CPU 寄存器
- * 各个寄存器的名称已经在程序中给出
- * 状态寄存器 p 中各个位的作用:
- *    7  bit  0
- *    ---- ----
- *    NVsB DIZC
- *    |||| ||||
- *    |||| |||+- Carry: 进位标志. 加法有进位或减法**无**借位时置 1
- *    |||| ||+-- Zero: 零标志. 运算结果为 0 时, 该位置 1
- *    |||| |+--- Interrupt: 中断屏蔽标志. 为 0 的时候允许 IRQ 和 NMI, 为 1 的时候只允许 NMI
- *    |||| +---- Decimal:  十进制标志置 1 后, ADC 和 SBC 指令使用十进制表示 (在 NES 中未被使用)
- *    ||++------ B: 用于表示软件中断的状态等, 具体参考此处. http://wiki.nesdev.com/w/index.php/CPU_status_flag_behavior
- *    |+-------- Overflow: 溢出标志. 有溢出时为 1, 无溢出时为 0
- *    +--------- Negative: 负数标志. 无溢出时 1 表示结果为负, 有溢出是 1 表示结果为正
- */
-struct _cpu {
-    uint8_t  a;    // 累加寄存器 Accumulator
-    uint8_t  x;    // 变址寄存器 Index Register X
-    uint8_t  y;    // 变址寄存器 Index Register Y
-    uint8_t  sp;   // 堆栈指针   Stack Pointer
-    uint8_t  p;    // 状态寄存器 Status Register
-    uint16_t pc;   // 程序计数器 Program Counter
-} cpu;
+#include <string.h>
 
 /* 显示 CPU 寄存器, 时钟等信息 */
-void cpu_debugger() {
+void cpu_debugger(struct nes_machine *m) {
     printf("CPU REGISTERS:\n");
-    printf("A:   %x\n", cpu.a);
-    printf("X:   %x\n", cpu.x);
-    printf("Y:   %x\n", cpu.y);
-    printf("SP:  %x\n", cpu.sp);
-    printf("P:   %x\n", cpu.p);
-    printf("PC:  %x\n", cpu.pc);
+    printf("A:   %x\n", m->cpu.a);
+    printf("X:   %x\n", m->cpu.x);
+    printf("Y:   %x\n", m->cpu.y);
+    printf("SP:  %x\n", m->cpu.sp);
+    printf("P:   %x\n", cpu_get_p(m));
+    printf("PC:  %x\n", m->cpu.pc);
     printf("\n");
-    printf("CPU CLOCK: %llu\n\n", cpu_clock());
+    printf("CPU CLOCK: %llu\n\n", (unsigned long long)cpu_clock(m));
 }
 
 /* 初始化 CPU */
-void cpu_init() {
+void cpu_init(struct nes_machine *m) {
     // http://wiki.nesdev.com/w/index.php/CPU_power_up_state
-    cpu_cycles = 0;
+    m->cpu_cycles = 0;
+    m->cpu_run_cycles = 0;
+    m->cpu_stall = 0;
     uint16_t i;
-    cpu.a  = 0;
-    cpu.x  = 0;
-    cpu.y  = 0;
-    cpu.p  = 0x24;
-    cpu.sp = 0xfd;
-    memory_write_byte(0x4017, 0); // frame irq enabled
-    memory_write_byte(0x4015, 0); // all channels disabled
+    m->cpu.a  = 0;
+    m->cpu.x  = 0;
+    m->cpu.y  = 0;
+    cpu_set_p(m, 0x24);
+    m->cpu.sp = 0xfd;
+    cpu_icache_flush(m);
+#ifdef BEMU_CPU_JIT
+    cpu_jit_init(m);
+#endif
+    memory_write_byte(m, 0x4017, 0); // frame irq enabled
+    memory_write_byte(m, 0x4015, 0); // all channels disabled
     for(i = 0x4017; i <= 0x400f; i++) {
-        memory_write_byte(i, 0);
+        memory_write_byte(m, i, 0);
     }
 
-    cpu.pc = memory_read_word(0xfffc);
+    m->cpu.pc = memory_read_word(m, 0xfffc);
+#ifdef BEMU_CPU_PROFILE
+    cpu_profile_init(m);
+#endif
+#ifdef BEMU_CPU_TRACE
+    cpu_trace_init(m);
+#endif
 }
 
 /* CPU 复位 */
-void cpu_reset() {
-    cpu.sp -= 3;
-    cpu.p  |= FLAG_INTERRUPT;
-    memory_write_byte(0x4015, 0);  // APU was silenced
-    cpu.pc = memory_read_word(0xfffc);
-}
-
-/* 检查并设置 Zero Flag 与 Negative Flag */
-void cpu_checknz(uint8_t n)
-{
-    if((n >> 7) & 1) { cpu.p |= FLAG_NEGATIVE; } else { cpu.p &= ~FLAG_NEGATIVE; }
-    if(n == 0)       { cpu.p |= FLAG_ZERO; }     else { cpu.p &= ~FLAG_ZERO; }
-}
-
-/* 修改 Flags */
-void cpu_modify_flag(uint8_t flag, int value) {
-    if(value) { cpu.p |= flag; }
-    else      { cpu.p &= ~flag; }
+void cpu_reset(struct nes_machine *m) {
+    m->cpu.sp -= 3;
+    m->cpu.p  |= FLAG_INTERRUPT;
+    memory_write_byte(m, 0x4015, 0);  // APU was silenced
+    m->cpu.pc = memory_read_word(m, 0xfffc);
 }
 
 /* 栈操作 */
-void cpu_stack_push_byte(uint8_t data) { memory_write_byte(0x100 + cpu.sp, data); cpu.sp -= 1; }
-void cpu_stack_push_word(uint16_t data)    { memory_write_word(0x0ff + cpu.sp, data); cpu.sp -= 2; }
-uint8_t  cpu_stack_pop_byte()              { cpu.sp += 1; return memory_read_byte(0x100 + cpu.sp); }
-uint16_t cpu_stack_pop_word()              { cpu.sp += 2; return memory_read_word(0x0ff + cpu.sp); }
+void cpu_stack_push_byte(struct nes_machine *m, uint8_t data) { memory_write_ram(m, 0x100 + m->cpu.sp, data); m->cpu.sp -= 1; }
+void cpu_stack_push_word(struct nes_machine *m, uint16_t data) {
+    memory_write_ram(m, 0x0ff + m->cpu.sp, data & 0xff);
+    memory_write_ram(m, 0x100 + m->cpu.sp, data >> 8);
+    m->cpu.sp -= 2;
+}
+uint8_t  cpu_stack_pop_byte(struct nes_machine *m) { m->cpu.sp += 1; return memory_read_ram(m, 0x100 + m->cpu.sp); }
+uint16_t cpu_stack_pop_word(struct nes_machine *m) { m->cpu.sp += 2; return memory_read_ram(m, 0x0ff + m->cpu.sp) + (memory_read_ram(m, 0x100 + m->cpu.sp) << 8); }
 
 
 /* CPU 寻址方式
@@ -114,88 +85,128 @@ uint16_t cpu_stack_pop_word()              { cpu.sp += 2; return memory_read_wor
  */
 
 
-/* 存储 CPU 经过寻址后得到的地址和该地址对应的值 */
-uint16_t op_address;
-uint8_t  op_value;
-uint8_t additional_cycles;  // 对于某些寻址方式, 如果跨页访问, 需要多使用一个 CPU Cycle
+
+/* CPU 时钟, 在 cpu_run 中包括当前指令在内已经执行的 Cycle,
+ * 使指令中的 PPU 寄存器写入等操作 (ppu_catch_up) 能够得到准确的时间
+ */
+uint64_t cpu_clock(struct nes_machine *m) {
+    return m->cpu_cycles + m->cpu_run_cycles;
+}
+
+/* 取出写入内存引起的 CPU 暂停 (OAM DMA) 的 Cycle 数, clock 为写入完成时的 CPU Cycle,
+ * 在奇数 Cycle 开始 DMA 时需要多等待 1 个 Cycle
+ */
+static inline int cpu_take_stall(struct nes_machine *m, uint64_t clock) {
+    int stall = m->cpu_stall + (int)(clock & 1);
+    m->cpu_stall = 0;
+    return stall;
+}
+
+/* 各指令的基本 Cycle 数, 跨页访问等情况需要的额外 Cycle 在执行时另外计算 */
+#define CPU_CYCLE_TABLE_ENTRY(code, mode, op, cycles) [code] = cycles,
+static const uint8_t cpu_cycle_table[256] = {
+    CPU_OPCODE_TABLE(CPU_CYCLE_TABLE_ENTRY)
+};
+
+/* 指令分派方式:
+ * 默认使用 computed goto (GCC 扩展) 实现的 threaded code, 每个操作码对应一段由寻址方式和指令拼接而成的代码;
+ * 编译时定义 BEMU_CPU_SWITCH_DISPATCH, 或编译器不支持 computed goto 时, 使用下面基于 switch 的实现,
+ * 该实现作为参考, 可用于对比两者的运行结果
+ */
+#if defined(__GNUC__) && !defined(BEMU_CPU_SWITCH_DISPATCH)
+#define CPU_THREADED_DISPATCH
+#endif
+
+/* 性能分析与指令跟踪需要逐条指令记录, 此时不使用 JIT (由 CMakeLists.txt 保证) */
+#if (defined(BEMU_CPU_PROFILE) || defined(BEMU_CPU_TRACE)) && defined(BEMU_CPU_JIT)
+#error "BEMU_CPU_JIT 不能与 BEMU_CPU_PROFILE 或 BEMU_CPU_TRACE 同时使用"
+#endif
+
+#if defined(BEMU_CPU_JIT) && !defined(CPU_THREADED_DISPATCH)
+#error "BEMU_CPU_JIT 需要 threaded code 实现, 不能与 BEMU_CPU_SWITCH_DISPATCH 同时使用"
+#endif
+
+#ifndef CPU_THREADED_DISPATCH
+
+/* CPU 经过寻址后得到的地址和该地址对应的值保存在 m->op_address 与 m->op_value 中 */
 
 /* implied (1 字节)
  * 隐含寻址. 与累加器寻址类似, 不过指令所需的操作数不在 A 中, 而在其他寄存器中
  */
-void cpu_addressing_implied() { additional_cycles = 0; }
+void cpu_addressing_implied(struct nes_machine *m) { m->additional_cycles = 0; }
 
 /* accumulator (1 字节)
  * 缩写: A
  * 累加器寻址. 指令所需操作数在累加器 A 中, 无需操作数
  */
-void cpu_addressing_accumulator() { additional_cycles = 0; }
+void cpu_addressing_accumulator(struct nes_machine *m) { m->additional_cycles = 0; }
 
 /* immediate (2 字节)
  * 缩写: #v
  * 立即数寻址. 后面跟一个 8 位的立即数
  */
-void cpu_addressing_immediate() {
-    op_value = memory_read_byte(cpu.pc);
-    cpu.pc++;
-    additional_cycles = 0;
+void cpu_addressing_immediate(struct nes_machine *m) {
+    m->op_value = memory_read_byte(m, m->cpu.pc);
+    m->cpu.pc++;
+    m->additional_cycles = 0;
 }
 
 /* zeropage (2 字节)
  * 缩写: d
  * 零页寻址. 地址 00 ~ FF 为零页地址
  */
-void cpu_addressing_zeropage() {
-    op_address = memory_read_byte(cpu.pc);
-    op_value = memory_read_byte(op_address);
-    cpu.pc++;
-    additional_cycles = 0;
+void cpu_addressing_zeropage(struct nes_machine *m) {
+    m->op_address = memory_read_byte(m, m->cpu.pc);
+    m->op_value = memory_read_ram(m, m->op_address);
+    m->cpu.pc++;
+    m->additional_cycles = 0;
 }
 
 /* zeropage, X-indexed (2 字节)
  * 缩写: d,x
  * 使用寄存器 X 的零页寻址. 在零页寻址的基础上, 地址与 X 中的值相加
  */
-void cpu_addressing_zeropage_x() {
-    op_address = (memory_read_byte(cpu.pc) + cpu.x) & 0xff;
-    op_value = memory_read_byte(op_address);
-    cpu.pc++;
-    additional_cycles = 0;
+void cpu_addressing_zeropage_x(struct nes_machine *m) {
+    m->op_address = (memory_read_byte(m, m->cpu.pc) + m->cpu.x) & 0xff;
+    m->op_value = memory_read_ram(m, m->op_address);
+    m->cpu.pc++;
+    m->additional_cycles = 0;
 }
 
 /* zeropage, Y-indexed (2 字节)
  * 缩写: d,y
  * 使用寄存器 Y 的零页寻址. 在零页寻址的基础上, 地址与 Y 中的值相加
  */
-void cpu_addressing_zeropage_y() {
-    op_address = (memory_read_byte(cpu.pc) + cpu.y) & 0xff;
-    op_value = memory_read_byte(op_address);
-    cpu.pc++;
-    additional_cycles = 0;
+void cpu_addressing_zeropage_y(struct nes_machine *m) {
+    m->op_address = (memory_read_byte(m, m->cpu.pc) + m->cpu.y) & 0xff;
+    m->op_value = memory_read_ram(m, m->op_address);
+    m->cpu.pc++;
+    m->additional_cycles = 0;
 }
 
 /* absolute (3 字节)
  * 缩写: a
  * 直接寻址. 操作数即为内存地址, 低位在前, 高位在后
  */
-void cpu_addressing_absolute() {
-    op_address = memory_read_word(cpu.pc);
-    op_value = memory_read_byte(op_address);
-    cpu.pc += 2;
-    additional_cycles = 0;
+void cpu_addressing_absolute(struct nes_machine *m) {
+    m->op_address = memory_read_word(m, m->cpu.pc);
+    m->op_value = memory_read_byte(m, m->op_address);
+    m->cpu.pc += 2;
+    m->additional_cycles = 0;
 }
 
 /* absolute, X-indexed (3 字节)
  * 缩写: a,x
  * 使用寄存器 X 的直接变址寻址. 16 位地址做为基地址, 与寄存器 X 的内容相加
  */
-void cpu_addressing_absolute_x() {
-    op_address = memory_read_word(cpu.pc) + cpu.x;
-    op_value = memory_read_byte(op_address);
-    cpu.pc += 2;
-    if ((op_address >> 8) != (cpu.pc >> 8)) {
-        additional_cycles = 1;
+void cpu_addressing_absolute_x(struct nes_machine *m) {
+    m->op_address = memory_read_word(m, m->cpu.pc) + m->cpu.x;
+    m->op_value = memory_read_byte(m, m->op_address);
+    m->cpu.pc += 2;
+    if ((m->op_address >> 8) != (m->cpu.pc >> 8)) {
+        m->additional_cycles = 1;
     } else {
-        additional_cycles = 0;
+        m->additional_cycles = 0;
     }
 }
 
@@ -203,14 +214,14 @@ void cpu_addressing_absolute_x() {
  * 缩写: a,y
  * 使用寄存器 Y 的直接变址寻址. 16 位地址做为基地址, 与寄存器 Y 的内容相加
  */
-void cpu_addressing_absolute_y() {
-    op_address = (memory_read_word(cpu.pc) + cpu.y) & 0xffff;
-    op_value = memory_read_byte(op_address);
-    cpu.pc += 2;
-    if ((op_address >> 8) != (cpu.pc >> 8)) {
-        additional_cycles = 1;
+void cpu_addressing_absolute_y(struct nes_machine *m) {
+    m->op_address = (memory_read_word(m, m->cpu.pc) + m->cpu.y) & 0xffff;
+    m->op_value = memory_read_byte(m, m->op_address);
+    m->cpu.pc += 2;
+    if ((m->op_address >> 8) != (m->cpu.pc >> 8)) {
+        m->additional_cycles = 1;
     } else {
-        additional_cycles = 0;
+        m->additional_cycles = 0;
     }
 }
 
@@ -218,15 +229,15 @@ void cpu_addressing_absolute_y() {
  * 缩写: label
  * 相对寻址. 用于条件转移指令. 指令第二字节为偏移量, 可正可负.
  */
-void cpu_addressing_relative() {
-    op_address = memory_read_byte(cpu.pc);
-    cpu.pc++;
-    if(op_address & 0x80) { op_address -= 0x100; }
-    op_address += cpu.pc;
-    if ((op_address >> 8) != (cpu.pc >> 8)) {
-        additional_cycles = 1;
+void cpu_addressing_relative(struct nes_machine *m) {
+    m->op_address = memory_read_byte(m, m->cpu.pc);
+    m->cpu.pc++;
+    if(m->op_address & 0x80) { m->op_address -= 0x100; }
+    m->op_address += m->cpu.pc;
+    if ((m->op_address >> 8) != (m->cpu.pc >> 8)) {
+        m->additional_cycles = 1;
     } else {
-        additional_cycles = 0;
+        m->additional_cycles = 0;
     }
 }
 
@@ -234,46 +245,46 @@ void cpu_addressing_relative() {
  * 缩写: (a)
  * 间接寻址. 对应地址内存单元中的数做为地址.
  */
-void cpu_addressing_indirect() {
-    uint16_t arg_addr = memory_read_word(cpu.pc);
+void cpu_addressing_indirect(struct nes_machine *m) {
+    uint16_t arg_addr = memory_read_word(m, m->cpu.pc);
 
     /* 据说这是 6502 的 Bug */
     if((arg_addr & 0xff) == 0xff) {
         // 有 Bug 的情况下
-        op_address = (memory_read_byte(arg_addr & 0xff00) << 8) + memory_read_byte(arg_addr);
+        m->op_address = (memory_read_byte(m, arg_addr & 0xff00) << 8) + memory_read_byte(m, arg_addr);
     } else {
         // 正常情况下
-        op_address = memory_read_word(arg_addr);
+        m->op_address = memory_read_word(m, arg_addr);
     }
-    cpu.pc += 2;
-    additional_cycles = 0;
+    m->cpu.pc += 2;
+    m->additional_cycles = 0;
 }
 
 /* indirect, X-indexed (2 字节)
  * 缩写: (d,x)
  * 先变址 X 后间接寻址. 以 X 做为变址, 与基地址相加, 然后间接寻址
  */
-void cpu_addressing_indirect_x() {
-    uint8_t arg_addr = memory_read_byte(cpu.pc);
-    op_address = (memory_read_byte((arg_addr + cpu.x + 1) & 0xff) << 8) | memory_read_byte((arg_addr + cpu.x) & 0xff);
-    op_value = memory_read_byte(op_address);
-    cpu.pc++;
-    additional_cycles = 0;
+void cpu_addressing_indirect_x(struct nes_machine *m) {
+    uint8_t arg_addr = memory_read_byte(m, m->cpu.pc);
+    m->op_address = (memory_read_ram(m, (arg_addr + m->cpu.x + 1) & 0xff) << 8) | memory_read_ram(m, (arg_addr + m->cpu.x) & 0xff);
+    m->op_value = memory_read_byte(m, m->op_address);
+    m->cpu.pc++;
+    m->additional_cycles = 0;
 }
 
 /* indirect, Y-indexed (2 字节)
  * 缩写: (d),y
  * 后变址 Y 间接寻址. 对操作数中的零页地址先做一次间接寻址, 得到 16 位地址, 再与 Y 相加, 对相加后得到的地址进行直接寻址.
  */
-void cpu_addressing_indirect_y() {
-    uint8_t arg_addr = memory_read_byte(cpu.pc);
-    op_address = (((memory_read_byte((arg_addr + 1) & 0xff) << 8) | memory_read_byte(arg_addr)) + cpu.y) & 0xffff;
-    op_value = memory_read_byte(op_address);
-    cpu.pc++;
-    if ((op_address >> 8) != (cpu.pc >> 8)) {
-        additional_cycles = 1;
+void cpu_addressing_indirect_y(struct nes_machine *m) {
+    uint8_t arg_addr = memory_read_byte(m, m->cpu.pc);
+    m->op_address = (((memory_read_ram(m, (arg_addr + 1) & 0xff) << 8) | memory_read_ram(m, arg_addr)) + m->cpu.y) & 0xffff;
+    m->op_value = memory_read_byte(m, m->op_address);
+    m->cpu.pc++;
+    if ((m->op_address >> 8) != (m->cpu.pc >> 8)) {
+        m->additional_cycles = 1;
     } else {
-        additional_cycles = 0;
+        m->additional_cycles = 0;
     }
 }
 
@@ -281,438 +292,717 @@ void cpu_addressing_indirect_y() {
 
 /* ALU ******/
 
-void cpu_ora() {
-    cpu.a |= op_value;
-    cpu_checknz(cpu.a);
+void cpu_ora(struct nes_machine *m) {
+    m->cpu.a |= m->op_value;
+    cpu_checknz(m, m->cpu.a);
 }
 
-void cpu_and() {
-    cpu.a &= op_value;
-    cpu_checknz(cpu.a);
+void cpu_and(struct nes_machine *m) {
+    m->cpu.a &= m->op_value;
+    cpu_checknz(m, m->cpu.a);
 }
 
-void cpu_eor() {
-    cpu.a ^= op_value;
-    cpu_checknz(cpu.a);
+void cpu_eor(struct nes_machine *m) {
+    m->cpu.a ^= m->op_value;
+    cpu_checknz(m, m->cpu.a);
 }
 
-void cpu_asl() {
-    cpu_modify_flag(FLAG_CARRY, op_value & 0x80);
-    op_value <<= 1;
-    cpu_checknz(op_value);
-    memory_write_byte(op_address, op_value);
+void cpu_asl(struct nes_machine *m) {
+    cpu_modify_flag(m, FLAG_CARRY, m->op_value & 0x80);
+    m->op_value <<= 1;
+    cpu_checknz(m, m->op_value);
+    memory_write_byte(m, m->op_address, m->op_value);
 }
 
-void cpu_asla() {
-    cpu_modify_flag(FLAG_CARRY, cpu.a & 0x80);
-    cpu.a <<= 1;
-    cpu_checknz(cpu.a);
+void cpu_asla(struct nes_machine *m) {
+    cpu_modify_flag(m, FLAG_CARRY, m->cpu.a & 0x80);
+    m->cpu.a <<= 1;
+    cpu_checknz(m, m->cpu.a);
 }
 
-void cpu_rol() {
-    uint8_t tmp = cpu.p & FLAG_CARRY;
-    cpu_modify_flag(FLAG_CARRY, op_value & 0x80);
-    op_value <<= 1;
-    op_value |= tmp ? 1 : 0;
-    memory_write_byte(op_address, op_value);
-    cpu_checknz(op_value);
+void cpu_rol(struct nes_machine *m) {
+    uint8_t tmp = CPU_FLAG_CARRY;
+    cpu_modify_flag(m, FLAG_CARRY, m->op_value & 0x80);
+    m->op_value <<= 1;
+    m->op_value |= tmp ? 1 : 0;
+    memory_write_byte(m, m->op_address, m->op_value);
+    cpu_checknz(m, m->op_value);
 }
 
-void cpu_rola() {
-    uint8_t tmp = cpu.p & FLAG_CARRY;
-    cpu_modify_flag(FLAG_CARRY, cpu.a & 0x80);
-    cpu.a <<= 1;
-    cpu.a |= tmp ? 1 : 0;
-    cpu_checknz(cpu.a);
+void cpu_rola(struct nes_machine *m) {
+    uint8_t tmp = CPU_FLAG_CARRY;
+    cpu_modify_flag(m, FLAG_CARRY, m->cpu.a & 0x80);
+    m->cpu.a <<= 1;
+    m->cpu.a |= tmp ? 1 : 0;
+    cpu_checknz(m, m->cpu.a);
 }
 
-void cpu_ror() {
-    uint8_t tmp = cpu.p & FLAG_CARRY;
-    cpu_modify_flag(FLAG_CARRY, op_value & 0x01);
-    op_value >>= 1;
-    op_value |= (tmp ? 1 : 0) << 7;
-    memory_write_byte(op_address, op_value);
-    cpu_checknz(op_value);
+void cpu_ror(struct nes_machine *m) {
+    uint8_t tmp = CPU_FLAG_CARRY;
+    cpu_modify_flag(m, FLAG_CARRY, m->op_value & 0x01);
+    m->op_value >>= 1;
+    m->op_value |= (tmp ? 1 : 0) << 7;
+    memory_write_byte(m, m->op_address, m->op_value);
+    cpu_checknz(m, m->op_value);
 }
 
-void cpu_rora() {
-    uint8_t tmp = cpu.p & FLAG_CARRY;
-    cpu_modify_flag(FLAG_CARRY, cpu.a & 0x01);
-    cpu.a >>= 1;
-    cpu.a |= (tmp ? 1 : 0) << 7;
-    cpu_checknz(cpu.a);
+void cpu_rora(struct nes_machine *m) {
+    uint8_t tmp = CPU_FLAG_CARRY;
+    cpu_modify_flag(m, FLAG_CARRY, m->cpu.a & 0x01);
+    m->cpu.a >>= 1;
+    m->cpu.a |= (tmp ? 1 : 0) << 7;
+    cpu_checknz(m, m->cpu.a);
 }
 
-void cpu_lsr() {
-    cpu_modify_flag(FLAG_CARRY, op_value & 0x01);
-    op_value >>= 1;
-    memory_write_byte(op_address, op_value);
-    cpu_checknz(op_value);
+void cpu_lsr(struct nes_machine *m) {
+    cpu_modify_flag(m, FLAG_CARRY, m->op_value & 0x01);
+    m->op_value >>= 1;
+    memory_write_byte(m, m->op_address, m->op_value);
+    cpu_checknz(m, m->op_value);
 }
 
-void cpu_lsra() {
-    cpu_modify_flag(FLAG_CARRY, cpu.a & 0x01);
-    cpu.a >>= 1;
-    cpu_checknz(cpu.a);
+void cpu_lsra(struct nes_machine *m) {
+    cpu_modify_flag(m, FLAG_CARRY, m->cpu.a & 0x01);
+    m->cpu.a >>= 1;
+    cpu_checknz(m, m->cpu.a);
 }
 
-void cpu_adc() {
+void cpu_adc(struct nes_machine *m) {
     uint16_t tmp;
-    tmp = op_value + cpu.a + ((cpu.p & FLAG_CARRY) ? 1 : 0);
-    cpu_modify_flag(FLAG_CARRY, tmp & 0xff00);
-    cpu_modify_flag(FLAG_OVERFLOW, ((op_value ^ tmp) & (cpu.a ^ tmp)) & 0x80);
-    cpu.a = (uint8_t)(tmp & 0xff);
-    cpu_checknz(cpu.a);
+    tmp = m->op_value + m->cpu.a + (CPU_FLAG_CARRY ? 1 : 0);
+    cpu_modify_flag(m, FLAG_CARRY, tmp & 0xff00);
+    cpu_modify_flag(m, FLAG_OVERFLOW, ((m->op_value ^ tmp) & (m->cpu.a ^ tmp)) & 0x80);
+    m->cpu.a = (uint8_t)(tmp & 0xff);
+    cpu_checknz(m, m->cpu.a);
 }
 
-void cpu_sbc() {
+void cpu_sbc(struct nes_machine *m) {
     uint16_t tmp;
-    tmp = cpu.a - op_value - (1 - ((cpu.p & FLAG_CARRY) ? 1 : 0));
-    cpu_modify_flag(FLAG_CARRY, (tmp & 0xff00) == 0);
-    cpu_modify_flag(FLAG_OVERFLOW, ((cpu.a ^ op_value) & (cpu.a ^ tmp)) & 0x80);
-    cpu.a = (uint8_t)(tmp & 0xff);
-    cpu_checknz(cpu.a);
+    tmp = m->cpu.a - m->op_value - (1 - (CPU_FLAG_CARRY ? 1 : 0));
+    cpu_modify_flag(m, FLAG_CARRY, (tmp & 0xff00) == 0);
+    cpu_modify_flag(m, FLAG_OVERFLOW, ((m->cpu.a ^ m->op_value) & (m->cpu.a ^ tmp)) & 0x80);
+    m->cpu.a = (uint8_t)(tmp & 0xff);
+    cpu_checknz(m, m->cpu.a);
 }
 
 /* Branching ******/
 
-void cpu_bmi() { if(cpu.p & FLAG_NEGATIVE) { cpu.pc = op_address; }}
-void cpu_bcs() { if(cpu.p & FLAG_CARRY) { cpu.pc = op_address; }}
-void cpu_beq() { if(cpu.p & FLAG_ZERO) { cpu.pc = op_address; }}
-void cpu_bvs() { if(cpu.p & FLAG_OVERFLOW) { cpu.pc = op_address; }}
+void cpu_bmi(struct nes_machine *m) { if(CPU_FLAG_NEGATIVE) { m->cpu.pc = m->op_address; }}
+void cpu_bcs(struct nes_machine *m) { if(CPU_FLAG_CARRY) { m->cpu.pc = m->op_address; }}
+void cpu_beq(struct nes_machine *m) { if(CPU_FLAG_ZERO) { m->cpu.pc = m->op_address; }}
+void cpu_bvs(struct nes_machine *m) { if(CPU_FLAG_OVERFLOW) { m->cpu.pc = m->op_address; }}
 
-void cpu_bpl() { if(!(cpu.p & FLAG_NEGATIVE)) { cpu.pc = op_address; }}
-void cpu_bcc() { if(!(cpu.p & FLAG_CARRY)) { cpu.pc = op_address; }}
-void cpu_bne() { if(!(cpu.p & FLAG_ZERO)) { cpu.pc = op_address; }}
-void cpu_bvc() { if(!(cpu.p & FLAG_OVERFLOW)) { cpu.pc = op_address; }}
+void cpu_bpl(struct nes_machine *m) { if(!CPU_FLAG_NEGATIVE) { m->cpu.pc = m->op_address; }}
+void cpu_bcc(struct nes_machine *m) { if(!CPU_FLAG_CARRY) { m->cpu.pc = m->op_address; }}
+void cpu_bne(struct nes_machine *m) { if(!CPU_FLAG_ZERO) { m->cpu.pc = m->op_address; }}
+void cpu_bvc(struct nes_machine *m) { if(!CPU_FLAG_OVERFLOW) { m->cpu.pc = m->op_address; }}
 
 /* Comapre ******/
 
-void cpu_bit() {
-    cpu_modify_flag(FLAG_OVERFLOW, op_value & 0x40);
-    cpu_modify_flag(FLAG_NEGATIVE, op_value & 0x80);
-    cpu_modify_flag(FLAG_ZERO, !(op_value & cpu.a));
+void cpu_bit(struct nes_machine *m) {
+    cpu_modify_flag(m, FLAG_OVERFLOW, m->op_value & 0x40);
+    cpu_modify_flag(m, FLAG_NEGATIVE, m->op_value & 0x80);
+    cpu_modify_flag(m, FLAG_ZERO, !(m->op_value & m->cpu.a));
 }
 
-void cpu_cmp() {
-    int tmpc = cpu.a - op_value;
-    cpu_modify_flag(FLAG_CARRY, tmpc >= 0);
-    cpu_checknz((uint8_t)tmpc);
+void cpu_cmp(struct nes_machine *m) {
+    int tmpc = m->cpu.a - m->op_value;
+    cpu_modify_flag(m, FLAG_CARRY, tmpc >= 0);
+    cpu_checknz(m, (uint8_t)tmpc);
 }
 
-void cpu_cpx() {
-    int tmpc = cpu.x - op_value;
-    cpu_modify_flag(FLAG_CARRY, tmpc >= 0);
-    cpu_checknz((uint8_t)tmpc);
+void cpu_cpx(struct nes_machine *m) {
+    int tmpc = m->cpu.x - m->op_value;
+    cpu_modify_flag(m, FLAG_CARRY, tmpc >= 0);
+    cpu_checknz(m, (uint8_t)tmpc);
 }
 
-void cpu_cpy() {
-    int tmpc = cpu.y - op_value;
-    cpu_modify_flag(FLAG_CARRY, tmpc >= 0);
-    cpu_checknz((uint8_t)tmpc);
+void cpu_cpy(struct nes_machine *m) {
+    int tmpc = m->cpu.y - m->op_value;
+    cpu_modify_flag(m, FLAG_CARRY, tmpc >= 0);
+    cpu_checknz(m, (uint8_t)tmpc);
 }
 
 /* Flag ******/
 
-void cpu_clc() { cpu_modify_flag(FLAG_CARRY, 0); }
-void cpu_cli() { cpu_modify_flag(FLAG_INTERRUPT, 0); }
-void cpu_cld() { cpu_modify_flag(FLAG_DECIMAL, 0); }
-void cpu_clv() { cpu_modify_flag(FLAG_OVERFLOW, 0); }
-void cpu_sec() { cpu_modify_flag(FLAG_CARRY, 1); }
-void cpu_sei() { cpu_modify_flag(FLAG_INTERRUPT, 1); }
-void cpu_sed() { cpu_modify_flag(FLAG_DECIMAL, 1); }
+void cpu_clc(struct nes_machine *m) { cpu_modify_flag(m, FLAG_CARRY, 0); }
+void cpu_cli(struct nes_machine *m) { cpu_modify_flag(m, FLAG_INTERRUPT, 0); cpu_irq_poll(m); }
+void cpu_cld(struct nes_machine *m) { cpu_modify_flag(m, FLAG_DECIMAL, 0); }
+void cpu_clv(struct nes_machine *m) { cpu_modify_flag(m, FLAG_OVERFLOW, 0); }
+void cpu_sec(struct nes_machine *m) { cpu_modify_flag(m, FLAG_CARRY, 1); }
+void cpu_sei(struct nes_machine *m) { cpu_modify_flag(m, FLAG_INTERRUPT, 1); }
+void cpu_sed(struct nes_machine *m) { cpu_modify_flag(m, FLAG_DECIMAL, 1); }
 
 /* Inc & Dec ******/
 
-void cpu_dec() {
-    uint8_t tmp = op_value - 1;
-    memory_write_byte(op_address, tmp);
-    cpu_checknz(tmp);
+void cpu_dec(struct nes_machine *m) {
+    uint8_t tmp = m->op_value - 1;
+    memory_write_byte(m, m->op_address, tmp);
+    cpu_checknz(m, tmp);
 }
 
-void cpu_dex() {
-    cpu.x--;
-    cpu_checknz(cpu.x);
+void cpu_dex(struct nes_machine *m) {
+    m->cpu.x--;
+    cpu_checknz(m, m->cpu.x);
 }
 
-void cpu_dey() {
-    cpu.y--;
-    cpu_checknz(cpu.y);
+void cpu_dey(struct nes_machine *m) {
+    m->cpu.y--;
+    cpu_checknz(m, m->cpu.y);
 }
 
-void cpu_inc() {
-    uint8_t tmp = op_value + 1;
-    memory_write_byte(op_address, tmp);
-    cpu_checknz(tmp);
+void cpu_inc(struct nes_machine *m) {
+    uint8_t tmp = m->op_value + 1;
+    memory_write_byte(m, m->op_address, tmp);
+    cpu_checknz(m, tmp);
 }
 
-void cpu_inx() {
-    cpu.x++;
-    cpu_checknz(cpu.x);
+void cpu_inx(struct nes_machine *m) {
+    m->cpu.x++;
+    cpu_checknz(m, m->cpu.x);
 }
 
-void cpu_iny() {
-    cpu.y++;
-    cpu_checknz(cpu.y);
+void cpu_iny(struct nes_machine *m) {
+    m->cpu.y++;
+    cpu_checknz(m, m->cpu.y);
 }
 
 /* Load & Store ******/
 
-void cpu_lda() { cpu.a = op_value; cpu_checknz(cpu.a); }
-void cpu_ldx() { cpu.x = op_value; cpu_checknz(cpu.x); }
-void cpu_ldy() { cpu.y = op_value; cpu_checknz(cpu.y); }
-void cpu_sta() { memory_write_byte(op_address, cpu.a); }
-void cpu_stx() { memory_write_byte(op_address, cpu.x); }
-void cpu_sty() { memory_write_byte(op_address, cpu.y); }
+void cpu_lda(struct nes_machine *m) { m->cpu.a = m->op_value; cpu_checknz(m, m->cpu.a); }
+void cpu_ldx(struct nes_machine *m) { m->cpu.x = m->op_value; cpu_checknz(m, m->cpu.x); }
+void cpu_ldy(struct nes_machine *m) { m->cpu.y = m->op_value; cpu_checknz(m, m->cpu.y); }
+void cpu_sta(struct nes_machine *m) { memory_write_byte(m, m->op_address, m->cpu.a); }
+void cpu_stx(struct nes_machine *m) { memory_write_byte(m, m->op_address, m->cpu.x); }
+void cpu_sty(struct nes_machine *m) { memory_write_byte(m, m->op_address, m->cpu.y); }
 
 /* Misc ******/
 
-void cpu_nop() {}
+void cpu_nop(struct nes_machine *m) {}
 
 /* Stack & Jump ******/
 
-void cpu_pha() { cpu_stack_push_byte(cpu.a); }
-void cpu_php() { cpu_stack_push_byte(cpu.p | 0x30); }
-void cpu_pla() { cpu.a = cpu_stack_pop_byte(); cpu_checknz(cpu.a); }
-void cpu_plp() { cpu.p = (cpu_stack_pop_byte() & 0xef) | 0x20; }
-void cpu_rts() { cpu.pc = cpu_stack_pop_word() + 1; }
-void cpu_rti() { cpu.p = cpu_stack_pop_byte() | FLAG_UNUSED; cpu.pc = cpu_stack_pop_word(); }
-void cpu_jmp() { cpu.pc = op_address; }
-void cpu_jsr() { cpu_stack_push_word(cpu.pc - 1); cpu.pc = op_address; }
-void cpu_brk() {
-    cpu_stack_push_word(cpu.pc - 1);
-    cpu_stack_push_byte(cpu.p);
-    cpu.p |= FLAG_UNUSED | FLAG_BREAK;
-    cpu.pc = memory_read_word(0xfffa); // NMI 中断
+void cpu_pha(struct nes_machine *m) { cpu_stack_push_byte(m, m->cpu.a); }
+void cpu_php(struct nes_machine *m) { cpu_stack_push_byte(m, cpu_get_p(m) | 0x30); }
+void cpu_pla(struct nes_machine *m) { m->cpu.a = cpu_stack_pop_byte(m); cpu_checknz(m, m->cpu.a); }
+void cpu_plp(struct nes_machine *m) { cpu_set_p(m, (cpu_stack_pop_byte(m) & 0xef) | 0x20); cpu_irq_poll(m); }
+void cpu_rts(struct nes_machine *m) { m->cpu.pc = cpu_stack_pop_word(m) + 1; CPU_PROFILE_RETURN(m); }
+void cpu_rti(struct nes_machine *m) { cpu_set_p(m, cpu_stack_pop_byte(m) | FLAG_UNUSED); m->cpu.pc = cpu_stack_pop_word(m); CPU_PROFILE_RETURN(m); cpu_irq_poll(m); }
+void cpu_jmp(struct nes_machine *m) { m->cpu.pc = m->op_address; }
+void cpu_jsr(struct nes_machine *m) { cpu_stack_push_word(m, m->cpu.pc - 1); m->cpu.pc = m->op_address; CPU_PROFILE_CALL(m); }
+void cpu_brk(struct nes_machine *m) {
+    cpu_stack_push_word(m, m->cpu.pc - 1);
+    cpu_stack_push_byte(m, cpu_get_p(m));
+    m->cpu.p |= FLAG_UNUSED | FLAG_BREAK;
+    m->cpu.pc = memory_read_word(m, 0xfffa); // NMI 中断
+    CPU_PROFILE_CALL(m);
 }
 
 /* Transfer ******/
 
-void cpu_tax() { cpu.x = cpu.a; cpu_checknz(cpu.x); }
-void cpu_tay() { cpu.y = cpu.a; cpu_checknz(cpu.y); }
-void cpu_txa() { cpu.a = cpu.x; cpu_checknz(cpu.a); }
-void cpu_tya() { cpu.a = cpu.y; cpu_checknz(cpu.a); }
-void cpu_tsx() { cpu.x = cpu.sp; cpu_checknz(cpu.x); }
-void cpu_txs() { cpu.sp = cpu.x; }
+void cpu_tax(struct nes_machine *m) { m->cpu.x = m->cpu.a; cpu_checknz(m, m->cpu.x); }
+void cpu_tay(struct nes_machine *m) { m->cpu.y = m->cpu.a; cpu_checknz(m, m->cpu.y); }
+void cpu_txa(struct nes_machine *m) { m->cpu.a = m->cpu.x; cpu_checknz(m, m->cpu.a); }
+void cpu_tya(struct nes_machine *m) { m->cpu.a = m->cpu.y; cpu_checknz(m, m->cpu.a); }
+void cpu_tsx(struct nes_machine *m) { m->cpu.x = m->cpu.sp; cpu_checknz(m, m->cpu.x); }
+void cpu_txs(struct nes_machine *m) { m->cpu.sp = m->cpu.x; }
 
 /* Undocumented Opcodes: 未实现 ******/
 
 /****************************************************************************************/
 
-uint64_t cpu_clock() {
-    return cpu_cycles;
-}
-
 /* CPU 运行指定 Cycle */
 
-void cpu_run(int cycles) {
+void cpu_run(struct nes_machine *m, int cycles) {
     uint8_t opcode;
     int tmp = cycles;
+    CPU_PROFILE_BEGIN(m, cycles);
     while(cycles > 0) {
-        // 仅供调试时使用
-        // printf("PC: %x\t", cpu.pc);
-        //////
-
-        opcode = memory_read_byte(cpu.pc);
+        CPU_PROFILE_INSTRUCTION(m, m->cpu.pc, cycles);
+        CPU_TRACE_INSTRUCTION(m, m->cpu.pc, m->cpu_cycles + (tmp - cycles));
 
-        // 仅供调试时使用
-        // printf("%x\t", opcode);
-        // disasm_once(cartridge.prg_rom, (cpu.pc - 0x8000) % prg_rom_size);
-        //////
-
-        cpu.pc++;
+        opcode = memory_read_byte(m, m->cpu.pc);
+        m->cpu.pc++;
+        m->cpu_run_cycles = tmp - cycles + cpu_cycle_table[opcode];
 
         switch(opcode) {
             /* STEP 1: 根据寻址方式取出操作数
              * STEP 2: 执行对应指令
              * STEP 3: 更新 cycles
              */
-            case 0x00: cpu_addressing_implied();     cpu_brk();  cycles -= 7; break;
-            case 0x01: cpu_addressing_indirect_x();  cpu_ora();  cycles -= 6; break;
-            case 0x04: cpu_addressing_zeropage();    cpu_nop();  cycles -= 1; break;
-            case 0x05: cpu_addressing_zeropage();    cpu_ora();  cycles -= 3; break;
-            case 0x06: cpu_addressing_zeropage();    cpu_asl();  cycles -= 5; break;
-            case 0x08: cpu_addressing_implied();     cpu_php();  cycles -= 3; break;
-            case 0x09: cpu_addressing_immediate();   cpu_ora();  cycles -= 2; break;
-            case 0x0A: cpu_addressing_accumulator(); cpu_asla(); cycles -= 2; break;
-            case 0x0C: cpu_addressing_absolute();    cpu_nop();  cycles -= 1; break;
-            case 0x0D: cpu_addressing_absolute();    cpu_ora();  cycles -= 4; break;
-            case 0x0E: cpu_addressing_absolute();    cpu_asl();  cycles -= 6; break;
-            case 0x10: cpu_addressing_relative();    cpu_bpl();  cycles -= 2; break;
-            case 0x11: cpu_addressing_indirect_y();  cpu_ora();  cycles -= 5; break;
-            case 0x14: cpu_addressing_zeropage_x();  cpu_nop();  cycles -= 1; break;
-            case 0x15: cpu_addressing_zeropage_x();  cpu_ora();  cycles -= 4; break;
-            case 0x16: cpu_addressing_zeropage_x();  cpu_asl();  cycles -= 6; break;
-            case 0x18: cpu_addressing_implied();     cpu_clc();  cycles -= 2; break;
-            case 0x19: cpu_addressing_absolute_y();  cpu_ora();  cycles -= 4; break;
-            case 0x1A: cpu_addressing_accumulator(); cpu_nop();  cycles -= 1; break;
-            case 0x1C: cpu_addressing_absolute_x();  cpu_nop();  cycles -= 1; break;
-            case 0x1D: cpu_addressing_absolute_x();  cpu_ora();  cycles -= 4; break;
-            case 0x1E: cpu_addressing_absolute_x();  cpu_asl();  cycles -= 7; break;
-            case 0x20: cpu_addressing_absolute();    cpu_jsr();  cycles -= 6; break;
-            case 0x21: cpu_addressing_indirect_x();  cpu_and();  cycles -= 6; break;
-            case 0x24: cpu_addressing_zeropage();    cpu_bit();  cycles -= 3; break;
-            case 0x25: cpu_addressing_zeropage();    cpu_and();  cycles -= 3; break;
-            case 0x26: cpu_addressing_zeropage();    cpu_rol();  cycles -= 5; break;
-            case 0x28: cpu_addressing_implied();     cpu_plp();  cycles -= 3; break;
-            case 0x29: cpu_addressing_immediate();   cpu_and();  cycles -= 2; break;
-            case 0x2A: cpu_addressing_accumulator(); cpu_rola(); cycles -= 2; break;
-            case 0x2C: cpu_addressing_absolute();    cpu_bit();  cycles -= 4; break;
-            case 0x2D: cpu_addressing_absolute();    cpu_and();  cycles -= 2; break;
-            case 0x2E: cpu_addressing_absolute();    cpu_rol();  cycles -= 6; break;
-            case 0x30: cpu_addressing_relative();    cpu_bmi();  cycles -= 2; break;
-            case 0x31: cpu_addressing_indirect_y();  cpu_and();  cycles -= 5; break;
-            case 0x34: cpu_addressing_zeropage_x();  cpu_nop();  cycles -= 1; break;
-            case 0x35: cpu_addressing_zeropage_x();  cpu_and();  cycles -= 4; break;
-            case 0x36: cpu_addressing_zeropage_x();  cpu_rol();  cycles -= 6; break;
-            case 0x38: cpu_addressing_implied();     cpu_sec();  cycles -= 2; break;
-            case 0x39: cpu_addressing_absolute_y();  cpu_and();  cycles -= 4; break;
-            case 0x3A: cpu_addressing_accumulator(); cpu_nop();  cycles -= 1; break;
-            case 0x3C: cpu_addressing_absolute_x();  cpu_nop();  cycles -= 1; break;
-            case 0x3D: cpu_addressing_absolute_x();  cpu_and();  cycles -= 4; break;
-            case 0x3E: cpu_addressing_absolute_x();  cpu_rol();  cycles -= 7; break;
-            case 0x40: cpu_addressing_implied();     cpu_rti();  cycles -= 6; break;
-            case 0x41: cpu_addressing_indirect_x();  cpu_eor();  cycles -= 6; break;
-            case 0x44: cpu_addressing_zeropage();    cpu_nop();  cycles -= 1; break;
-            case 0x45: cpu_addressing_zeropage();    cpu_eor();  cycles -= 3; break;
-            case 0x46: cpu_addressing_zeropage();    cpu_lsr();  cycles -= 5; break;
-            case 0x48: cpu_addressing_implied();     cpu_pha();  cycles -= 3; break;
-            case 0x49: cpu_addressing_immediate();   cpu_eor();  cycles -= 2; break;
-            case 0x4A: cpu_addressing_accumulator(); cpu_lsra(); cycles -= 2; break;
-            case 0x4C: cpu_addressing_absolute();    cpu_jmp();  cycles -= 3; break;
-            case 0x4D: cpu_addressing_absolute();    cpu_eor();  cycles -= 4; break;
-            case 0x4E: cpu_addressing_absolute();    cpu_lsr();  cycles -= 6; break;
-            case 0x50: cpu_addressing_relative();    cpu_bvc();  cycles -= 2; break;
-            case 0x51: cpu_addressing_indirect_y();  cpu_eor();  cycles -= 5; break;
-            case 0x54: cpu_addressing_zeropage_x();  cpu_nop();  cycles -= 1; break;
-            case 0x55: cpu_addressing_zeropage_x();  cpu_eor();  cycles -= 4; break;
-            case 0x56: cpu_addressing_zeropage_x();  cpu_lsr();  cycles -= 6; break;
-            case 0x59: cpu_addressing_absolute_y();  cpu_eor();  cycles -= 4; break;
-            case 0x5A: cpu_addressing_accumulator(); cpu_nop();  cycles -= 1; break;
-            case 0x5C: cpu_addressing_absolute_x();  cpu_nop();  cycles -= 1; break;
-            case 0x5D: cpu_addressing_absolute_x();  cpu_eor();  cycles -= 4; break;
-            case 0x5E: cpu_addressing_absolute_x();  cpu_lsr();  cycles -= 7; break;
-            case 0x60: cpu_addressing_implied();     cpu_rts();  cycles -= 6; break;
-            case 0x61: cpu_addressing_indirect_x();  cpu_adc();  cycles -= 6; break;
-            case 0x64: cpu_addressing_zeropage();    cpu_nop();  cycles -= 1; break;
-            case 0x65: cpu_addressing_zeropage();    cpu_adc();  cycles -= 3; break;
-            case 0x66: cpu_addressing_zeropage();    cpu_ror();  cycles -= 5; break;
-            case 0x68: cpu_addressing_implied();     cpu_pla();  cycles -= 4; break;
-            case 0x69: cpu_addressing_immediate();   cpu_adc();  cycles -= 2; break;
-            case 0x6A: cpu_addressing_accumulator(); cpu_rora(); cycles -= 2; break;
-            case 0x6C: cpu_addressing_indirect();    cpu_jmp();  cycles -= 5; break;
-            case 0x6D: cpu_addressing_absolute();    cpu_adc();  cycles -= 4; break;
-            case 0x6E: cpu_addressing_absolute();    cpu_ror();  cycles -= 6; break;
-            case 0x70: cpu_addressing_relative();    cpu_bvs();  cycles -= 2; break;
-            case 0x71: cpu_addressing_indirect_y();  cpu_adc();  cycles -= 5; break;
-            case 0x74: cpu_addressing_zeropage();    cpu_nop();  cycles -= 1; break;
-            case 0x75: cpu_addressing_zeropage_x();  cpu_adc();  cycles -= 4; break;
-            case 0x76: cpu_addressing_zeropage_x();  cpu_ror();  cycles -= 6; break;
-            case 0x78: cpu_addressing_implied();     cpu_sei();  cycles -= 2; break;
-            case 0x79: cpu_addressing_absolute_y();  cpu_adc();  cycles -= 4; break;
-            case 0x7A: cpu_addressing_accumulator(); cpu_nop();  cycles -= 1; break;
-            case 0x7C: cpu_addressing_absolute_x();  cpu_nop();  cycles -= 1; break;
-            case 0x7D: cpu_addressing_absolute_x();    cpu_adc();  cycles -= 4; break;
-            case 0x7E: cpu_addressing_absolute_x();    cpu_ror();  cycles -= 7; break;
-            case 0x80: cpu_addressing_immediate();   cpu_nop();  cycles -= 1; break;
-            case 0x81: cpu_addressing_indirect_x();  cpu_sta();  cycles -= 6; break;
-            case 0x84: cpu_addressing_zeropage();    cpu_sty();  cycles -= 3; break;
-            case 0x85: cpu_addressing_zeropage();    cpu_sta();  cycles -= 3; break;
-            case 0x86: cpu_addressing_zeropage();    cpu_stx();  cycles -= 3; break;
-            case 0x88: cpu_addressing_implied();     cpu_dey();  cycles -= 2; break;
-            case 0x8A: cpu_addressing_implied();     cpu_txa();  cycles -= 2; break;
-            case 0x8C: cpu_addressing_absolute();    cpu_sty();  cycles -= 4; break;
-            case 0x8D: cpu_addressing_absolute();    cpu_sta();  cycles -= 4; break;
-            case 0x8E: cpu_addressing_absolute();    cpu_stx();  cycles -= 4; break;
-            case 0x90: cpu_addressing_relative();    cpu_bcc();  cycles -= 2; break;
-            case 0x91: cpu_addressing_indirect_y();  cpu_sta();  cycles -= 6; break;
-            case 0x94: cpu_addressing_zeropage_x();  cpu_sty();  cycles -= 4; break;
-            case 0x95: cpu_addressing_zeropage_x();  cpu_sta();  cycles -= 4; break;
-            case 0x96: cpu_addressing_zeropage_y();  cpu_stx();  cycles -= 4; break;
-            case 0x98: cpu_addressing_implied();     cpu_tya();  cycles -= 2; break;
-            case 0x99: cpu_addressing_absolute_y();    cpu_sta();  cycles -= 5; break;
-            case 0x9A: cpu_addressing_implied();     cpu_txs();  cycles -= 2; break;
-            case 0x9D: cpu_addressing_absolute_x();  cpu_sta();  cycles -= 5; break;
-            case 0xA0: cpu_addressing_immediate();   cpu_ldy();  cycles -= 2; break;
-            case 0xA1: cpu_addressing_indirect_x();  cpu_lda();  cycles -= 6; break;
-            case 0xA2: cpu_addressing_immediate();   cpu_ldx();  cycles -= 2; break;
-            case 0xA4: cpu_addressing_zeropage();    cpu_ldy();  cycles -= 3; break;
-            case 0xA5: cpu_addressing_zeropage();    cpu_lda();  cycles -= 3; break;
-            case 0xA6: cpu_addressing_zeropage();    cpu_ldx();  cycles -= 3; break;
-            case 0xA8: cpu_addressing_implied();     cpu_tay();  cycles -= 3; break;
-            case 0xA9: cpu_addressing_immediate();   cpu_lda();  cycles -= 2; break;
-            case 0xAA: cpu_addressing_implied();     cpu_tax();  cycles -= 2; break;
-            case 0xAC: cpu_addressing_absolute();    cpu_ldy();  cycles -= 4; break;
-            case 0xAD: cpu_addressing_absolute();    cpu_lda();  cycles -= 4; break;
-            case 0xAE: cpu_addressing_absolute();    cpu_ldx();  cycles -= 4; break;
-            case 0xB0: cpu_addressing_relative();    cpu_bcs();  cycles -= 2; break;
-            case 0xB1: cpu_addressing_indirect_y();  cpu_lda();  cycles -= 5; break;
-            case 0xB4: cpu_addressing_zeropage_x();  cpu_ldy();  cycles -= 4; break;
-            case 0xB5: cpu_addressing_zeropage_x();  cpu_lda();  cycles -= 4; break;
-            case 0xB6: cpu_addressing_zeropage_y();  cpu_ldx();  cycles -= 4; break;
-            case 0xB8: cpu_addressing_implied();     cpu_clv();  cycles -= 2; break;
-            case 0xB9: cpu_addressing_absolute_y();  cpu_lda();  cycles -= 4; break;
-            case 0xBA: cpu_addressing_implied();     cpu_tsx();  cycles -= 2; break;
-            case 0xBC: cpu_addressing_absolute_x();  cpu_ldy();  cycles -= 4; break;
-            case 0xBD: cpu_addressing_absolute_x();  cpu_lda();  cycles -= 4; break;
-            case 0xBE: cpu_addressing_absolute_y();  cpu_ldx();  cycles -= 4; break;
-            case 0xC0: cpu_addressing_immediate();   cpu_cpy();  cycles -= 2; break;
-            case 0xC1: cpu_addressing_indirect_x();  cpu_cmp();  cycles -= 6; break;
-            case 0xC4: cpu_addressing_zeropage();    cpu_cpy();  cycles -= 3; break;
-            case 0xC5: cpu_addressing_zeropage();    cpu_cmp();  cycles -= 3; break;
-            case 0xC6: cpu_addressing_zeropage();    cpu_dec();  cycles -= 5; break;
-            case 0xC8: cpu_addressing_implied();     cpu_iny();  cycles -= 2; break;
-            case 0xC9: cpu_addressing_immediate();   cpu_cmp();  cycles -= 2; break;
-            case 0xCA: cpu_addressing_implied();     cpu_dex();  cycles -= 2; break;
-            case 0xCC: cpu_addressing_absolute();    cpu_cpy();  cycles -= 4; break;
-            case 0xCD: cpu_addressing_absolute();    cpu_cmp();  cycles -= 4; break;
-            case 0xCE: cpu_addressing_absolute();    cpu_dec();  cycles -= 6; break;
-            case 0xD0: cpu_addressing_relative();    cpu_bne();  cycles -= 2; break;
-            case 0xD1: cpu_addressing_indirect_y();  cpu_cmp();  cycles -= 5; break;
-            case 0xD4: cpu_addressing_zeropage_x();  cpu_nop();  cycles -= 1; break;
-            case 0xD5: cpu_addressing_zeropage_x();  cpu_cmp();  cycles -= 5; break;
-            case 0xD6: cpu_addressing_zeropage_x();  cpu_dec();  cycles -= 6; break;
-            case 0xD8: cpu_addressing_implied();     cpu_cld();  cycles -= 2; break;
-            case 0xD9: cpu_addressing_absolute_y();  cpu_cmp();  cycles -= 4; break;
-            case 0xDA: cpu_addressing_accumulator(); cpu_nop();  cycles -= 1; break;
-            case 0xDC: cpu_addressing_absolute_x();  cpu_nop();  cycles -= 1; break;
-            case 0xDD: cpu_addressing_absolute_x();  cpu_cmp();  cycles -= 4; break;
-            case 0xDE: cpu_addressing_absolute_x();  cpu_dec();  cycles -= 7; break;
-            case 0xE0: cpu_addressing_immediate();   cpu_cpx();  cycles -= 2; break;
-            case 0xE1: cpu_addressing_indirect_x();  cpu_sbc();  cycles -= 6; break;
-            case 0xE4: cpu_addressing_zeropage();    cpu_cpx();  cycles -= 3; break;
-            case 0xE5: cpu_addressing_zeropage();    cpu_sbc();  cycles -= 3; break;
-            case 0xE6: cpu_addressing_zeropage();    cpu_inc();  cycles -= 5; break;
-            case 0xE8: cpu_addressing_implied();     cpu_inx();  cycles -= 2; break;
-            case 0xE9: cpu_addressing_immediate();   cpu_sbc();  cycles -= 2; break;
-            case 0xEA: cpu_addressing_accumulator(); cpu_nop();  cycles -= 2; break;
-            case 0xEC: cpu_addressing_absolute();    cpu_cpx();  cycles -= 4; break;
-            case 0xED: cpu_addressing_absolute();    cpu_sbc();  cycles -= 4; break;
-            case 0xEE: cpu_addressing_absolute();    cpu_inc();  cycles -= 6; break;
-            case 0xF0: cpu_addressing_relative();    cpu_beq();  cycles -= 2; break;
-            case 0xF1: cpu_addressing_indirect_y();  cpu_sbc();  cycles -= 5; break;
-            case 0xF4: cpu_addressing_zeropage_x();  cpu_nop();  cycles -= 1; break;
-            case 0xF5: cpu_addressing_zeropage_x();  cpu_sbc();  cycles -= 4; break;
-            case 0xF6: cpu_addressing_zeropage_x();  cpu_inc();  cycles -= 6; break;
-            case 0xF8: cpu_addressing_implied();     cpu_sed();  cycles -= 2; break;
-            case 0xF9: cpu_addressing_absolute_y();  cpu_sbc();  cycles -= 4; break;
-            case 0xFA: cpu_addressing_accumulator(); cpu_nop();  cycles -= 1; break;
-            case 0xFC: cpu_addressing_absolute_x();  cpu_nop();  cycles -= 1; break;
-            case 0xFD: cpu_addressing_absolute_x();  cpu_sbc();  cycles -= 4; break;
-            case 0xFE: cpu_addressing_absolute_x();  cpu_inc();  cycles -= 7; break;
+            case 0x00: cpu_addressing_implied(m);     cpu_brk(m);  cycles -= 7; break;
+            case 0x01: cpu_addressing_indirect_x(m);  cpu_ora(m);  cycles -= 6; break;
+            case 0x04: cpu_addressing_zeropage(m);    cpu_nop(m);  cycles -= 1; break;
+            case 0x05: cpu_addressing_zeropage(m);    cpu_ora(m);  cycles -= 3; break;
+            case 0x06: cpu_addressing_zeropage(m);    cpu_asl(m);  cycles -= 5; break;
+            case 0x08: cpu_addressing_implied(m);     cpu_php(m);  cycles -= 3; break;
+            case 0x09: cpu_addressing_immediate(m);   cpu_ora(m);  cycles -= 2; break;
+            case 0x0A: cpu_addressing_accumulator(m); cpu_asla(m); cycles -= 2; break;
+            case 0x0C: cpu_addressing_absolute(m);    cpu_nop(m);  cycles -= 1; break;
+            case 0x0D: cpu_addressing_absolute(m);    cpu_ora(m);  cycles -= 4; break;
+            case 0x0E: cpu_addressing_absolute(m);    cpu_asl(m);  cycles -= 6; break;
+            case 0x10: cpu_addressing_relative(m);    cpu_bpl(m);  cycles -= 2; break;
+            case 0x11: cpu_addressing_indirect_y(m);  cpu_ora(m);  cycles -= 5; break;
+            case 0x14: cpu_addressing_zeropage_x(m);  cpu_nop(m);  cycles -= 1; break;
+            case 0x15: cpu_addressing_zeropage_x(m);  cpu_ora(m);  cycles -= 4; break;
+            case 0x16: cpu_addressing_zeropage_x(m);  cpu_asl(m);  cycles -= 6; break;
+            case 0x18: cpu_addressing_implied(m);     cpu_clc(m);  cycles -= 2; break;
+            case 0x19: cpu_addressing_absolute_y(m);  cpu_ora(m);  cycles -= 4; break;
+            case 0x1A: cpu_addressing_accumulator(m); cpu_nop(m);  cycles -= 1; break;
+            case 0x1C: cpu_addressing_absolute_x(m);  cpu_nop(m);  cycles -= 1; break;
+            case 0x1D: cpu_addressing_absolute_x(m);  cpu_ora(m);  cycles -= 4; break;
+            case 0x1E: cpu_addressing_absolute_x(m);  cpu_asl(m);  cycles -= 7; break;
+            case 0x20: cpu_addressing_absolute(m);    cpu_jsr(m);  cycles -= 6; break;
+            case 0x21: cpu_addressing_indirect_x(m);  cpu_and(m);  cycles -= 6; break;
+            case 0x24: cpu_addressing_zeropage(m);    cpu_bit(m);  cycles -= 3; break;
+            case 0x25: cpu_addressing_zeropage(m);    cpu_and(m);  cycles -= 3; break;
+            case 0x26: cpu_addressing_zeropage(m);    cpu_rol(m);  cycles -= 5; break;
+            case 0x28: cpu_addressing_implied(m);     cpu_plp(m);  cycles -= 3; break;
+            case 0x29: cpu_addressing_immediate(m);   cpu_and(m);  cycles -= 2; break;
+            case 0x2A: cpu_addressing_accumulator(m); cpu_rola(m); cycles -= 2; break;
+            case 0x2C: cpu_addressing_absolute(m);    cpu_bit(m);  cycles -= 4; break;
+            case 0x2D: cpu_addressing_absolute(m);    cpu_and(m);  cycles -= 2; break;
+            case 0x2E: cpu_addressing_absolute(m);    cpu_rol(m);  cycles -= 6; break;
+            case 0x30: cpu_addressing_relative(m);    cpu_bmi(m);  cycles -= 2; break;
+            case 0x31: cpu_addressing_indirect_y(m);  cpu_and(m);  cycles -= 5; break;
+            case 0x34: cpu_addressing_zeropage_x(m);  cpu_nop(m);  cycles -= 1; break;
+            case 0x35: cpu_addressing_zeropage_x(m);  cpu_and(m);  cycles -= 4; break;
+            case 0x36: cpu_addressing_zeropage_x(m);  cpu_rol(m);  cycles -= 6; break;
+            case 0x38: cpu_addressing_implied(m);     cpu_sec(m);  cycles -= 2; break;
+            case 0x39: cpu_addressing_absolute_y(m);  cpu_and(m);  cycles -= 4; break;
+            case 0x3A: cpu_addressing_accumulator(m); cpu_nop(m);  cycles -= 1; break;
+            case 0x3C: cpu_addressing_absolute_x(m);  cpu_nop(m);  cycles -= 1; break;
+            case 0x3D: cpu_addressing_absolute_x(m);  cpu_and(m);  cycles -= 4; break;
+            case 0x3E: cpu_addressing_absolute_x(m);  cpu_rol(m);  cycles -= 7; break;
+            case 0x40: cpu_addressing_implied(m);     cpu_rti(m);  cycles -= 6; break;
+            case 0x41: cpu_addressing_indirect_x(m);  cpu_eor(m);  cycles -= 6; break;
+            case 0x44: cpu_addressing_zeropage(m);    cpu_nop(m);  cycles -= 1; break;
+            case 0x45: cpu_addressing_zeropage(m);    cpu_eor(m);  cycles -= 3; break;
+            case 0x46: cpu_addressing_zeropage(m);    cpu_lsr(m);  cycles -= 5; break;
+            case 0x48: cpu_addressing_implied(m);     cpu_pha(m);  cycles -= 3; break;
+            case 0x49: cpu_addressing_immediate(m);   cpu_eor(m);  cycles -= 2; break;
+            case 0x4A: cpu_addressing_accumulator(m); cpu_lsra(m); cycles -= 2; break;
+            case 0x4C: cpu_addressing_absolute(m);    cpu_jmp(m);  cycles -= 3; break;
+            case 0x4D: cpu_addressing_absolute(m);    cpu_eor(m);  cycles -= 4; break;
+            case 0x4E: cpu_addressing_absolute(m);    cpu_lsr(m);  cycles -= 6; break;
+            case 0x50: cpu_addressing_relative(m);    cpu_bvc(m);  cycles -= 2; break;
+            case 0x51: cpu_addressing_indirect_y(m);  cpu_eor(m);  cycles -= 5; break;
+            case 0x54: cpu_addressing_zeropage_x(m);  cpu_nop(m);  cycles -= 1; break;
+            case 0x55: cpu_addressing_zeropage_x(m);  cpu_eor(m);  cycles -= 4; break;
+            case 0x56: cpu_addressing_zeropage_x(m);  cpu_lsr(m);  cycles -= 6; break;
+            case 0x58: cpu_addressing_implied(m);     cpu_cli(m);  cycles -= 2; break;
+            case 0x59: cpu_addressing_absolute_y(m);  cpu_eor(m);  cycles -= 4; break;
+            case 0x5A: cpu_addressing_accumulator(m); cpu_nop(m);  cycles -= 1; break;
+            case 0x5C: cpu_addressing_absolute_x(m);  cpu_nop(m);  cycles -= 1; break;
+            case 0x5D: cpu_addressing_absolute_x(m);  cpu_eor(m);  cycles -= 4; break;
+            case 0x5E: cpu_addressing_absolute_x(m);  cpu_lsr(m);  cycles -= 7; break;
+            case 0x60: cpu_addressing_implied(m);     cpu_rts(m);  cycles -= 6; break;
+            case 0x61: cpu_addressing_indirect_x(m);  cpu_adc(m);  cycles -= 6; break;
+            case 0x64: cpu_addressing_zeropage(m);    cpu_nop(m);  cycles -= 1; break;
+            case 0x65: cpu_addressing_zeropage(m);    cpu_adc(m);  cycles -= 3; break;
+            case 0x66: cpu_addressing_zeropage(m);    cpu_ror(m);  cycles -= 5; break;
+            case 0x68: cpu_addressing_implied(m);     cpu_pla(m);  cycles -= 4; break;
+            case 0x69: cpu_addressing_immediate(m);   cpu_adc(m);  cycles -= 2; break;
+            case 0x6A: cpu_addressing_accumulator(m); cpu_rora(m); cycles -= 2; break;
+            case 0x6C: cpu_addressing_indirect(m);    cpu_jmp(m);  cycles -= 5; break;
+            case 0x6D: cpu_addressing_absolute(m);    cpu_adc(m);  cycles -= 4; break;
+            case 0x6E: cpu_addressing_absolute(m);    cpu_ror(m);  cycles -= 6; break;
+            case 0x70: cpu_addressing_relative(m);    cpu_bvs(m);  cycles -= 2; break;
+            case 0x71: cpu_addressing_indirect_y(m);  cpu_adc(m);  cycles -= 5; break;
+            case 0x74: cpu_addressing_zeropage(m);    cpu_nop(m);  cycles -= 1; break;
+            case 0x75: cpu_addressing_zeropage_x(m);  cpu_adc(m);  cycles -= 4; break;
+            case 0x76: cpu_addressing_zeropage_x(m);  cpu_ror(m);  cycles -= 6; break;
+            case 0x78: cpu_addressing_implied(m);     cpu_sei(m);  cycles -= 2; break;
+            case 0x79: cpu_addressing_absolute_y(m);  cpu_adc(m);  cycles -= 4; break;
+            case 0x7A: cpu_addressing_accumulator(m); cpu_nop(m);  cycles -= 1; break;
+            case 0x7C: cpu_addressing_absolute_x(m);  cpu_nop(m);  cycles -= 1; break;
+            case 0x7D: cpu_addressing_absolute_x(m);    cpu_adc(m);  cycles -= 4; break;
+            case 0x7E: cpu_addressing_absolute_x(m);    cpu_ror(m);  cycles -= 7; break;
+            case 0x80: cpu_addressing_immediate(m);   cpu_nop(m);  cycles -= 1; break;
+            case 0x81: cpu_addressing_indirect_x(m);  cpu_sta(m);  cycles -= 6; break;
+            case 0x84: cpu_addressing_zeropage(m);    cpu_sty(m);  cycles -= 3; break;
+            case 0x85: cpu_addressing_zeropage(m);    cpu_sta(m);  cycles -= 3; break;
+            case 0x86: cpu_addressing_zeropage(m);    cpu_stx(m);  cycles -= 3; break;
+            case 0x88: cpu_addressing_implied(m);     cpu_dey(m);  cycles -= 2; break;
+            case 0x8A: cpu_addressing_implied(m);     cpu_txa(m);  cycles -= 2; break;
+            case 0x8C: cpu_addressing_absolute(m);    cpu_sty(m);  cycles -= 4; break;
+            case 0x8D: cpu_addressing_absolute(m);    cpu_sta(m);  cycles -= 4; break;
+            case 0x8E: cpu_addressing_absolute(m);    cpu_stx(m);  cycles -= 4; break;
+            case 0x90: cpu_addressing_relative(m);    cpu_bcc(m);  cycles -= 2; break;
+            case 0x91: cpu_addressing_indirect_y(m);  cpu_sta(m);  cycles -= 6; break;
+            case 0x94: cpu_addressing_zeropage_x(m);  cpu_sty(m);  cycles -= 4; break;
+            case 0x95: cpu_addressing_zeropage_x(m);  cpu_sta(m);  cycles -= 4; break;
+            case 0x96: cpu_addressing_zeropage_y(m);  cpu_stx(m);  cycles -= 4; break;
+            case 0x98: cpu_addressing_implied(m);     cpu_tya(m);  cycles -= 2; break;
+            case 0x99: cpu_addressing_absolute_y(m);    cpu_sta(m);  cycles -= 5; break;
+            case 0x9A: cpu_addressing_implied(m);     cpu_txs(m);  cycles -= 2; break;
+            case 0x9D: cpu_addressing_absolute_x(m);  cpu_sta(m);  cycles -= 5; break;
+            case 0xA0: cpu_addressing_immediate(m);   cpu_ldy(m);  cycles -= 2; break;
+            case 0xA1: cpu_addressing_indirect_x(m);  cpu_lda(m);  cycles -= 6; break;
+            case 0xA2: cpu_addressing_immediate(m);   cpu_ldx(m);  cycles -= 2; break;
+            case 0xA4: cpu_addressing_zeropage(m);    cpu_ldy(m);  cycles -= 3; break;
+            case 0xA5: cpu_addressing_zeropage(m);    cpu_lda(m);  cycles -= 3; break;
+            case 0xA6: cpu_addressing_zeropage(m);    cpu_ldx(m);  cycles -= 3; break;
+            case 0xA8: cpu_addressing_implied(m);     cpu_tay(m);  cycles -= 3; break;
+            case 0xA9: cpu_addressing_immediate(m);   cpu_lda(m);  cycles -= 2; break;
+            case 0xAA: cpu_addressing_implied(m);     cpu_tax(m);  cycles -= 2; break;
+            case 0xAC: cpu_addressing_absolute(m);    cpu_ldy(m);  cycles -= 4; break;
+            case 0xAD: cpu_addressing_absolute(m);    cpu_lda(m);  cycles -= 4; break;
+            case 0xAE: cpu_addressing_absolute(m);    cpu_ldx(m);  cycles -= 4; break;
+            case 0xB0: cpu_addressing_relative(m);    cpu_bcs(m);  cycles -= 2; break;
+            case 0xB1: cpu_addressing_indirect_y(m);  cpu_lda(m);  cycles -= 5; break;
+            case 0xB4: cpu_addressing_zeropage_x(m);  cpu_ldy(m);  cycles -= 4; break;
+            case 0xB5: cpu_addressing_zeropage_x(m);  cpu_lda(m);  cycles -= 4; break;
+            case 0xB6: cpu_addressing_zeropage_y(m);  cpu_ldx(m);  cycles -= 4; break;
+            case 0xB8: cpu_addressing_implied(m);     cpu_clv(m);  cycles -= 2; break;
+            case 0xB9: cpu_addressing_absolute_y(m);  cpu_lda(m);  cycles -= 4; break;
+            case 0xBA: cpu_addressing_implied(m);     cpu_tsx(m);  cycles -= 2; break;
+            case 0xBC: cpu_addressing_absolute_x(m);  cpu_ldy(m);  cycles -= 4; break;
+            case 0xBD: cpu_addressing_absolute_x(m);  cpu_lda(m);  cycles -= 4; break;
+            case 0xBE: cpu_addressing_absolute_y(m);  cpu_ldx(m);  cycles -= 4; break;
+            case 0xC0: cpu_addressing_immediate(m);   cpu_cpy(m);  cycles -= 2; break;
+            case 0xC1: cpu_addressing_indirect_x(m);  cpu_cmp(m);  cycles -= 6; break;
+            case 0xC4: cpu_addressing_zeropage(m);    cpu_cpy(m);  cycles -= 3; break;
+            case 0xC5: cpu_addressing_zeropage(m);    cpu_cmp(m);  cycles -= 3; break;
+            case 0xC6: cpu_addressing_zeropage(m);    cpu_dec(m);  cycles -= 5; break;
+            case 0xC8: cpu_addressing_implied(m);     cpu_iny(m);  cycles -= 2; break;
+            case 0xC9: cpu_addressing_immediate(m);   cpu_cmp(m);  cycles -= 2; break;
+            case 0xCA: cpu_addressing_implied(m);     cpu_dex(m);  cycles -= 2; break;
+            case 0xCC: cpu_addressing_absolute(m);    cpu_cpy(m);  cycles -= 4; break;
+            case 0xCD: cpu_addressing_absolute(m);    cpu_cmp(m);  cycles -= 4; break;
+            case 0xCE: cpu_addressing_absolute(m);    cpu_dec(m);  cycles -= 6; break;
+            case 0xD0: cpu_addressing_relative(m);    cpu_bne(m);  cycles -= 2; break;
+            case 0xD1: cpu_addressing_indirect_y(m);  cpu_cmp(m);  cycles -= 5; break;
+            case 0xD4: cpu_addressing_zeropage_x(m);  cpu_nop(m);  cycles -= 1; break;
+            case 0xD5: cpu_addressing_zeropage_x(m);  cpu_cmp(m);  cycles -= 5; break;
+            case 0xD6: cpu_addressing_zeropage_x(m);  cpu_dec(m);  cycles -= 6; break;
+            case 0xD8: cpu_addressing_implied(m);     cpu_cld(m);  cycles -= 2; break;
+            case 0xD9: cpu_addressing_absolute_y(m);  cpu_cmp(m);  cycles -= 4; break;
+            case 0xDA: cpu_addressing_accumulator(m); cpu_nop(m);  cycles -= 1; break;
+            case 0xDC: cpu_addressing_absolute_x(m);  cpu_nop(m);  cycles -= 1; break;
+            case 0xDD: cpu_addressing_absolute_x(m);  cpu_cmp(m);  cycles -= 4; break;
+            case 0xDE: cpu_addressing_absolute_x(m);  cpu_dec(m);  cycles -= 7; break;
+            case 0xE0: cpu_addressing_immediate(m);   cpu_cpx(m);  cycles -= 2; break;
+            case 0xE1: cpu_addressing_indirect_x(m);  cpu_sbc(m);  cycles -= 6; break;
+            case 0xE4: cpu_addressing_zeropage(m);    cpu_cpx(m);  cycles -= 3; break;
+            case 0xE5: cpu_addressing_zeropage(m);    cpu_sbc(m);  cycles -= 3; break;
+            case 0xE6: cpu_addressing_zeropage(m);    cpu_inc(m);  cycles -= 5; break;
+            case 0xE8: cpu_addressing_implied(m);     cpu_inx(m);  cycles -= 2; break;
+            case 0xE9: cpu_addressing_immediate(m);   cpu_sbc(m);  cycles -= 2; break;
+            case 0xEA: cpu_addressing_accumulator(m); cpu_nop(m);  cycles -= 2; break;
+            case 0xEC: cpu_addressing_absolute(m);    cpu_cpx(m);  cycles -= 4; break;
+            case 0xED: cpu_addressing_absolute(m);    cpu_sbc(m);  cycles -= 4; break;
+            case 0xEE: cpu_addressing_absolute(m);    cpu_inc(m);  cycles -= 6; break;
+            case 0xF0: cpu_addressing_relative(m);    cpu_beq(m);  cycles -= 2; break;
+            case 0xF1: cpu_addressing_indirect_y(m);  cpu_sbc(m);  cycles -= 5; break;
+            case 0xF4: cpu_addressing_zeropage_x(m);  cpu_nop(m);  cycles -= 1; break;
+            case 0xF5: cpu_addressing_zeropage_x(m);  cpu_sbc(m);  cycles -= 4; break;
+            case 0xF6: cpu_addressing_zeropage_x(m);  cpu_inc(m);  cycles -= 6; break;
+            case 0xF8: cpu_addressing_implied(m);     cpu_sed(m);  cycles -= 2; break;
+            case 0xF9: cpu_addressing_absolute_y(m);  cpu_sbc(m);  cycles -= 4; break;
+            case 0xFA: cpu_addressing_accumulator(m); cpu_nop(m);  cycles -= 1; break;
+            case 0xFC: cpu_addressing_absolute_x(m);  cpu_nop(m);  cycles -= 1; break;
+            case 0xFD: cpu_addressing_absolute_x(m);  cpu_sbc(m);  cycles -= 4; break;
+            case 0xFE: cpu_addressing_absolute_x(m);  cpu_inc(m);  cycles -= 7; break;
             default:
                 break;
         }
-        cycles -= additional_cycles;
+        cycles -= m->additional_cycles;
+        if(m->cpu_stall) { cycles -= cpu_take_stall(m, m->cpu_cycles + (tmp - cycles)); }
+    }
+    CPU_PROFILE_END(m, cycles);
+    m->cpu_cycles += tmp - cycles;
+    m->cpu_run_cycles = 0;
+}
+
+/* 参考实现中没有指令缓存 */
+void cpu_icache_flush(struct nes_machine *m) {}
+void cpu_icache_invalidate(struct nes_machine *m, uint16_t address) {}
+void cpu_icache_invalidate_page(struct nes_machine *m, uint8_t page) {}
+
+#else /* CPU_THREADED_DISPATCH */
+
+/* Threaded code 实现
+ * 每个操作码对应一段独立的代码 (handler), 由寻址方式与指令两部分宏拼接而成,
+ * 寻址得到的地址和操作数保存在 cpu_run 的局部变量 address, value, extra 中,
+ * 每段代码执行完成后, 直接通过 computed goto 跳转到下一条指令对应的代码.
+ *
+ * 取指令时使用指令缓存 (见后面的 cpu_icache), 进入 handler 时 m->cpu.pc 已经指向下一条指令,
+ * 指令的操作数 (1 或 2 字节) 保存在局部变量 operand 中.
+ */
+
+/* 各指令的操作数长度, 未列出的操作码长度为 0 */
+#define CPU_OPERAND_LENGTH_TABLE_ENTRY(code, mode, op, cycles) [code] = OPERAND_LENGTH_##mode,
+static const uint8_t cpu_operand_length_table[256] = {
+    CPU_OPCODE_TABLE(CPU_OPERAND_LENGTH_TABLE_ENTRY)
+};
+
+/* 指令缓存
+ * 以 CPU 地址为索引, 保存已经解码过的指令: 对应的 handler, 操作数, 基本 Cycle 数与指令长度.
+ * 某个地址上的指令第一次执行时进行解码并填入缓存, 之后再次执行时无需经过 memory_read_byte.
+ *
+ * 只缓存内部 RAM (0000 ~ 07FF, 及其镜像), Save RAM (6000 ~ 7FFF) 与 PRG ROM (8000 ~ FFFF) 中的指令,
+ * 在其他区域 (PPU, IO 寄存器等) 执行的指令每次都重新解码.
+ * 这些区域被写入时, 通过 cpu_icache_invalidate 使包含被修改字节的指令失效.
+ */
+#define ICACHE_PRG_ROM_BASE  0x0000   // 8000 ~ FFFF
+#define ICACHE_RAM_BASE      0x8000   // 0000 ~ 07FF
+#define ICACHE_SAVE_RAM_BASE 0x8800   // 6000 ~ 7FFF
+
+/* 指令缓存保存在 m->cpu_icache 中 (共 CPU_ICACHE_SIZE 项),
+ * m->cpu_icache_page_used 中每个标志对应 256 项, 表示其中是否有已经解码的指令, 用于减少写内存时不必要的失效操作
+ */
+
+/* 获取 CPU 地址在指令缓存中的位置, -1 表示该地址不缓存 */
+static inline int cpu_icache_index(uint16_t address) {
+    if(address >= 0x8000) { return ICACHE_PRG_ROM_BASE + (address - 0x8000); }
+    if(address < 0x2000)  { return ICACHE_RAM_BASE + (address & 0x07ff); }
+    if(address >= 0x6000) { return ICACHE_SAVE_RAM_BASE + (address - 0x6000); }
+    return -1;
+}
+
+/* 清空指令缓存 */
+void cpu_icache_flush(struct nes_machine *m) {
+    memset(m->cpu_icache, 0, sizeof(m->cpu_icache));
+    memset(m->cpu_icache_page_used, 0, sizeof(m->cpu_icache_page_used));
+}
+
+/* 某个字节被写入后, 使可能包含该字节的指令 (起始地址为 address - 2 ~ address) 失效 */
+void cpu_icache_invalidate(struct nes_machine *m, uint16_t address) {
+    int i, index;
+#ifdef BEMU_CPU_JIT
+    cpu_jit_invalidate(m, address);
+#endif
+    for(i = 0; i < 3; i++) {
+        if(address < 0x2000) {
+            index = ICACHE_RAM_BASE + ((address - i) & 0x07ff);
+        } else {
+            index = cpu_icache_index(address - i);
+        }
+        if(index >= 0 && m->cpu_icache_page_used[index >> 8]) {
+            m->cpu_icache[index].handler = NULL;
+        }
+    }
+}
+
+/* 页表中的某页被映射到其他内存 (切换 Bank) 后, 使该页中的指令, 以及从上一页末尾开始的指令失效
+ * 只有该页中有已经解码的指令时才需要清除, 因此切换没有执行过的 Bank 几乎没有开销
+ */
+void cpu_icache_invalidate_page(struct nes_machine *m, uint8_t page) {
+    int index = cpu_icache_index(page << 8);
+#ifdef BEMU_CPU_JIT
+    cpu_jit_invalidate_page(m, page);
+#endif
+    if(index < 0) { return; }
+    if(m->cpu_icache_page_used[index >> 8]) {
+        memset(&m->cpu_icache[index], 0, 0x100 * sizeof(struct cpu_decoded_instruction));
+        m->cpu_icache_page_used[index >> 8] = 0;
+    }
+    cpu_icache_invalidate(m, page << 8);
+}
+
+/* 获取 address 所在页 (256 项) 的标志, JIT 生成的代码写入内部 RAM 时使用 */
+uint8_t *cpu_icache_page_flag(struct nes_machine *m, uint16_t address) {
+    return &m->cpu_icache_page_used[cpu_icache_index(address) >> 8];
+}
+
+/* 解码 address 处的指令 */
+static void cpu_decode(struct nes_machine *m, struct cpu_decoded_instruction *instruction, uint16_t address, const void * const *dispatch_table) {
+    uint8_t opcode = memory_read_byte(m, address);
+    uint8_t length = cpu_operand_length_table[opcode];
+    instruction->operand = 0;
+    if(length >= 1) { instruction->operand = memory_read_byte(m, address + 1); }
+    if(length >= 2) { instruction->operand |= memory_read_byte(m, address + 2) << 8; }
+    instruction->cycles = cpu_cycle_table[opcode];
+    instruction->length = length + 1;
+    instruction->handler = dispatch_table[opcode];
+}
+
+/* 空转循环检测
+ * 很多游戏在等待 VBlank 或 NMI 时执行类似 "LDA $2002 / BPL" 或 "LDA flag / BEQ" 的循环.
+ * 这类循环只读取 PPU 状态寄存器或内部 RAM 等没有副作用的地址, 不写入任何内存,
+ * 在下一个事件 (VBlank, Sprite 0 hit 等) 发生之前, 每次循环的结果都完全相同.
+ *
+ * 每次跳转回循环起始地址时, 记录 CPU 寄存器与剩余的 Cycle 数.
+ * 如果循环体满足上述条件, 并且连续两次完整的循环之后 CPU 寄存器没有变化, 说明循环已经进入不动点,
+ * 此时直接扣除之后若干次完整循环所需的 Cycle 数, 最后一次不完整的循环仍然正常执行,
+ * 因此运行结果与逐条执行指令完全相同.
+ */
+struct cpu_idle {
+    uint16_t head;     // 循环起始地址
+    const void *via;   // 跳转回起始地址的指令 (指令缓存中的项), NULL 表示 JIT 编译的基本块
+    int arrivals;      // 连续经由 via 到达 head 的次数
+    int cycles;        // 上次到达 head 时剩余的 Cycle 数
+    int verified;      // 0: 未检查循环体, 1: 空转循环, -1: 不是空转循环
+    struct _cpu regs;  // 上次到达 head 时的 CPU 寄存器
+};
+
+/* 判断指令是否只读取没有副作用的地址 (内部 RAM, PPU 状态寄存器, Save RAM 与 PRG ROM), 并且不写入内存 */
+static int cpu_idle_safe_instruction(uint8_t opcode, uint16_t operand) {
+    switch(opcode) {
+        case 0xa9: case 0xa2: case 0xa0: case 0xc9: case 0xe0: case 0xc0:  // LDA, LDX, LDY, CMP, CPX, CPY (immediate)
+        case 0x29: case 0x09: case 0x49: case 0xea:                        // AND, ORA, EOR (immediate), NOP
+        case 0xa5: case 0xa6: case 0xa4: case 0x24: case 0xc5: case 0xe4:  // zeropage
+        case 0xc4: case 0x25: case 0x05: case 0x45:
+        case 0xb5: case 0xb6: case 0xb4: case 0xd5: case 0x35: case 0x15:  // zeropage, X/Y
+        case 0x55:
+            return 1;
+        case 0xad: case 0xae: case 0xac: case 0x2c: case 0xcd: case 0xec:  // absolute
+        case 0xcc: case 0x2d: case 0x0d: case 0x4d:
+            return operand < 0x2000 || (operand < 0x4000 && (operand & 7) == 2) || operand >= 0x6000;
+        default:
+            return 0;
+    }
+}
+
+/* 检查从 head 开始的循环体: 只包含上述指令, 并且以跳转回 head 的分支或 JMP 指令结束
+ * via 为执行该跳转指令时使用的指令缓存项, NULL 表示不检查 (JIT 编译的基本块)
+ */
+static int cpu_idle_verify(struct nes_machine *m, uint16_t head, const void *via) {
+    uint16_t address = head;
+    while((uint16_t)(address - head) < 16) {
+        uint8_t opcode = memory_read_byte(m, address);
+        uint8_t length = cpu_operand_length_table[opcode];
+        uint16_t operand = 0, next = address + length + 1;
+        int index = cpu_icache_index(address);
+        if(index < 0 || (address < 0x2000 && (address & 0x7ff) + length >= 0x800)) { return 0; }
+        if(length >= 1) { operand = memory_read_byte(m, address + 1); }
+        if(length >= 2) { operand |= memory_read_byte(m, address + 2) << 8; }
+
+        if((opcode & 0x1f) == 0x10 || opcode == 0x4c) {  // 分支与 JMP
+            uint16_t target = opcode == 0x4c ? operand : (uint16_t)((int8_t)operand + next);
+            return target == head && (via == NULL || via == &m->cpu_icache[index]);
+        }
+        if(!cpu_idle_safe_instruction(opcode, operand)) { return 0; }
+        address = next;
+    }
+    return 0;
+}
+
+/* 经由 via 跳转到 m->cpu.pc 时调用, 发现空转循环时减少 cycles */
+static void cpu_idle_arrive(struct nes_machine *m, struct cpu_idle *idle, const void *via, int *cycles) {
+    if(m->cpu.pc != idle->head || via != idle->via) {
+        idle->head = m->cpu.pc;
+        idle->via = via;
+        idle->arrivals = 1;
+        idle->verified = 0;
+    } else if(++idle->arrivals >= 3) {
+        int c = idle->cycles - *cycles;
+        if(c > 0 && *cycles > c &&
+           m->cpu.a == idle->regs.a && m->cpu.x == idle->regs.x && m->cpu.y == idle->regs.y &&
+           m->cpu.sp == idle->regs.sp && m->cpu.p == idle->regs.p && m->cpu.n == idle->regs.n &&
+           m->cpu.z == idle->regs.z && m->cpu.c == idle->regs.c && m->cpu.v == idle->regs.v) {
+            if(idle->verified == 0) { idle->verified = cpu_idle_verify(m, idle->head, via) ? 1 : -1; }
+            if(idle->verified > 0) { *cycles -= (*cycles - 1) / c * c; }
+        }
     }
-    cpu_cycles += tmp - cycles;
+    idle->cycles = *cycles;
+    idle->regs = m->cpu;
 }
 
-void cpu_interrupt() {
-    if(ppu_generate_nmi()) {
-        cpu.p |= FLAG_INTERRUPT;
-        cpu_stack_push_word(cpu.pc);
-        cpu_stack_push_byte(cpu.p);
-        cpu.pc = memory_read_word(0xfffa);
+/* CPU 运行指定 Cycle */
+
+void cpu_run(struct nes_machine *m, int cycles) {
+#define CPU_DISPATCH_TABLE_ENTRY(code, mode, op, cycles) [code] = &&opcode_##code,
+    static const void *dispatch_table[256] = {
+        [0 ... 255] = &&opcode_undocumented,
+        CPU_OPCODE_TABLE(CPU_DISPATCH_TABLE_ENTRY)
+    };
+
+    struct cpu_decoded_instruction *instruction, uncached;
+    uint16_t address = 0, operand;
+    uint8_t value = 0;
+    uint8_t extra = m->additional_cycles;
+    int tmp = cycles;
+    struct cpu_idle idle = { .head = 0, .via = NULL, .arrivals = 0 };
+
+    CPU_PROFILE_BEGIN(m, cycles);
+
+    /* 从指令缓存中取指令 (缓存中没有时先进行解码), 扣除基本 Cycle 数, 然后跳转到对应的 handler */
+#define CPU_DISPATCH() \
+    do { \
+        if(cycles <= 0) { goto finish; } \
+        CPU_PROFILE_INSTRUCTION(m, m->cpu.pc, cycles); \
+        CPU_TRACE_INSTRUCTION(m, m->cpu.pc, m->cpu_cycles + (tmp - cycles)); \
+        int index = cpu_icache_index(m->cpu.pc); \
+        instruction = (index >= 0) ? &m->cpu_icache[index] : &uncached; \
+        if(index < 0 || instruction->handler == NULL) { \
+            cpu_decode(m, instruction, m->cpu.pc, dispatch_table); \
+            if(index >= 0) { m->cpu_icache_page_used[index >> 8] = 1; } \
+        } \
+        operand = instruction->operand; \
+        m->cpu.pc += instruction->length; \
+        cycles -= instruction->cycles; \
+        m->cpu_run_cycles = tmp - cycles; \
+        goto *instruction->handler; \
+    } while(0)
+
+    CPU_DISPATCH();
+
+    /* 写入 OAMDMA 后扣除 CPU 暂停的 Cycle */
+#define CPU_STALL_TAKEN  { cycles -= cpu_take_stall(m, m->cpu_cycles + (tmp - cycles)); }
+
+    /* 跳转或分支之后, 检查是否进入空转循环 */
+#define CPU_BRANCH_TAKEN { cycles -= extra; goto branch_taken; }
+branch_taken:
+    cpu_idle_arrive(m, &idle, instruction, &cycles);
+
+    /* 如果目标地址处有 JIT 编译的基本块, 直接执行 (见 cpu_jit.c) */
+#ifdef BEMU_CPU_JIT
+    while(cycles > 0) {
+        int used;
+        uint16_t pc = m->cpu.pc;
+        m->additional_cycles = extra;
+        m->cpu_run_cycles = tmp - cycles;
+        used = cpu_jit_run(m, cycles);
+        if(used == 0) { break; }
+        cycles -= used;
+        extra = m->additional_cycles;
+        if(m->cpu_stall) { cycles -= cpu_take_stall(m, m->cpu_cycles + (tmp - cycles)); }
+        if(m->cpu.pc == pc) { cpu_idle_arrive(m, &idle, NULL, &cycles); }
+    }
+#endif
+    CPU_DISPATCH();
+
+#define CPU_HANDLER(code, mode, op, cycles_) \
+    opcode_##code: \
+        ADDRESSING_##mode \
+        OPERATION_##op \
+        cycles -= extra; \
+        CPU_DISPATCH();
+
+    CPU_OPCODE_TABLE(CPU_HANDLER)
+
+opcode_undocumented:
+    cycles -= extra;
+    CPU_DISPATCH();
+
+finish:
+    CPU_PROFILE_END(m, cycles);
+    m->additional_cycles = extra;
+    m->cpu_cycles += tmp - cycles;
+    m->cpu_run_cycles = 0;
+}
+
+#endif /* CPU_THREADED_DISPATCH */
+
+void cpu_interrupt(struct nes_machine *m) {
+    if(ppu_generate_nmi(m)) {
+        cpu_stack_push_word(m, m->cpu.pc);
+        cpu_stack_push_byte(m, (cpu_get_p(m) & ~FLAG_BREAK) | FLAG_UNUSED);  // 压栈的是进入 NMI 之前的状态
+        m->cpu.p |= FLAG_INTERRUPT;
+        m->cpu.pc = memory_read_word(m, 0xfffa);
+        CPU_PROFILE_CALL(m);
     }
 }
+
+/* IRQ (Mapper 等产生), 中断屏蔽标志为 1 时不响应, 返回 1 表示已经响应 */
+int cpu_irq(struct nes_machine *m) {
+    if(m->cpu.p & FLAG_INTERRUPT) { return 0; }
+    cpu_stack_push_word(m, m->cpu.pc);
+    cpu_stack_push_byte(m, (cpu_get_p(m) & ~FLAG_BREAK) | FLAG_UNUSED);
+    m->cpu.p |= FLAG_INTERRUPT;
+    m->cpu.pc = memory_read_word(m, 0xfffe);
+    CPU_PROFILE_CALL(m);
+    return 1;
+}
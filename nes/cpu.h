@@ -2,12 +2,17 @@
 #define BEMU_CPU_H
 
 #include <stdint.h>
+#include "machine.h"
 
-void cpu_init();
-void cpu_interrupt();
-uint64_t cpu_clock();
-void cpu_run(int cycles);
+void cpu_init(struct nes_machine *m);
+void cpu_interrupt(struct nes_machine *m);
+int cpu_irq(struct nes_machine *m);
+uint64_t cpu_clock(struct nes_machine *m);
+void cpu_run(struct nes_machine *m, int cycles);
+void cpu_icache_flush(struct nes_machine *m);
+void cpu_icache_invalidate(struct nes_machine *m, uint16_t address);
+void cpu_icache_invalidate_page(struct nes_machine *m, uint8_t page);
 
-void cpu_debugger();
+void cpu_debugger(struct nes_machine *m);
 
 #endif //BEMU_CPU_H
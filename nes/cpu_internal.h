@@ -0,0 +1,433 @@
+/* CPU 内部使用的定义, 由 cpu.c 与 cpu_jit.c 共用
+ */
+
+#ifndef BEMU_CPU_INTERNAL_H
+#define BEMU_CPU_INTERNAL_H
+
+#include <stdint.h>
+#include "cpu.h"
+#include "memory.h"
+#include "cpu_profile.h"
+
+/* 用于获得 CPU 状态寄存器中的指定状态, 具体内容见 machine.h 中 struct _cpu 的注释 */
+#define FLAG_CARRY     0x01
+#define FLAG_ZERO      0x02
+#define FLAG_INTERRUPT 0x04
+#define FLAG_DECIMAL   0x08
+#define FLAG_BREAK     0x10
+#define FLAG_UNUSED    0x20
+#define FLAG_OVERFLOW  0x40
+#define FLAG_NEGATIVE  0x80
+
+/* 合成完整的状态寄存器 */
+static inline uint8_t cpu_get_p(struct nes_machine *m) {
+    return (m->cpu.p & (FLAG_INTERRUPT | FLAG_DECIMAL | FLAG_BREAK | FLAG_UNUSED)) |
+           (m->cpu.n & FLAG_NEGATIVE) | (m->cpu.v ? FLAG_OVERFLOW : 0) |
+           (m->cpu.z ? 0 : FLAG_ZERO) | (m->cpu.c ? FLAG_CARRY : 0);
+}
+
+/* 设置完整的状态寄存器 */
+static inline void cpu_set_p(struct nes_machine *m, uint8_t p) {
+    m->cpu.p = p;
+    m->cpu.n = p & FLAG_NEGATIVE;
+    m->cpu.z = !(p & FLAG_ZERO);
+    m->cpu.c = p & FLAG_CARRY;
+    m->cpu.v = (p & FLAG_OVERFLOW) ? 1 : 0;
+}
+
+/* 设置 Zero Flag 与 Negative Flag */
+static inline void cpu_checknz(struct nes_machine *m, uint8_t n) {
+    m->cpu.n = m->cpu.z = n;
+}
+
+/* 修改 Flags */
+static inline void cpu_modify_flag(struct nes_machine *m, uint8_t flag, int value) {
+    switch(flag) {
+        case FLAG_CARRY:    m->cpu.c = value ? 1 : 0; break;
+        case FLAG_OVERFLOW: m->cpu.v = value ? 1 : 0; break;
+        case FLAG_ZERO:     m->cpu.z = value ? 0 : 1; break;
+        case FLAG_NEGATIVE: m->cpu.n = value ? FLAG_NEGATIVE : 0; break;
+        default:
+            if(value) { m->cpu.p |= flag; }
+            else      { m->cpu.p &= ~flag; }
+    }
+}
+
+/* 中断屏蔽标志被清除 (CLI, PLP, RTI) 之后, 立即响应等待中的 Mapper IRQ,
+ * 否则要等到下一次扫描线事件才会重新检查 (见 nes.c 中的 nes_scanline)
+ */
+static inline void cpu_irq_poll(struct nes_machine *m) {
+    if(m->mapper.irq) { cpu_irq(m); }
+}
+
+/* 读取 N, Z, C, V */
+#define CPU_FLAG_NEGATIVE (m->cpu.n & FLAG_NEGATIVE)
+#define CPU_FLAG_ZERO     (m->cpu.z == 0)
+#define CPU_FLAG_CARRY    (m->cpu.c)
+#define CPU_FLAG_OVERFLOW (m->cpu.v)
+
+void cpu_stack_push_byte(struct nes_machine *m, uint8_t data);
+void cpu_stack_push_word(struct nes_machine *m, uint16_t data);
+uint8_t cpu_stack_pop_byte(struct nes_machine *m);
+uint16_t cpu_stack_pop_word(struct nes_machine *m);
+uint8_t *cpu_icache_page_flag(struct nes_machine *m, uint16_t address);
+
+/* 以下宏用于拼接每个操作码对应的代码 (见 cpu.c 中的 threaded code 实现)
+ * 使用时需要提供局部变量:
+ *   m: 当前的 nes_machine
+ *   operand: 指令的操作数 (1 或 2 字节), 此时 m->cpu.pc 已经指向下一条指令
+ *   address, value: 寻址得到的地址和该地址对应的值
+ *   extra: 跨页访问等情况需要的额外 Cycle 数
+ * 并定义 CPU_BRANCH_TAKEN, 在分支, 跳转, 子程序调用与返回等指令修改 m->cpu.pc 之后执行,
+ * 以及 CPU_STALL_TAKEN, 在写入内存引起 CPU 暂停 (m->cpu_stall 不为 0, 见 memory.c 中的 OAM DMA) 之后执行
+ */
+
+/* 寻址方式, 与 cpu.c 中 cpu_addressing_* 的行为保持一致 */
+#define ADDRESSING_implied     extra = 0;
+#define ADDRESSING_accumulator extra = 0;
+#define ADDRESSING_immediate   value = (uint8_t)operand; extra = 0;
+#define ADDRESSING_zeropage \
+    address = (uint8_t)operand; value = memory_read_ram(m, address); extra = 0;
+#define ADDRESSING_zeropage_x \
+    address = (operand + m->cpu.x) & 0xff; value = memory_read_ram(m, address); extra = 0;
+#define ADDRESSING_zeropage_y \
+    address = (operand + m->cpu.y) & 0xff; value = memory_read_ram(m, address); extra = 0;
+#define ADDRESSING_absolute \
+    address = operand; value = memory_read_byte(m, address); extra = 0;
+#define ADDRESSING_absolute_x \
+    address = operand + m->cpu.x; value = memory_read_byte(m, address); \
+    extra = (address >> 8) != (m->cpu.pc >> 8);
+#define ADDRESSING_absolute_y \
+    address = operand + m->cpu.y; value = memory_read_byte(m, address); \
+    extra = (address >> 8) != (m->cpu.pc >> 8);
+#define ADDRESSING_relative \
+    address = (uint16_t)(int8_t)operand + m->cpu.pc; \
+    extra = (address >> 8) != (m->cpu.pc >> 8);
+#define ADDRESSING_indirect \
+    if((operand & 0xff) == 0xff) { \
+        address = (memory_read_byte(m, operand & 0xff00) << 8) + memory_read_byte(m, operand); \
+    } else { \
+        address = memory_read_word(m, operand); \
+    } \
+    extra = 0;
+#define ADDRESSING_indirect_x \
+    address = (memory_read_ram(m, (operand + m->cpu.x + 1) & 0xff) << 8) | memory_read_ram(m, (operand + m->cpu.x) & 0xff); \
+    value = memory_read_byte(m, address); extra = 0;
+#define ADDRESSING_indirect_y \
+    address = ((memory_read_ram(m, (operand + 1) & 0xff) << 8) | memory_read_ram(m, operand)) + m->cpu.y; \
+    value = memory_read_byte(m, address); \
+    extra = (address >> 8) != (m->cpu.pc >> 8);
+
+/* 各寻址方式的操作数长度 (字节) */
+#define OPERAND_LENGTH_implied     0
+#define OPERAND_LENGTH_accumulator 0
+#define OPERAND_LENGTH_immediate   1
+#define OPERAND_LENGTH_zeropage    1
+#define OPERAND_LENGTH_zeropage_x  1
+#define OPERAND_LENGTH_zeropage_y  1
+#define OPERAND_LENGTH_absolute    2
+#define OPERAND_LENGTH_absolute_x  2
+#define OPERAND_LENGTH_absolute_y  2
+#define OPERAND_LENGTH_relative    1
+#define OPERAND_LENGTH_indirect    2
+#define OPERAND_LENGTH_indirect_x  1
+#define OPERAND_LENGTH_indirect_y  1
+
+/* 写入内存, 写入 OAMDMA 等寄存器引起 CPU 暂停时执行 CPU_STALL_TAKEN */
+#define CPU_WRITE(address, data) \
+    do { \
+        memory_write_byte(m, address, data); \
+        if(m->cpu_stall) { CPU_STALL_TAKEN; } \
+    } while(0)
+
+/* 指令, 与 cpu.c 中 cpu_* 指令函数的行为保持一致 */
+#define OPERATION_ora  m->cpu.a |= value; cpu_checknz(m, m->cpu.a);
+#define OPERATION_and  m->cpu.a &= value; cpu_checknz(m, m->cpu.a);
+#define OPERATION_eor  m->cpu.a ^= value; cpu_checknz(m, m->cpu.a);
+#define OPERATION_asl \
+    cpu_modify_flag(m, FLAG_CARRY, value & 0x80); value <<= 1; cpu_checknz(m, value); CPU_WRITE(address, value);
+#define OPERATION_asla cpu_modify_flag(m, FLAG_CARRY, m->cpu.a & 0x80); m->cpu.a <<= 1; cpu_checknz(m, m->cpu.a);
+#define OPERATION_rol { \
+    uint8_t carry = CPU_FLAG_CARRY; \
+    cpu_modify_flag(m, FLAG_CARRY, value & 0x80); \
+    value = (value << 1) | (carry ? 1 : 0); \
+    CPU_WRITE(address, value); cpu_checknz(m, value); }
+#define OPERATION_rola { \
+    uint8_t carry = CPU_FLAG_CARRY; \
+    cpu_modify_flag(m, FLAG_CARRY, m->cpu.a & 0x80); \
+    m->cpu.a = (m->cpu.a << 1) | (carry ? 1 : 0); \
+    cpu_checknz(m, m->cpu.a); }
+#define OPERATION_ror { \
+    uint8_t carry = CPU_FLAG_CARRY; \
+    cpu_modify_flag(m, FLAG_CARRY, value & 0x01); \
+    value = (value >> 1) | ((carry ? 1 : 0) << 7); \
+    CPU_WRITE(address, value); cpu_checknz(m, value); }
+#define OPERATION_rora { \
+    uint8_t carry = CPU_FLAG_CARRY; \
+    cpu_modify_flag(m, FLAG_CARRY, m->cpu.a & 0x01); \
+    m->cpu.a = (m->cpu.a >> 1) | ((carry ? 1 : 0) << 7); \
+    cpu_checknz(m, m->cpu.a); }
+#define OPERATION_lsr \
+    cpu_modify_flag(m, FLAG_CARRY, value & 0x01); value >>= 1; CPU_WRITE(address, value); cpu_checknz(m, value);
+#define OPERATION_lsra cpu_modify_flag(m, FLAG_CARRY, m->cpu.a & 0x01); m->cpu.a >>= 1; cpu_checknz(m, m->cpu.a);
+#define OPERATION_adc { \
+    uint16_t tmp = value + m->cpu.a + (CPU_FLAG_CARRY ? 1 : 0); \
+    cpu_modify_flag(m, FLAG_CARRY, tmp & 0xff00); \
+    cpu_modify_flag(m, FLAG_OVERFLOW, ((value ^ tmp) & (m->cpu.a ^ tmp)) & 0x80); \
+    m->cpu.a = (uint8_t)(tmp & 0xff); \
+    cpu_checknz(m, m->cpu.a); }
+#define OPERATION_sbc { \
+    uint16_t tmp = m->cpu.a - value - (1 - (CPU_FLAG_CARRY ? 1 : 0)); \
+    cpu_modify_flag(m, FLAG_CARRY, (tmp & 0xff00) == 0); \
+    cpu_modify_flag(m, FLAG_OVERFLOW, ((m->cpu.a ^ value) & (m->cpu.a ^ tmp)) & 0x80); \
+    m->cpu.a = (uint8_t)(tmp & 0xff); \
+    cpu_checknz(m, m->cpu.a); }
+
+#define OPERATION_bmi if(CPU_FLAG_NEGATIVE) { m->cpu.pc = address; CPU_BRANCH_TAKEN; }
+#define OPERATION_bcs if(CPU_FLAG_CARRY) { m->cpu.pc = address; CPU_BRANCH_TAKEN; }
+#define OPERATION_beq if(CPU_FLAG_ZERO) { m->cpu.pc = address; CPU_BRANCH_TAKEN; }
+#define OPERATION_bvs if(CPU_FLAG_OVERFLOW) { m->cpu.pc = address; CPU_BRANCH_TAKEN; }
+#define OPERATION_bpl if(!CPU_FLAG_NEGATIVE) { m->cpu.pc = address; CPU_BRANCH_TAKEN; }
+#define OPERATION_bcc if(!CPU_FLAG_CARRY) { m->cpu.pc = address; CPU_BRANCH_TAKEN; }
+#define OPERATION_bne if(!CPU_FLAG_ZERO) { m->cpu.pc = address; CPU_BRANCH_TAKEN; }
+#define OPERATION_bvc if(!CPU_FLAG_OVERFLOW) { m->cpu.pc = address; CPU_BRANCH_TAKEN; }
+
+#define OPERATION_bit \
+    cpu_modify_flag(m, FLAG_OVERFLOW, value & 0x40); \
+    cpu_modify_flag(m, FLAG_NEGATIVE, value & 0x80); \
+    cpu_modify_flag(m, FLAG_ZERO, !(value & m->cpu.a));
+#define OPERATION_compare(reg) { \
+    int tmpc = (reg) - value; \
+    cpu_modify_flag(m, FLAG_CARRY, tmpc >= 0); \
+    cpu_checknz(m, (uint8_t)tmpc); }
+#define OPERATION_cmp OPERATION_compare(m->cpu.a)
+#define OPERATION_cpx OPERATION_compare(m->cpu.x)
+#define OPERATION_cpy OPERATION_compare(m->cpu.y)
+
+#define OPERATION_clc cpu_modify_flag(m, FLAG_CARRY, 0);
+#define OPERATION_cli cpu_modify_flag(m, FLAG_INTERRUPT, 0); cpu_irq_poll(m);
+#define OPERATION_cld cpu_modify_flag(m, FLAG_DECIMAL, 0);
+#define OPERATION_clv cpu_modify_flag(m, FLAG_OVERFLOW, 0);
+#define OPERATION_sec cpu_modify_flag(m, FLAG_CARRY, 1);
+#define OPERATION_sei cpu_modify_flag(m, FLAG_INTERRUPT, 1);
+#define OPERATION_sed cpu_modify_flag(m, FLAG_DECIMAL, 1);
+
+#define OPERATION_dec value--; CPU_WRITE(address, value); cpu_checknz(m, value);
+#define OPERATION_inc value++; CPU_WRITE(address, value); cpu_checknz(m, value);
+#define OPERATION_dex m->cpu.x--; cpu_checknz(m, m->cpu.x);
+#define OPERATION_dey m->cpu.y--; cpu_checknz(m, m->cpu.y);
+#define OPERATION_inx m->cpu.x++; cpu_checknz(m, m->cpu.x);
+#define OPERATION_iny m->cpu.y++; cpu_checknz(m, m->cpu.y);
+
+#define OPERATION_lda m->cpu.a = value; cpu_checknz(m, m->cpu.a);
+#define OPERATION_ldx m->cpu.x = value; cpu_checknz(m, m->cpu.x);
+#define OPERATION_ldy m->cpu.y = value; cpu_checknz(m, m->cpu.y);
+#define OPERATION_sta CPU_WRITE(address, m->cpu.a);
+#define OPERATION_stx CPU_WRITE(address, m->cpu.x);
+#define OPERATION_sty CPU_WRITE(address, m->cpu.y);
+
+#define OPERATION_nop
+
+#define OPERATION_pha cpu_stack_push_byte(m, m->cpu.a);
+#define OPERATION_php cpu_stack_push_byte(m, cpu_get_p(m) | 0x30);
+#define OPERATION_pla m->cpu.a = cpu_stack_pop_byte(m); cpu_checknz(m, m->cpu.a);
+#define OPERATION_plp cpu_set_p(m, (cpu_stack_pop_byte(m) & 0xef) | 0x20); cpu_irq_poll(m);
+#define OPERATION_rts m->cpu.pc = cpu_stack_pop_word(m) + 1; CPU_PROFILE_RETURN(m); CPU_BRANCH_TAKEN;
+#define OPERATION_rti cpu_set_p(m, cpu_stack_pop_byte(m) | FLAG_UNUSED); m->cpu.pc = cpu_stack_pop_word(m); CPU_PROFILE_RETURN(m); cpu_irq_poll(m); CPU_BRANCH_TAKEN;
+#define OPERATION_jmp m->cpu.pc = address; CPU_BRANCH_TAKEN;
+#define OPERATION_jsr cpu_stack_push_word(m, m->cpu.pc - 1); m->cpu.pc = address; CPU_PROFILE_CALL(m); CPU_BRANCH_TAKEN;
+#define OPERATION_brk \
+    cpu_stack_push_word(m, m->cpu.pc - 1); \
+    cpu_stack_push_byte(m, cpu_get_p(m)); \
+    m->cpu.p |= FLAG_UNUSED | FLAG_BREAK; \
+    m->cpu.pc = memory_read_word(m, 0xfffa); \
+    CPU_PROFILE_CALL(m); \
+    CPU_BRANCH_TAKEN;
+
+#define OPERATION_tax m->cpu.x = m->cpu.a; cpu_checknz(m, m->cpu.x);
+#define OPERATION_tay m->cpu.y = m->cpu.a; cpu_checknz(m, m->cpu.y);
+#define OPERATION_txa m->cpu.a = m->cpu.x; cpu_checknz(m, m->cpu.a);
+#define OPERATION_tya m->cpu.a = m->cpu.y; cpu_checknz(m, m->cpu.a);
+#define OPERATION_tsx m->cpu.x = m->cpu.sp; cpu_checknz(m, m->cpu.x);
+#define OPERATION_txs m->cpu.sp = m->cpu.x;
+
+/* 指令表: 操作码, 寻址方式, 指令, 基本 Cycle 数
+ * 与 cpu.c 中 switch 实现的内容一一对应, 未列出的操作码 (Undocumented Opcodes) 不执行任何操作
+ */
+#define CPU_OPCODE_TABLE(X) \
+    X(0x00, implied,     brk,  7) \
+    X(0x01, indirect_x,  ora,  6) \
+    X(0x04, zeropage,    nop,  1) \
+    X(0x05, zeropage,    ora,  3) \
+    X(0x06, zeropage,    asl,  5) \
+    X(0x08, implied,     php,  3) \
+    X(0x09, immediate,   ora,  2) \
+    X(0x0A, accumulator, asla, 2) \
+    X(0x0C, absolute,    nop,  1) \
+    X(0x0D, absolute,    ora,  4) \
+    X(0x0E, absolute,    asl,  6) \
+    X(0x10, relative,    bpl,  2) \
+    X(0x11, indirect_y,  ora,  5) \
+    X(0x14, zeropage_x,  nop,  1) \
+    X(0x15, zeropage_x,  ora,  4) \
+    X(0x16, zeropage_x,  asl,  6) \
+    X(0x18, implied,     clc,  2) \
+    X(0x19, absolute_y,  ora,  4) \
+    X(0x1A, accumulator, nop,  1) \
+    X(0x1C, absolute_x,  nop,  1) \
+    X(0x1D, absolute_x,  ora,  4) \
+    X(0x1E, absolute_x,  asl,  7) \
+    X(0x20, absolute,    jsr,  6) \
+    X(0x21, indirect_x,  and,  6) \
+    X(0x24, zeropage,    bit,  3) \
+    X(0x25, zeropage,    and,  3) \
+    X(0x26, zeropage,    rol,  5) \
+    X(0x28, implied,     plp,  3) \
+    X(0x29, immediate,   and,  2) \
+    X(0x2A, accumulator, rola, 2) \
+    X(0x2C, absolute,    bit,  4) \
+    X(0x2D, absolute,    and,  2) \
+    X(0x2E, absolute,    rol,  6) \
+    X(0x30, relative,    bmi,  2) \
+    X(0x31, indirect_y,  and,  5) \
+    X(0x34, zeropage_x,  nop,  1) \
+    X(0x35, zeropage_x,  and,  4) \
+    X(0x36, zeropage_x,  rol,  6) \
+    X(0x38, implied,     sec,  2) \
+    X(0x39, absolute_y,  and,  4) \
+    X(0x3A, accumulator, nop,  1) \
+    X(0x3C, absolute_x,  nop,  1) \
+    X(0x3D, absolute_x,  and,  4) \
+    X(0x3E, absolute_x,  rol,  7) \
+    X(0x40, implied,     rti,  6) \
+    X(0x41, indirect_x,  eor,  6) \
+    X(0x44, zeropage,    nop,  1) \
+    X(0x45, zeropage,    eor,  3) \
+    X(0x46, zeropage,    lsr,  5) \
+    X(0x48, implied,     pha,  3) \
+    X(0x49, immediate,   eor,  2) \
+    X(0x4A, accumulator, lsra, 2) \
+    X(0x4C, absolute,    jmp,  3) \
+    X(0x4D, absolute,    eor,  4) \
+    X(0x4E, absolute,    lsr,  6) \
+    X(0x50, relative,    bvc,  2) \
+    X(0x51, indirect_y,  eor,  5) \
+    X(0x54, zeropage_x,  nop,  1) \
+    X(0x55, zeropage_x,  eor,  4) \
+    X(0x56, zeropage_x,  lsr,  6) \
+    X(0x58, implied,     cli,  2) \
+    X(0x59, absolute_y,  eor,  4) \
+    X(0x5A, accumulator, nop,  1) \
+    X(0x5C, absolute_x,  nop,  1) \
+    X(0x5D, absolute_x,  eor,  4) \
+    X(0x5E, absolute_x,  lsr,  7) \
+    X(0x60, implied,     rts,  6) \
+    X(0x61, indirect_x,  adc,  6) \
+    X(0x64, zeropage,    nop,  1) \
+    X(0x65, zeropage,    adc,  3) \
+    X(0x66, zeropage,    ror,  5) \
+    X(0x68, implied,     pla,  4) \
+    X(0x69, immediate,   adc,  2) \
+    X(0x6A, accumulator, rora, 2) \
+    X(0x6C, indirect,    jmp,  5) \
+    X(0x6D, absolute,    adc,  4) \
+    X(0x6E, absolute,    ror,  6) \
+    X(0x70, relative,    bvs,  2) \
+    X(0x71, indirect_y,  adc,  5) \
+    X(0x74, zeropage,    nop,  1) \
+    X(0x75, zeropage_x,  adc,  4) \
+    X(0x76, zeropage_x,  ror,  6) \
+    X(0x78, implied,     sei,  2) \
+    X(0x79, absolute_y,  adc,  4) \
+    X(0x7A, accumulator, nop,  1) \
+    X(0x7C, absolute_x,  nop,  1) \
+    X(0x7D, absolute_x,  adc,  4) \
+    X(0x7E, absolute_x,  ror,  7) \
+    X(0x80, immediate,   nop,  1) \
+    X(0x81, indirect_x,  sta,  6) \
+    X(0x84, zeropage,    sty,  3) \
+    X(0x85, zeropage,    sta,  3) \
+    X(0x86, zeropage,    stx,  3) \
+    X(0x88, implied,     dey,  2) \
+    X(0x8A, implied,     txa,  2) \
+    X(0x8C, absolute,    sty,  4) \
+    X(0x8D, absolute,    sta,  4) \
+    X(0x8E, absolute,    stx,  4) \
+    X(0x90, relative,    bcc,  2) \
+    X(0x91, indirect_y,  sta,  6) \
+    X(0x94, zeropage_x,  sty,  4) \
+    X(0x95, zeropage_x,  sta,  4) \
+    X(0x96, zeropage_y,  stx,  4) \
+    X(0x98, implied,     tya,  2) \
+    X(0x99, absolute_y,  sta,  5) \
+    X(0x9A, implied,     txs,  2) \
+    X(0x9D, absolute_x,  sta,  5) \
+    X(0xA0, immediate,   ldy,  2) \
+    X(0xA1, indirect_x,  lda,  6) \
+    X(0xA2, immediate,   ldx,  2) \
+    X(0xA4, zeropage,    ldy,  3) \
+    X(0xA5, zeropage,    lda,  3) \
+    X(0xA6, zeropage,    ldx,  3) \
+    X(0xA8, implied,     tay,  3) \
+    X(0xA9, immediate,   lda,  2) \
+    X(0xAA, implied,     tax,  2) \
+    X(0xAC, absolute,    ldy,  4) \
+    X(0xAD, absolute,    lda,  4) \
+    X(0xAE, absolute,    ldx,  4) \
+    X(0xB0, relative,    bcs,  2) \
+    X(0xB1, indirect_y,  lda,  5) \
+    X(0xB4, zeropage_x,  ldy,  4) \
+    X(0xB5, zeropage_x,  lda,  4) \
+    X(0xB6, zeropage_y,  ldx,  4) \
+    X(0xB8, implied,     clv,  2) \
+    X(0xB9, absolute_y,  lda,  4) \
+    X(0xBA, implied,     tsx,  2) \
+    X(0xBC, absolute_x,  ldy,  4) \
+    X(0xBD, absolute_x,  lda,  4) \
+    X(0xBE, absolute_y,  ldx,  4) \
+    X(0xC0, immediate,   cpy,  2) \
+    X(0xC1, indirect_x,  cmp,  6) \
+    X(0xC4, zeropage,    cpy,  3) \
+    X(0xC5, zeropage,    cmp,  3) \
+    X(0xC6, zeropage,    dec,  5) \
+    X(0xC8, implied,     iny,  2) \
+    X(0xC9, immediate,   cmp,  2) \
+    X(0xCA, implied,     dex,  2) \
+    X(0xCC, absolute,    cpy,  4) \
+    X(0xCD, absolute,    cmp,  4) \
+    X(0xCE, absolute,    dec,  6) \
+    X(0xD0, relative,    bne,  2) \
+    X(0xD1, indirect_y,  cmp,  5) \
+    X(0xD4, zeropage_x,  nop,  1) \
+    X(0xD5, zeropage_x,  cmp,  5) \
+    X(0xD6, zeropage_x,  dec,  6) \
+    X(0xD8, implied,     cld,  2) \
+    X(0xD9, absolute_y,  cmp,  4) \
+    X(0xDA, accumulator, nop,  1) \
+    X(0xDC, absolute_x,  nop,  1) \
+    X(0xDD, absolute_x,  cmp,  4) \
+    X(0xDE, absolute_x,  dec,  7) \
+    X(0xE0, immediate,   cpx,  2) \
+    X(0xE1, indirect_x,  sbc,  6) \
+    X(0xE4, zeropage,    cpx,  3) \
+    X(0xE5, zeropage,    sbc,  3) \
+    X(0xE6, zeropage,    inc,  5) \
+    X(0xE8, implied,     inx,  2) \
+    X(0xE9, immediate,   sbc,  2) \
+    X(0xEA, accumulator, nop,  2) \
+    X(0xEC, absolute,    cpx,  4) \
+    X(0xED, absolute,    sbc,  4) \
+    X(0xEE, absolute,    inc,  6) \
+    X(0xF0, relative,    beq,  2) \
+    X(0xF1, indirect_y,  sbc,  5) \
+    X(0xF4, zeropage_x,  nop,  1) \
+    X(0xF5, zeropage_x,  sbc,  4) \
+    X(0xF6, zeropage_x,  inc,  6) \
+    X(0xF8, implied,     sed,  2) \
+    X(0xF9, absolute_y,  sbc,  4) \
+    X(0xFA, accumulator, nop,  1) \
+    X(0xFC, absolute_x,  nop,  1) \
+    X(0xFD, absolute_x,  sbc,  4) \
+    X(0xFE, absolute_x,  inc,  7) \
+
+#endif //BEMU_CPU_INTERNAL_H
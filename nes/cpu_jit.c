@@ -0,0 +1,551 @@
+/* 6502 动态重编译 (JIT), 仅支持 x86-64
+ *
+ * cpu_run 每次执行跳转或分支指令后, 调用 cpu_jit_run 检查目标地址.
+ * 某个 PRG ROM 中的地址被跳转到的次数超过 JIT_HOT_THRESHOLD 后, 将从该地址开始的一段指令 (基本块)
+ * 翻译为 x86-64 机器码, 之后再次跳转到该地址时直接执行机器码.
+ *
+ * 基本块在以下位置结束:
+ *   - 分支, 跳转, 子程序调用与返回, BRK 等修改 PC 的指令
+ *   - CLI 与 PLP (清除中断屏蔽标志后可能立即响应 IRQ)
+ *   - 写入地址可能不在内部 RAM 或 Save RAM 中的指令 (PPU 与 IO 寄存器, PRG ROM 等)
+ *   - Undocumented Opcodes (不包含在基本块中, 交给 cpu_run 执行)
+ *   - 指令数达到 JIT_MAX_INSTRUCTIONS
+ *
+ * 对内部 RAM 的读写, 寄存器传送, 标志位操作等简单指令直接生成机器码,
+ * 其他指令调用由 cpu_internal.h 中的宏生成的 C 函数 (jit_helper_*) 执行, 行为与 cpu_run 完全一致.
+ * 基本块中的 Cycle 数在编译时计算, 只有跨页访问需要的额外 Cycle 在执行时累加.
+ *
+ * PRG ROM 中已经被编译的字节被写入时, 丢弃全部已编译的代码.
+ *
+ * JIT 的状态保存在 struct cpu_jit 中, 由 cpu_jit_init 分配, 每台 nes_machine 各有一个.
+ * 设置环境变量 BEMU_CPU_JIT=0 时不使用 JIT, 全部指令由 cpu_run 执行, 用于与 JIT 对比运行结果 (见 tools/headless.c).
+ *
+ * 生成的代码中使用的寄存器:
+ *   rbx: &m->cpu
+ *   r12: m->interal_ram
+ *   r13d: 执行时累加的额外 Cycle 数
+ */
+
+#include "cpu_jit.h"
+
+#ifdef BEMU_CPU_JIT
+
+#if !defined(__GNUC__) || !defined(__x86_64__)
+#error "BEMU_CPU_JIT 仅支持 x86-64 平台上的 GCC 或 Clang"
+#endif
+
+#include "cpu.h"
+#include "cpu_internal.h"
+#include "memory.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define JIT_HOT_THRESHOLD    16              // 跳转到某地址的次数超过该值后编译
+#define JIT_MAX_INSTRUCTIONS 32              // 每个基本块中的最大指令数
+#define JIT_CODE_SIZE        (4 * 1024 * 1024)
+#define JIT_BLOCK_CODE_MAX   4096            // 每个基本块生成代码的最大长度
+#define JIT_MAX_BLOCKS       8192
+
+#define JIT_UNCOMPILABLE     0xff            // jit_counter 中的值, 表示该地址无法编译
+
+struct jit_block {
+    uint8_t *code;   // 机器码入口, 返回执行的 Cycle 数
+    int max_cycles;  // 执行该基本块最多需要的 Cycle 数
+};
+
+struct cpu_jit {
+    struct nes_machine *m;
+    uint8_t *code;                           // 代码缓冲区
+    uint8_t *code_ptr;                       // 代码缓冲区中下一个可用位置
+    struct jit_block blocks[JIT_MAX_BLOCKS];
+    int block_count;
+    struct jit_block *block_map[0x8000];     // 以 PRG ROM 地址 (8000 ~ FFFF) 为索引
+    uint8_t counter[0x8000];                 // 各地址被跳转到的次数
+    uint8_t covered[0x8000];                 // 该字节是否属于某个已编译的基本块
+    int reset_pending;                       // 已编译的代码失效, 下次进入 cpu_jit_run 时回收代码缓冲区
+};
+
+/* 指令的寻址方式与操作, 由 CPU_OPCODE_TABLE 生成, 用于编译时判断 */
+enum jit_mode {
+    JIT_MODE_none, JIT_MODE_implied, JIT_MODE_accumulator, JIT_MODE_immediate,
+    JIT_MODE_zeropage, JIT_MODE_zeropage_x, JIT_MODE_zeropage_y,
+    JIT_MODE_absolute, JIT_MODE_absolute_x, JIT_MODE_absolute_y,
+    JIT_MODE_relative, JIT_MODE_indirect, JIT_MODE_indirect_x, JIT_MODE_indirect_y
+};
+
+enum jit_op {
+    JIT_OP_none,
+    JIT_OP_adc, JIT_OP_and, JIT_OP_asl, JIT_OP_asla, JIT_OP_bcc, JIT_OP_bcs, JIT_OP_beq, JIT_OP_bit,
+    JIT_OP_bmi, JIT_OP_bne, JIT_OP_bpl, JIT_OP_brk, JIT_OP_bvc, JIT_OP_bvs, JIT_OP_clc, JIT_OP_cld,
+    JIT_OP_cli, JIT_OP_clv, JIT_OP_cmp, JIT_OP_cpx, JIT_OP_cpy, JIT_OP_dec, JIT_OP_dex, JIT_OP_dey,
+    JIT_OP_eor, JIT_OP_inc, JIT_OP_inx, JIT_OP_iny, JIT_OP_jmp, JIT_OP_jsr, JIT_OP_lda, JIT_OP_ldx,
+    JIT_OP_ldy, JIT_OP_lsr, JIT_OP_lsra, JIT_OP_nop, JIT_OP_ora, JIT_OP_pha, JIT_OP_php, JIT_OP_pla,
+    JIT_OP_plp, JIT_OP_rol, JIT_OP_rola, JIT_OP_ror, JIT_OP_rora, JIT_OP_rti, JIT_OP_rts, JIT_OP_sbc,
+    JIT_OP_sec, JIT_OP_sed, JIT_OP_sei, JIT_OP_sta, JIT_OP_stx, JIT_OP_sty, JIT_OP_tax, JIT_OP_tay,
+    JIT_OP_tsx, JIT_OP_txa, JIT_OP_txs, JIT_OP_tya
+};
+
+#define JIT_MODE_TABLE_ENTRY(code, mode, op, cycles)   [code] = JIT_MODE_##mode,
+#define JIT_OP_TABLE_ENTRY(code, mode, op, cycles)     [code] = JIT_OP_##op,
+#define JIT_CYCLE_TABLE_ENTRY(code, mode, op, cycles)  [code] = cycles,
+#define JIT_LENGTH_TABLE_ENTRY(code, mode, op, cycles) [code] = OPERAND_LENGTH_##mode + 1,
+static const uint8_t jit_mode_table[256]   = { CPU_OPCODE_TABLE(JIT_MODE_TABLE_ENTRY) };
+static const uint8_t jit_op_table[256]     = { CPU_OPCODE_TABLE(JIT_OP_TABLE_ENTRY) };
+static const uint8_t jit_cycle_table[256]  = { CPU_OPCODE_TABLE(JIT_CYCLE_TABLE_ENTRY) };
+static const uint8_t jit_length_table[256] = { CPU_OPCODE_TABLE(JIT_LENGTH_TABLE_ENTRY) };
+
+/* 不能直接生成机器码的指令调用以下函数执行, 调用前 m->cpu.pc 已经指向下一条指令
+ * elapsed 为基本块开始后包括该指令在内经过的 Cycle 数, 执行时计入 m->cpu_run_cycles (见 cpu_clock)
+ * 返回跨页访问等情况需要的额外 Cycle 数
+ */
+#define CPU_BRANCH_TAKEN (void)0
+#define CPU_STALL_TAKEN  (void)0  // 写入 IO 寄存器的指令总是基本块中的最后一条, 由 cpu_run 扣除暂停的 Cycle
+#define JIT_HELPER(code, mode, op, cycles) \
+    static int jit_helper_##code(struct nes_machine *m, uint16_t operand, int elapsed) { \
+        uint16_t address = 0; \
+        uint8_t value = 0, extra; \
+        m->cpu_run_cycles += elapsed; \
+        ADDRESSING_##mode \
+        OPERATION_##op \
+        m->cpu_run_cycles -= elapsed; \
+        (void)address; (void)value; (void)operand; \
+        m->additional_cycles = extra; \
+        return extra; \
+    }
+CPU_OPCODE_TABLE(JIT_HELPER)
+
+#define JIT_HELPER_TABLE_ENTRY(code, mode, op, cycles) [code] = jit_helper_##code,
+static int (* const jit_helper_table[256])(struct nes_machine *, uint16_t, int) = { CPU_OPCODE_TABLE(JIT_HELPER_TABLE_ENTRY) };
+
+/* 机器码生成 */
+
+#define JIT_CPU(reg) ((uint8_t)offsetof(struct _cpu, reg))
+
+static void jit_emit8(struct cpu_jit *jit, uint8_t data)   { *jit->code_ptr++ = data; }
+static void jit_emit16(struct cpu_jit *jit, uint16_t data) { memcpy(jit->code_ptr, &data, 2); jit->code_ptr += 2; }
+static void jit_emit32(struct cpu_jit *jit, uint32_t data) { memcpy(jit->code_ptr, &data, 4); jit->code_ptr += 4; }
+static void jit_emit64(struct cpu_jit *jit, uint64_t data) { memcpy(jit->code_ptr, &data, 8); jit->code_ptr += 8; }
+
+/* mov al, [rbx + reg] */
+static void jit_emit_load_al(struct cpu_jit *jit, uint8_t reg)  { jit_emit8(jit, 0x8a); jit_emit8(jit, 0x43); jit_emit8(jit, reg); }
+/* mov [rbx + reg], al */
+static void jit_emit_store_al(struct cpu_jit *jit, uint8_t reg) { jit_emit8(jit, 0x88); jit_emit8(jit, 0x43); jit_emit8(jit, reg); }
+/* or byte [rbx + p], flag */
+static void jit_emit_set_flag(struct cpu_jit *jit, uint8_t flag)   { jit_emit8(jit, 0x80); jit_emit8(jit, 0x4b); jit_emit8(jit, JIT_CPU(p)); jit_emit8(jit, flag); }
+/* and byte [rbx + p], ~flag */
+static void jit_emit_clear_flag(struct cpu_jit *jit, uint8_t flag) { jit_emit8(jit, 0x80); jit_emit8(jit, 0x63); jit_emit8(jit, JIT_CPU(p)); jit_emit8(jit, ~flag); }
+/* mov byte [rbx + reg], data */
+static void jit_emit_store_imm(struct cpu_jit *jit, uint8_t reg, uint8_t data) { jit_emit8(jit, 0xc6); jit_emit8(jit, 0x43); jit_emit8(jit, reg); jit_emit8(jit, data); }
+
+/* 与 cpu_checknz 相同, 根据 al 设置 Zero Flag 与 Negative Flag */
+static void jit_emit_checknz(struct cpu_jit *jit) {
+    jit_emit_store_al(jit, JIT_CPU(n));
+    jit_emit_store_al(jit, JIT_CPU(z));
+}
+
+/* mov rax, pointer; call rax */
+static void jit_emit_call(struct cpu_jit *jit, const void *function) {
+    jit_emit8(jit, 0x48); jit_emit8(jit, 0xb8); jit_emit64(jit, (uint64_t)(uintptr_t)function);
+    jit_emit8(jit, 0xff); jit_emit8(jit, 0xd0);
+}
+
+/* mov rdi, m; mov esi, operand
+ * 设置 cpu_icache_invalidate 与 jit_helper_* 的参数
+ */
+static void jit_emit_set_args(struct cpu_jit *jit, uint16_t operand) {
+    jit_emit8(jit, 0x48); jit_emit8(jit, 0xbf); jit_emit64(jit, (uint64_t)(uintptr_t)jit->m);
+    jit_emit8(jit, 0xbe); jit_emit32(jit, operand);
+}
+
+/* mov word [rbx + pc], address */
+static void jit_emit_set_pc(struct cpu_jit *jit, uint16_t address) {
+    jit_emit8(jit, 0x66); jit_emit8(jit, 0xc7); jit_emit8(jit, 0x43); jit_emit8(jit, JIT_CPU(pc)); jit_emit16(jit, address);
+}
+
+/* m->additional_cycles = extra */
+static void jit_emit_set_additional_cycles(struct cpu_jit *jit, uint8_t extra) {
+    jit_emit8(jit, 0x48); jit_emit8(jit, 0xb8); jit_emit64(jit, (uint64_t)(uintptr_t)&jit->m->additional_cycles);
+    jit_emit8(jit, 0xc6); jit_emit8(jit, 0x00); jit_emit8(jit, extra);
+}
+
+/* 将内部 RAM 中的值读入 cl, address 为 CPU 地址 (0000 ~ 1FFF) */
+static void jit_emit_load_cl_ram(struct cpu_jit *jit, uint16_t address) {
+    jit_emit8(jit, 0x41); jit_emit8(jit, 0x8a); jit_emit8(jit, 0x8c); jit_emit8(jit, 0x24); jit_emit32(jit, address & 0x07ff);
+}
+
+/* 将 al 写入内部 RAM, 如果该地址所在的指令缓存中有已经解码的指令, 调用 cpu_icache_invalidate
+ * 地址位于页的前 2 个字节时, 包含该字节的指令可能从上一页开始, 此时总是调用 cpu_icache_invalidate
+ */
+static void jit_emit_store_al_ram(struct cpu_jit *jit, uint16_t address) {
+    jit_emit8(jit, 0x41); jit_emit8(jit, 0x88); jit_emit8(jit, 0x84); jit_emit8(jit, 0x24); jit_emit32(jit, address & 0x07ff);
+    if((address & 0xff) >= 2) {
+        jit_emit8(jit, 0x48); jit_emit8(jit, 0xb8); jit_emit64(jit, (uint64_t)(uintptr_t)cpu_icache_page_flag(jit->m, address));
+        jit_emit8(jit, 0x80); jit_emit8(jit, 0x38); jit_emit8(jit, 0x00);  // cmp byte [rax], 0
+        jit_emit8(jit, 0x74); jit_emit8(jit, 27);                     // je +27
+    }
+    jit_emit_set_args(jit, address);
+    jit_emit_call(jit, cpu_icache_invalidate);
+}
+
+/* 将寻址得到的值读入 cl, 返回 0 表示该寻址方式不能直接生成机器码 */
+static int jit_emit_load_value(struct cpu_jit *jit, uint8_t mode, uint16_t operand) {
+    switch(mode) {
+        case JIT_MODE_immediate:
+            jit_emit8(jit, 0xb1); jit_emit8(jit, (uint8_t)operand);  // mov cl, operand
+            return 1;
+        case JIT_MODE_zeropage:
+            jit_emit_load_cl_ram(jit, operand & 0xff);
+            return 1;
+        case JIT_MODE_absolute:
+            if(operand >= 0x2000) { return 0; }
+            jit_emit_load_cl_ram(jit, operand);
+            return 1;
+        case JIT_MODE_zeropage_x:
+        case JIT_MODE_zeropage_y:
+            // movzx ecx, byte [rbx + x/y]; add cl, operand; mov cl, [r12 + rcx]
+            jit_emit8(jit, 0x0f); jit_emit8(jit, 0xb6); jit_emit8(jit, 0x4b);
+            jit_emit8(jit, mode == JIT_MODE_zeropage_x ? JIT_CPU(x) : JIT_CPU(y));
+            jit_emit8(jit, 0x80); jit_emit8(jit, 0xc1); jit_emit8(jit, (uint8_t)operand);
+            jit_emit8(jit, 0x41); jit_emit8(jit, 0x8a); jit_emit8(jit, 0x0c); jit_emit8(jit, 0x0c);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* 获取静态写入地址 (内部 RAM 中), 返回 0 表示写入地址不确定或不在内部 RAM 中 */
+static int jit_static_ram_address(uint8_t mode, uint16_t operand, uint16_t *address) {
+    if(mode == JIT_MODE_zeropage) { *address = operand & 0xff; return 1; }
+    if(mode == JIT_MODE_absolute && operand < 0x2000) { *address = operand; return 1; }
+    return 0;
+}
+
+/* 判断指令是否可能写入内部 RAM 与 Save RAM 以外的区域 */
+static int jit_unsafe_write(uint8_t opcode, uint16_t operand) {
+    uint8_t mode = jit_mode_table[opcode];
+    uint32_t first, last;
+    switch(jit_op_table[opcode]) {
+        case JIT_OP_sta: case JIT_OP_stx: case JIT_OP_sty:
+        case JIT_OP_asl: case JIT_OP_lsr: case JIT_OP_rol: case JIT_OP_ror:
+        case JIT_OP_inc: case JIT_OP_dec:
+            break;
+        default:
+            return 0;
+    }
+    switch(mode) {
+        case JIT_MODE_zeropage: case JIT_MODE_zeropage_x: case JIT_MODE_zeropage_y:
+            return 0;
+        case JIT_MODE_absolute:
+            first = last = operand;
+            break;
+        case JIT_MODE_absolute_x: case JIT_MODE_absolute_y:
+            first = operand;
+            last = (uint32_t)operand + 0xff;
+            break;
+        default:
+            return 1;
+    }
+    if(last < 0x2000) { return 0; }
+    if(first >= 0x6000 && last < 0x8000) { return 0; }
+    return 1;
+}
+
+/* 直接生成指令的机器码, 返回 0 表示该指令需要调用 jit_helper_* 执行 */
+static int jit_emit_native(struct cpu_jit *jit, uint8_t opcode, uint16_t operand) {
+    uint8_t mode = jit_mode_table[opcode];
+    uint8_t reg;
+    uint16_t address;
+    uint8_t *start = jit->code_ptr;
+
+    switch(jit_op_table[opcode]) {
+        case JIT_OP_lda: case JIT_OP_ldx: case JIT_OP_ldy:
+            if(!jit_emit_load_value(jit, mode, operand)) { break; }
+            reg = jit_op_table[opcode] == JIT_OP_lda ? JIT_CPU(a) : jit_op_table[opcode] == JIT_OP_ldx ? JIT_CPU(x) : JIT_CPU(y);
+            jit_emit8(jit, 0x88); jit_emit8(jit, 0xc8);                 // mov al, cl
+            jit_emit_store_al(jit, reg);
+            jit_emit_checknz(jit);
+            return 1;
+        case JIT_OP_and: case JIT_OP_ora: case JIT_OP_eor:
+            if(!jit_emit_load_value(jit, mode, operand)) { break; }
+            jit_emit_load_al(jit, JIT_CPU(a));
+            // and/or/xor al, cl
+            jit_emit8(jit, jit_op_table[opcode] == JIT_OP_and ? 0x20 : jit_op_table[opcode] == JIT_OP_ora ? 0x08 : 0x30);
+            jit_emit8(jit, 0xc8);
+            jit_emit_store_al(jit, JIT_CPU(a));
+            jit_emit_checknz(jit);
+            return 1;
+        case JIT_OP_cmp: case JIT_OP_cpx: case JIT_OP_cpy:
+            if(!jit_emit_load_value(jit, mode, operand)) { break; }
+            reg = jit_op_table[opcode] == JIT_OP_cmp ? JIT_CPU(a) : jit_op_table[opcode] == JIT_OP_cpx ? JIT_CPU(x) : JIT_CPU(y);
+            jit_emit_load_al(jit, reg);
+            jit_emit8(jit, 0x38); jit_emit8(jit, 0xc8);                                   // cmp al, cl
+            jit_emit8(jit, 0x0f); jit_emit8(jit, 0x93); jit_emit8(jit, 0x43); jit_emit8(jit, JIT_CPU(c));  // setae [rbx + c]
+            jit_emit8(jit, 0x28); jit_emit8(jit, 0xc8);                                   // sub al, cl
+            jit_emit_checknz(jit);
+            return 1;
+        case JIT_OP_sta: case JIT_OP_stx: case JIT_OP_sty:
+            if(!jit_static_ram_address(mode, operand, &address)) { break; }
+            reg = jit_op_table[opcode] == JIT_OP_sta ? JIT_CPU(a) : jit_op_table[opcode] == JIT_OP_stx ? JIT_CPU(x) : JIT_CPU(y);
+            jit_emit_load_al(jit, reg);
+            jit_emit_store_al_ram(jit, address);
+            return 1;
+        case JIT_OP_inc: case JIT_OP_dec:
+            if(!jit_static_ram_address(mode, operand, &address)) { break; }
+            jit_emit8(jit, 0x41); jit_emit8(jit, 0x8a); jit_emit8(jit, 0x84); jit_emit8(jit, 0x24); jit_emit32(jit, address & 0x07ff);  // mov al, [r12 + address]
+            jit_emit8(jit, 0xfe); jit_emit8(jit, jit_op_table[opcode] == JIT_OP_inc ? 0xc0 : 0xc8);                      // inc/dec al
+            jit_emit_checknz(jit);
+            jit_emit_store_al_ram(jit, address);
+            return 1;
+        case JIT_OP_inx: case JIT_OP_iny: case JIT_OP_dex: case JIT_OP_dey:
+            reg = (jit_op_table[opcode] == JIT_OP_inx || jit_op_table[opcode] == JIT_OP_dex) ? JIT_CPU(x) : JIT_CPU(y);
+            jit_emit_load_al(jit, reg);
+            jit_emit8(jit, 0xfe); jit_emit8(jit, (jit_op_table[opcode] == JIT_OP_inx || jit_op_table[opcode] == JIT_OP_iny) ? 0xc0 : 0xc8);
+            jit_emit_store_al(jit, reg);
+            jit_emit_checknz(jit);
+            return 1;
+        case JIT_OP_tax: jit_emit_load_al(jit, JIT_CPU(a));  jit_emit_store_al(jit, JIT_CPU(x));  jit_emit_checknz(jit); return 1;
+        case JIT_OP_tay: jit_emit_load_al(jit, JIT_CPU(a));  jit_emit_store_al(jit, JIT_CPU(y));  jit_emit_checknz(jit); return 1;
+        case JIT_OP_txa: jit_emit_load_al(jit, JIT_CPU(x));  jit_emit_store_al(jit, JIT_CPU(a));  jit_emit_checknz(jit); return 1;
+        case JIT_OP_tya: jit_emit_load_al(jit, JIT_CPU(y));  jit_emit_store_al(jit, JIT_CPU(a));  jit_emit_checknz(jit); return 1;
+        case JIT_OP_tsx: jit_emit_load_al(jit, JIT_CPU(sp)); jit_emit_store_al(jit, JIT_CPU(x));  jit_emit_checknz(jit); return 1;
+        case JIT_OP_txs: jit_emit_load_al(jit, JIT_CPU(x));  jit_emit_store_al(jit, JIT_CPU(sp)); return 1;
+        case JIT_OP_clc: jit_emit_store_imm(jit, JIT_CPU(c), 0);   return 1;
+        case JIT_OP_cld: jit_emit_clear_flag(jit, FLAG_DECIMAL);   return 1;
+        case JIT_OP_clv: jit_emit_store_imm(jit, JIT_CPU(v), 0);   return 1;
+        case JIT_OP_sec: jit_emit_store_imm(jit, JIT_CPU(c), 1);   return 1;
+        case JIT_OP_sei: jit_emit_set_flag(jit, FLAG_INTERRUPT);   return 1;
+        case JIT_OP_sed: jit_emit_set_flag(jit, FLAG_DECIMAL);     return 1;
+        case JIT_OP_nop:
+            // 只读取内部 RAM 的 NOP 没有副作用
+            if(mode == JIT_MODE_absolute || mode == JIT_MODE_absolute_x) { break; }
+            return 1;
+        default:
+            break;
+    }
+    jit->code_ptr = start;
+    return 0;
+}
+
+/* 丢弃全部已编译的代码 */
+static void jit_reset(struct cpu_jit *jit) {
+    memset(jit->block_map, 0, sizeof(jit->block_map));
+    memset(jit->counter, 0, sizeof(jit->counter));
+    memset(jit->covered, 0, sizeof(jit->covered));
+    jit->block_count = 0;
+    jit->code_ptr = jit->code;
+    jit->reset_pending = 0;
+}
+
+/* 编译从 start 开始的基本块, 返回 NULL 表示无法编译 */
+static struct jit_block *jit_compile(struct cpu_jit *jit, uint16_t start) {
+    struct nes_machine *m = jit->m;
+    struct jit_block *block;
+    uint32_t pc = start;
+    int instructions = 0, static_cycles = 0, max_cycles = 0;
+    int pc_set = 0, extra_set = 0;
+
+    if(jit->block_count >= JIT_MAX_BLOCKS || jit->code_ptr + JIT_BLOCK_CODE_MAX > jit->code + JIT_CODE_SIZE) {
+        jit_reset(jit);
+    }
+    block = &jit->blocks[jit->block_count];
+    block->code = jit->code_ptr;
+
+    jit_emit8(jit, 0x53);                                                            // push rbx
+    jit_emit8(jit, 0x41); jit_emit8(jit, 0x54);                                           // push r12
+    jit_emit8(jit, 0x41); jit_emit8(jit, 0x55);                                           // push r13
+    jit_emit8(jit, 0x48); jit_emit8(jit, 0xbb); jit_emit64(jit, (uint64_t)(uintptr_t)&m->cpu);    // mov rbx, &m->cpu
+    jit_emit8(jit, 0x49); jit_emit8(jit, 0xbc); jit_emit64(jit, (uint64_t)(uintptr_t)m->interal_ram);  // mov r12, m->interal_ram
+    jit_emit8(jit, 0x45); jit_emit8(jit, 0x31); jit_emit8(jit, 0xed);                          // xor r13d, r13d
+
+    while(instructions < JIT_MAX_INSTRUCTIONS) {
+        uint8_t opcode = memory_read_byte(m, pc);
+        uint8_t length = jit_length_table[opcode];
+        uint8_t mode = jit_mode_table[opcode];
+        uint16_t operand = 0;
+        uint16_t next;
+
+        if(jit_op_table[opcode] == JIT_OP_none) { break; }  // Undocumented Opcodes
+        if(pc + length > 0x10000) { break; }
+        if(length >= 2) { operand = memory_read_byte(m, pc + 1); }
+        if(length >= 3) { operand |= memory_read_byte(m, pc + 2) << 8; }
+        next = pc + length;
+        memset(&jit->covered[pc - 0x8000], 1, length);
+        instructions++;
+        static_cycles += jit_cycle_table[opcode];
+        max_cycles += jit_cycle_table[opcode];
+
+        if(mode == JIT_MODE_relative) {
+            // 条件分支: 额外的 Cycle 数在编译时即可确定
+            uint16_t target = (uint16_t)(int8_t)operand + next;
+            uint8_t extra = (target >> 8) != (next >> 8);
+            uint8_t op = jit_op_table[opcode];
+            static_cycles += extra;
+            max_cycles += extra;
+            jit_emit_set_pc(jit, next);
+            if(op == JIT_OP_bmi || op == JIT_OP_bpl) {
+                jit_emit8(jit, 0xf6); jit_emit8(jit, 0x43); jit_emit8(jit, JIT_CPU(n)); jit_emit8(jit, FLAG_NEGATIVE);  // test byte [rbx + n], 0x80
+                jit_emit8(jit, op == JIT_OP_bmi ? 0x74 : 0x75); jit_emit8(jit, 0x06);                           // jz/jnz +6
+            } else {
+                // cmp byte [rbx + z/c/v], 0
+                jit_emit8(jit, 0x80); jit_emit8(jit, 0x7b);
+                jit_emit8(jit, (op == JIT_OP_beq || op == JIT_OP_bne) ? JIT_CPU(z) :
+                          (op == JIT_OP_bcs || op == JIT_OP_bcc) ? JIT_CPU(c) : JIT_CPU(v));
+                jit_emit8(jit, 0x00);
+                // z == 0 表示 Zero Flag 为 1, c/v != 0 表示 Carry/Overflow 为 1
+                jit_emit8(jit, (op == JIT_OP_beq || op == JIT_OP_bcc || op == JIT_OP_bvc) ? 0x75 : 0x74); jit_emit8(jit, 0x06);  // jnz/jz +6
+            }
+            jit_emit_set_pc(jit, target);
+            jit_emit_set_additional_cycles(jit, extra);
+            pc_set = extra_set = 1;
+            break;
+        }
+        if(jit_op_table[opcode] == JIT_OP_jmp && mode == JIT_MODE_absolute) {
+            jit_emit_set_pc(jit, operand);
+            jit_emit_set_additional_cycles(jit, 0);
+            pc_set = extra_set = 1;
+            break;
+        }
+        if(jit_emit_native(jit, opcode, operand)) {
+            extra_set = 0;
+            pc = next;
+            continue;
+        }
+
+        // 调用 C 函数执行该指令
+        jit_emit_set_pc(jit, next);
+        jit_emit_set_args(jit, operand);
+        jit_emit8(jit, 0x41); jit_emit8(jit, 0x8d); jit_emit8(jit, 0x95); jit_emit32(jit, static_cycles);  // lea edx, [r13 + static_cycles]
+        jit_emit_call(jit, jit_helper_table[opcode]);
+        jit_emit8(jit, 0x41); jit_emit8(jit, 0x01); jit_emit8(jit, 0xc5);      // add r13d, eax
+        if(mode == JIT_MODE_absolute_x || mode == JIT_MODE_absolute_y || mode == JIT_MODE_indirect_y) {
+            max_cycles += 1;
+        }
+        pc_set = extra_set = 1;
+        pc = next;
+
+        switch(jit_op_table[opcode]) {
+            case JIT_OP_jmp: case JIT_OP_jsr: case JIT_OP_rts: case JIT_OP_rti: case JIT_OP_brk:
+            case JIT_OP_cli: case JIT_OP_plp:  // 可能响应 IRQ (cpu_irq_poll), 修改 m->cpu.pc
+                break;
+            default:
+                if(!jit_unsafe_write(opcode, operand)) {
+                    pc_set = 0;
+                    continue;
+                }
+                break;
+        }
+        break;
+    }
+
+    if(instructions == 0) {
+        jit->code_ptr = block->code;
+        return NULL;
+    }
+
+    if(!pc_set) { jit_emit_set_pc(jit, pc); }
+    if(!extra_set) { jit_emit_set_additional_cycles(jit, 0); }
+
+    jit_emit8(jit, 0x41); jit_emit8(jit, 0x8d); jit_emit8(jit, 0x85); jit_emit32(jit, static_cycles);  // lea eax, [r13 + static_cycles]
+    jit_emit8(jit, 0x41); jit_emit8(jit, 0x5d);                                               // pop r13
+    jit_emit8(jit, 0x41); jit_emit8(jit, 0x5c);                                               // pop r12
+    jit_emit8(jit, 0x5b);                                                                // pop rbx
+    jit_emit8(jit, 0xc3);                                                                // ret
+
+    block->max_cycles = max_cycles;
+    jit->block_count++;
+    jit->block_map[start - 0x8000] = block;
+    return block;
+}
+
+/* 初始化 JIT, 丢弃全部已编译的代码 */
+void cpu_jit_init(struct nes_machine *m) {
+    const char *enabled = getenv("BEMU_CPU_JIT");
+    struct cpu_jit *jit = m->cpu_jit;
+    if(enabled != NULL && strcmp(enabled, "0") == 0) {
+        cpu_jit_exit(m);
+        return;
+    }
+    if(jit == NULL) {
+        void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(code == MAP_FAILED) {
+            fprintf(stderr, "JIT: Unable to allocate code buffer, JIT disabled\n");
+            return;
+        }
+        jit = calloc(1, sizeof(struct cpu_jit));
+        if(jit == NULL) {
+            munmap(code, JIT_CODE_SIZE);
+            fprintf(stderr, "JIT: Out of memory, JIT disabled\n");
+            return;
+        }
+        jit->m = m;
+        jit->code = code;
+        m->cpu_jit = jit;
+    }
+    jit_reset(jit);
+}
+
+/* 释放 JIT 的代码缓冲区 */
+void cpu_jit_exit(struct nes_machine *m) {
+    struct cpu_jit *jit = m->cpu_jit;
+    if(jit == NULL) { return; }
+    munmap(jit->code, JIT_CODE_SIZE);
+    free(jit);
+    m->cpu_jit = NULL;
+}
+
+/* 如果 m->cpu.pc 处有已编译的基本块, 并且剩余的 Cycle 数足够, 执行该基本块
+ * 返回执行的 Cycle 数, 0 表示没有执行
+ */
+int cpu_jit_run(struct nes_machine *m, int cycles) {
+    struct cpu_jit *jit = m->cpu_jit;
+    uint16_t pc = m->cpu.pc;
+    struct jit_block *block;
+
+    if(pc < 0x8000 || jit == NULL) { return 0; }
+    if(jit->reset_pending) { jit_reset(jit); }
+
+    block = jit->block_map[pc - 0x8000];
+    if(block == NULL) {
+        if(jit->counter[pc - 0x8000] < JIT_HOT_THRESHOLD) {
+            jit->counter[pc - 0x8000]++;
+            return 0;
+        }
+        if(jit->counter[pc - 0x8000] == JIT_UNCOMPILABLE) { return 0; }
+        block = jit_compile(jit, pc);
+        if(block == NULL) {
+            jit->counter[pc - 0x8000] = JIT_UNCOMPILABLE;
+            return 0;
+        }
+    }
+    if(cycles <= block->max_cycles) { return 0; }
+    return ((int (*)(void))block->code)();
+}
+
+/* 使全部已编译的代码失效
+ * 可能在基本块执行过程中被调用, 因此代码缓冲区在下次进入 cpu_jit_run 时才回收
+ */
+static void jit_invalidate_all(struct cpu_jit *jit) {
+    memset(jit->block_map, 0, sizeof(jit->block_map));
+    memset(jit->counter, 0, sizeof(jit->counter));
+    memset(jit->covered, 0, sizeof(jit->covered));
+    jit->reset_pending = 1;
+}
+
+/* 8000 ~ FFFF 中的某个字节被修改后, 如果该字节已经被编译, 使全部已编译的代码失效 */
+void cpu_jit_invalidate(struct nes_machine *m, uint16_t address) {
+    struct cpu_jit *jit = m->cpu_jit;
+    if(jit == NULL || address < 0x8000 || !jit->covered[address - 0x8000]) { return; }
+    jit_invalidate_all(jit);
+}
+
+/* PRG ROM 中的某页被切换到其他 Bank 后, 如果该页中有已经编译的指令, 使全部已编译的代码失效 */
+void cpu_jit_invalidate_page(struct nes_machine *m, uint8_t page) {
+    struct cpu_jit *jit = m->cpu_jit;
+    if(jit == NULL || page < 0x80 || memchr(&jit->covered[(page - 0x80) << 8], 1, 0x100) == NULL) { return; }
+    jit_invalidate_all(jit);
+}
+
+#endif /* BEMU_CPU_JIT */
@@ -0,0 +1,13 @@
+#ifndef BEMU_CPU_JIT_H
+#define BEMU_CPU_JIT_H
+
+#include <stdint.h>
+#include "machine.h"
+
+void cpu_jit_init(struct nes_machine *m);
+void cpu_jit_exit(struct nes_machine *m);
+int cpu_jit_run(struct nes_machine *m, int cycles);
+void cpu_jit_invalidate(struct nes_machine *m, uint16_t address);
+void cpu_jit_invalidate_page(struct nes_machine *m, uint8_t page);
+
+#endif //BEMU_CPU_JIT_H
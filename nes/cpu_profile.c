@@ -0,0 +1,300 @@
+/* 6502 程序性能分析
+ *
+ * 编译时定义 BEMU_CPU_PROFILE 后, cpu_run 在每条指令开始执行时记录 PC,
+ * 并将上一条指令使用的 Cycle 数 (包括跨页等额外 Cycle) 累加到该指令的地址上.
+ * 空转循环检测跳过的 Cycle 计入跳转回循环起始地址的分支指令.
+ *
+ * JSR, BRK 与 NMI 视为子程序调用, RTS 与 RTI 视为返回, 由此维护一个调用栈,
+ * 并在调用树 (struct cpu_profile_node) 中按调用路径统计 Cycle 数.
+ * 返回时弹出所有栈指针已经被释放的调用, 因此通过 "PHA, PHA, RTS" 跳转的代码与
+ * 不返回的子程序不会破坏调用栈.
+ *
+ * cpu_profile_report 输出按子程序与按指令排序的文本报告 (指令通过反汇编器显示),
+ * cpu_profile_folded 输出 folded stacks, 可以直接交给 flamegraph.pl 等工具生成火焰图.
+ */
+
+#include "cpu_profile.h"
+
+#ifdef BEMU_CPU_PROFILE
+
+#include "memory.h"
+#include "disassembler.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CPU_PROFILE_TOP_ROUTINES     32
+#define CPU_PROFILE_TOP_INSTRUCTIONS 64
+#define CPU_PROFILE_TOP_EDGES        64
+
+/* 排序用 */
+struct cpu_profile_entry {
+    uint32_t key;
+    uint64_t value;
+};
+
+static int cpu_profile_compare_value(const void *a, const void *b) {
+    uint64_t x = ((const struct cpu_profile_entry *)a)->value, y = ((const struct cpu_profile_entry *)b)->value;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int cpu_profile_compare_key(const void *a, const void *b) {
+    uint32_t x = ((const struct cpu_profile_entry *)a)->key, y = ((const struct cpu_profile_entry *)b)->key;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* 新建一个调用树节点, 节点已满时返回 -1 */
+static int cpu_profile_new_node(struct cpu_profile *p, int parent, uint16_t routine) {
+    struct cpu_profile_node *node;
+    if(p->node_count >= CPU_PROFILE_MAX_NODES) { return -1; }
+    node = &p->nodes[p->node_count];
+    node->routine = routine;
+    node->parent = parent;
+    node->first_child = -1;
+    node->next_sibling = -1;
+    node->cycles = 0;
+    node->calls = 0;
+    if(parent >= 0) {
+        node->next_sibling = p->nodes[parent].first_child;
+        p->nodes[parent].first_child = p->node_count;
+    }
+    return p->node_count++;
+}
+
+/* 初始化, 清空之前的统计结果, 调用时 m->cpu.pc 应为 Reset 后的第一条指令 */
+void cpu_profile_init(struct nes_machine *m) {
+    struct cpu_profile *p = m->cpu_profile;
+    if(p == NULL) {
+        p = malloc(sizeof(struct cpu_profile));
+        if(p == NULL) {
+            fprintf(stderr, "Profiler: Out of memory\n");
+            exit(-1);
+        }
+        m->cpu_profile = p;
+    }
+    memset(p->cycles, 0, sizeof(p->cycles));
+    memset(p->count, 0, sizeof(p->count));
+    p->node_count = 0;
+    cpu_profile_new_node(p, -1, m->cpu.pc);
+    p->nodes[0].calls = 1;
+    p->depth = 0;
+    p->node = 0;
+    p->last_pc = m->cpu.pc;
+    p->last_node = 0;
+    p->last_cycles = 0;
+}
+
+/* 保存统计结果, 然后释放内存 */
+void cpu_profile_exit(struct nes_machine *m) {
+    if(m->cpu_profile == NULL) { return; }
+    cpu_profile_save(m);
+    free(m->cpu_profile);
+    m->cpu_profile = NULL;
+}
+
+/* 进入子程序, 此时 m->cpu.pc 为子程序的入口, 返回地址已经压栈 */
+void cpu_profile_call(struct nes_machine *m) {
+    struct cpu_profile *p = m->cpu_profile;
+    int child;
+    if(p->depth >= CPU_PROFILE_MAX_DEPTH) { return; }
+
+    for(child = p->nodes[p->node].first_child; child >= 0; child = p->nodes[child].next_sibling) {
+        if(p->nodes[child].routine == m->cpu.pc) { break; }
+    }
+    if(child < 0) {
+        child = cpu_profile_new_node(p, p->node, m->cpu.pc);
+        if(child < 0) { child = p->node; }  // 调用树已满, 计入调用者
+    }
+
+    p->stack[p->depth].node = p->node;
+    p->stack[p->depth].sp = m->cpu.sp;
+    p->depth++;
+    p->node = child;
+    p->nodes[child].calls++;
+}
+
+/* 从子程序返回, 此时返回地址已经出栈 */
+void cpu_profile_return(struct nes_machine *m) {
+    struct cpu_profile *p = m->cpu_profile;
+    while(p->depth > 0 && p->stack[p->depth - 1].sp < m->cpu.sp) {
+        p->depth--;
+        p->node = p->stack[p->depth].node;
+    }
+}
+
+/* 子程序的名称 */
+static void cpu_profile_routine_name(struct nes_machine *m, uint16_t routine, char *buf, size_t size) {
+    if(routine == m->cpu_profile->nodes[0].routine) {
+        snprintf(buf, size, "reset");
+    } else if(routine == memory_read_word(m, 0xfffa)) {
+        snprintf(buf, size, "nmi");
+    } else {
+        snprintf(buf, size, "sub_%04X", routine);
+    }
+}
+
+/* 反汇编 pc 处的指令, 只读取直接映射到内存的页, 避免读取 PPU 等寄存器产生副作用 */
+static void cpu_profile_disasm(struct nes_machine *m, uint16_t pc, char *buf, size_t size) {
+    uint8_t code[3];
+    int i;
+    for(i = 0; i < 3; i++) {
+        uint16_t address = pc + i;
+        const struct memory_page *page = &m->memory_page_table[address >> 8];
+        if(page->read == NULL) {
+            snprintf(buf, size, "?");
+            return;
+        }
+        code[i] = page->read[address & 0xff];
+    }
+    disasm_format(code, buf, size);
+}
+
+/* 输出文本报告 */
+void cpu_profile_report(struct nes_machine *m, FILE *fp) {
+    struct cpu_profile *p = m->cpu_profile;
+    struct cpu_profile_entry *entries;
+    uint64_t *self, *total, *calls;
+    int *stamp;
+    uint64_t total_cycles = 0, total_instructions = 0;
+    int i, n, count;
+    char name[16], caller[16], code[32];
+
+    entries = malloc(sizeof(struct cpu_profile_entry) * 0x10000);
+    self = calloc(0x10000, sizeof(uint64_t));
+    total = calloc(0x10000, sizeof(uint64_t));
+    calls = calloc(0x10000, sizeof(uint64_t));
+    stamp = malloc(sizeof(int) * 0x10000);
+    if(entries == NULL || self == NULL || total == NULL || calls == NULL || stamp == NULL) {
+        fprintf(fp, "Profiler: Out of memory\n");
+        goto finish;
+    }
+
+    for(i = 0; i < 0x10000; i++) {
+        total_cycles += p->cycles[i];
+        total_instructions += p->count[i];
+        stamp[i] = -1;
+    }
+    fprintf(fp, "bEMU 6502 profile\n");
+    fprintf(fp, "Total: %llu cycles, %llu instructions\n\n",
+            (unsigned long long)total_cycles, (unsigned long long)total_instructions);
+    if(total_cycles == 0) { total_cycles = 1; }
+
+    /* 子程序: self 不含其调用的子程序, total 包含, 递归调用只计算一次 */
+    for(n = 0; n < p->node_count; n++) {
+        int a;
+        self[p->nodes[n].routine] += p->nodes[n].cycles;
+        calls[p->nodes[n].routine] += p->nodes[n].calls;
+        for(a = n; a >= 0; a = p->nodes[a].parent) {
+            if(stamp[p->nodes[a].routine] == n) { continue; }
+            stamp[p->nodes[a].routine] = n;
+            total[p->nodes[a].routine] += p->nodes[n].cycles;
+        }
+    }
+    count = 0;
+    for(i = 0; i < 0x10000; i++) {
+        if(calls[i] == 0) { continue; }
+        entries[count].key = i;
+        entries[count].value = self[i];
+        count++;
+    }
+    qsort(entries, count, sizeof(struct cpu_profile_entry), cpu_profile_compare_value);
+    fprintf(fp, "Routines (by self cycles)\n");
+    fprintf(fp, "  %-10s %10s %14s %7s %14s %7s\n", "routine", "calls", "self", "self%", "total", "total%");
+    for(i = 0; i < count && i < CPU_PROFILE_TOP_ROUTINES; i++) {
+        uint16_t r = entries[i].key;
+        cpu_profile_routine_name(m, r, name, sizeof(name));
+        fprintf(fp, "  %-10s %10llu %14llu %6.2f%% %14llu %6.2f%%\n", name, (unsigned long long)calls[r],
+                (unsigned long long)self[r], 100.0 * self[r] / total_cycles,
+                (unsigned long long)total[r], 100.0 * total[r] / total_cycles);
+    }
+
+    /* 指令 */
+    count = 0;
+    for(i = 0; i < 0x10000; i++) {
+        if(p->cycles[i] == 0) { continue; }
+        entries[count].key = i;
+        entries[count].value = p->cycles[i];
+        count++;
+    }
+    qsort(entries, count, sizeof(struct cpu_profile_entry), cpu_profile_compare_value);
+    fprintf(fp, "\nInstructions (by cycles)\n");
+    fprintf(fp, "  %-6s %12s %14s %7s  %s\n", "PC", "count", "cycles", "%", "code");
+    for(i = 0; i < count && i < CPU_PROFILE_TOP_INSTRUCTIONS; i++) {
+        uint16_t pc = entries[i].key;
+        cpu_profile_disasm(m, pc, code, sizeof(code));
+        fprintf(fp, "  $%04X  %12llu %14llu %6.2f%%  %s\n", pc, (unsigned long long)p->count[pc],
+                (unsigned long long)p->cycles[pc], 100.0 * p->cycles[pc] / total_cycles, code);
+    }
+
+    /* 调用关系: 合并调用树中调用者与被调用者相同的边 */
+    count = 0;
+    for(n = 1; n < p->node_count; n++) {
+        entries[count].key = ((uint32_t)p->nodes[p->nodes[n].parent].routine << 16) | p->nodes[n].routine;
+        entries[count].value = p->nodes[n].calls;
+        count++;
+    }
+    qsort(entries, count, sizeof(struct cpu_profile_entry), cpu_profile_compare_key);
+    for(i = 0, n = 0; i < count; i++) {
+        if(n > 0 && entries[n - 1].key == entries[i].key) {
+            entries[n - 1].value += entries[i].value;
+        } else {
+            entries[n++] = entries[i];
+        }
+    }
+    qsort(entries, n, sizeof(struct cpu_profile_entry), cpu_profile_compare_value);
+    fprintf(fp, "\nCall graph (by calls)\n");
+    fprintf(fp, "  %-10s    %-10s %10s\n", "caller", "callee", "calls");
+    for(i = 0; i < n && i < CPU_PROFILE_TOP_EDGES; i++) {
+        cpu_profile_routine_name(m, entries[i].key >> 16, caller, sizeof(caller));
+        cpu_profile_routine_name(m, entries[i].key & 0xffff, name, sizeof(name));
+        fprintf(fp, "  %-10s -> %-10s %10llu\n", caller, name, (unsigned long long)entries[i].value);
+    }
+
+finish:
+    free(entries);
+    free(self);
+    free(total);
+    free(calls);
+    free(stamp);
+}
+
+/* 输出 folded stacks, 每行为 "reset;sub_C000;sub_C123 Cycle 数" */
+void cpu_profile_folded(struct nes_machine *m, FILE *fp) {
+    struct cpu_profile *p = m->cpu_profile;
+    int path[CPU_PROFILE_MAX_DEPTH + 1];
+    int n, a, depth;
+    char name[16];
+
+    for(n = 0; n < p->node_count; n++) {
+        if(p->nodes[n].cycles == 0) { continue; }
+        depth = 0;
+        for(a = n; a >= 0 && depth <= CPU_PROFILE_MAX_DEPTH; a = p->nodes[a].parent) {
+            path[depth++] = a;
+        }
+        while(depth-- > 0) {
+            cpu_profile_routine_name(m, p->nodes[path[depth]].routine, name, sizeof(name));
+            fprintf(fp, "%s%c", name, depth > 0 ? ';' : ' ');
+        }
+        fprintf(fp, "%llu\n", (unsigned long long)p->nodes[n].cycles);
+    }
+}
+
+/* 将报告与 folded stacks 分别写入 CPU_PROFILE_REPORT_FILE 与 CPU_PROFILE_FOLDED_FILE
+ * 输出:
+ *     0: 正常返回, -1: 文件无法写入
+ */
+int cpu_profile_save(struct nes_machine *m) {
+    FILE *fp;
+
+    fp = fopen(CPU_PROFILE_REPORT_FILE, "w");
+    if(fp == NULL) { return -1; }
+    cpu_profile_report(m, fp);
+    fclose(fp);
+
+    fp = fopen(CPU_PROFILE_FOLDED_FILE, "w");
+    if(fp == NULL) { return -1; }
+    cpu_profile_folded(m, fp);
+    fclose(fp);
+    return 0;
+}
+
+#endif /* BEMU_CPU_PROFILE */
@@ -0,0 +1,91 @@
+#ifndef BEMU_CPU_PROFILE_H
+#define BEMU_CPU_PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "machine.h"
+
+/* 6502 程序性能分析, 编译时定义 BEMU_CPU_PROFILE 后启用, 具体见 cpu_profile.c
+ * 未启用时, 下面的 CPU_PROFILE_* 宏为空, 不产生任何代码
+ */
+
+#define CPU_PROFILE_REPORT_FILE  "bemu_profile.txt"     // 文本报告
+#define CPU_PROFILE_FOLDED_FILE  "bemu_profile.folded"  // 供 flamegraph.pl 等工具使用的 folded stacks
+
+#define CPU_PROFILE_MAX_DEPTH 128   // 调用栈的最大深度
+#define CPU_PROFILE_MAX_NODES 8192  // 调用树的最大节点数
+
+/* 调用树中的节点, 每个节点对应一条从 Reset 开始的调用路径 */
+struct cpu_profile_node {
+    uint16_t routine;   // 子程序的入口地址
+    int parent;         // 父节点, -1 表示根节点
+    int first_child;    // 第一个子节点, -1 表示没有
+    int next_sibling;   // 下一个兄弟节点, -1 表示没有
+    uint64_t cycles;    // 在该路径上 (不含子程序) 执行的 Cycle 数
+    uint64_t calls;     // 进入该路径的次数
+};
+
+struct cpu_profile {
+    uint64_t cycles[0x10000];  // 以 PC 为索引, 该地址上的指令执行的 Cycle 数
+    uint64_t count[0x10000];   // 以 PC 为索引, 该地址上的指令执行的次数
+
+    struct cpu_profile_node nodes[CPU_PROFILE_MAX_NODES];
+    int node_count;
+
+    /* 调用栈, sp 为进入子程序时 (已压入返回地址) 的栈指针 */
+    struct { int node; uint8_t sp; } stack[CPU_PROFILE_MAX_DEPTH];
+    int depth;
+    int node;                  // 当前所在的节点
+
+    /* 上一条指令, 它使用的 Cycle 数在下一条指令开始时才能确定 */
+    uint16_t last_pc;
+    int last_node;
+    int last_cycles;
+};
+
+void cpu_profile_init(struct nes_machine *m);
+void cpu_profile_exit(struct nes_machine *m);
+void cpu_profile_call(struct nes_machine *m);
+void cpu_profile_return(struct nes_machine *m);
+void cpu_profile_report(struct nes_machine *m, FILE *fp);
+void cpu_profile_folded(struct nes_machine *m, FILE *fp);
+int cpu_profile_save(struct nes_machine *m);
+
+/* cpu_run 开始时调用, cycles 为剩余的 Cycle 数 */
+static inline void cpu_profile_begin(struct nes_machine *m, int cycles) {
+    m->cpu_profile->last_cycles = cycles;
+}
+
+/* 结算上一条指令使用的 Cycle 数 */
+static inline void cpu_profile_end(struct nes_machine *m, int cycles) {
+    struct cpu_profile *p = m->cpu_profile;
+    int used = p->last_cycles - cycles;
+    p->cycles[p->last_pc] += used;
+    p->nodes[p->last_node].cycles += used;
+    p->last_cycles = cycles;
+}
+
+/* 开始执行 pc 处的指令 */
+static inline void cpu_profile_instruction(struct nes_machine *m, uint16_t pc, int cycles) {
+    struct cpu_profile *p = m->cpu_profile;
+    cpu_profile_end(m, cycles);
+    p->count[pc]++;
+    p->last_pc = pc;
+    p->last_node = p->node;
+}
+
+#ifdef BEMU_CPU_PROFILE
+#define CPU_PROFILE_BEGIN(m, cycles)           cpu_profile_begin(m, cycles)
+#define CPU_PROFILE_END(m, cycles)             cpu_profile_end(m, cycles)
+#define CPU_PROFILE_INSTRUCTION(m, pc, cycles) cpu_profile_instruction(m, pc, cycles)
+#define CPU_PROFILE_CALL(m)                    cpu_profile_call(m)
+#define CPU_PROFILE_RETURN(m)                  cpu_profile_return(m)
+#else
+#define CPU_PROFILE_BEGIN(m, cycles)           ((void)0)
+#define CPU_PROFILE_END(m, cycles)             ((void)0)
+#define CPU_PROFILE_INSTRUCTION(m, pc, cycles) ((void)0)
+#define CPU_PROFILE_CALL(m)                    ((void)0)
+#define CPU_PROFILE_RETURN(m)                  ((void)0)
+#endif
+
+#endif //BEMU_CPU_PROFILE_H
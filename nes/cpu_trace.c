@@ -0,0 +1,280 @@
+/* 6502 指令跟踪
+ *
+ * 编译时定义 BEMU_CPU_TRACE 后, cpu_run 在每条指令开始执行时将 PC, 操作码, A/X/Y/P/SP,
+ * CPU Cycle 与 PPU 扫描线写入一个固定大小的环形缓冲区 (struct cpu_trace), 只保留最近的记录.
+ * 空转循环检测跳过的循环不会出现在记录中, 表现为 Cycle 的跳变.
+ *
+ * 环形缓冲区在以下情况下保存到 CPU_TRACE_DUMP_FILE:
+ *   - 执行到环境变量 BEMU_TRACE_TRIGGER (十六进制地址) 指定的地址 (仅第一次)
+ *   - 调用 cpu_trace_dump, 例如在 main.c 中收到 SIGINFO 时
+ *   - 程序崩溃时在信号处理函数中调用 cpu_trace_crash_dump, 只使用 write 等 async-signal-safe 的函数,
+ *     写入 cpu_trace_init 时预先打开的文件
+ *
+ * 设置环境变量 BEMU_TRACE_FILE 后, 全部记录由后台线程压缩并写入该文件:
+ * cpu_run 每写入 CPU_TRACE_CHUNK 条记录, 通过 cpu_trace_publish 交给后台线程,
+ * 后台线程来不及处理时 cpu_run 等待, 因此不会丢失记录.
+ *
+ * 文件格式: 开头为 CPU_TRACE_MAGIC, 之后为压缩后的记录 (见 cpu_trace_encode),
+ * 可以使用 tools/tracedump.c 转换为文本.
+ */
+
+#include "cpu_trace.h"
+
+/* 压缩后的记录以一个字节的标志开始, 之后依次为:
+ *   PC:       标志 0x01 为 1 时为 2 字节的地址, 否则为 1 字节的有符号差值
+ *   操作码:   标志 0x02 为 1 时存在
+ *   A/X/Y/P/SP: 标志 0x04/0x08/0x10/0x20/0x40 为 1 时存在, 每个 1 字节
+ *   扫描线:   标志 0x80 为 1 时存在, 2 字节
+ *   Cycle:    与上一条记录的差值, 无符号 LEB128
+ * 不存在的字段与上一条记录相同. 多字节的值均为小端序.
+ */
+#define TRACE_PC_ABSOLUTE 0x01
+#define TRACE_OPCODE      0x02
+#define TRACE_A           0x04
+#define TRACE_X           0x08
+#define TRACE_Y           0x10
+#define TRACE_P           0x20
+#define TRACE_SP          0x40
+#define TRACE_SCANLINE    0x80
+
+/* 压缩一条记录, 写入 out (至少 CPU_TRACE_RECORD_MAX 字节), 返回写入的字节数 */
+int cpu_trace_encode(struct cpu_trace_record *prev, const struct cpu_trace_record *record, uint8_t *out) {
+    uint8_t flags = 0;
+    int16_t delta = (int16_t)(record->pc - prev->pc);
+    uint64_t cycles = record->cycle - prev->cycle;
+    int n = 1;
+
+    if(delta < -128 || delta > 127) {
+        flags |= TRACE_PC_ABSOLUTE;
+        out[n++] = record->pc & 0xff;
+        out[n++] = record->pc >> 8;
+    } else {
+        out[n++] = (uint8_t)delta;
+    }
+    if(record->opcode != prev->opcode) { flags |= TRACE_OPCODE; out[n++] = record->opcode; }
+    if(record->a != prev->a)           { flags |= TRACE_A;      out[n++] = record->a; }
+    if(record->x != prev->x)           { flags |= TRACE_X;      out[n++] = record->x; }
+    if(record->y != prev->y)           { flags |= TRACE_Y;      out[n++] = record->y; }
+    if(record->p != prev->p)           { flags |= TRACE_P;      out[n++] = record->p; }
+    if(record->sp != prev->sp)         { flags |= TRACE_SP;     out[n++] = record->sp; }
+    if(record->scanline != prev->scanline) {
+        flags |= TRACE_SCANLINE;
+        out[n++] = record->scanline & 0xff;
+        out[n++] = record->scanline >> 8;
+    }
+    do {
+        out[n++] = (cycles & 0x7f) | (cycles >= 0x80 ? 0x80 : 0);
+        cycles >>= 7;
+    } while(cycles);
+
+    out[0] = flags;
+    *prev = *record;
+    return n;
+}
+
+/* 从文件中读取并解压一条记录, 返回 1 表示成功, 0 表示文件结束 */
+int cpu_trace_read(FILE *fp, struct cpu_trace_record *prev, struct cpu_trace_record *record) {
+    int flags = fgetc(fp), c, shift = 0;
+    uint64_t cycles = 0;
+    if(flags == EOF) { return 0; }
+
+    *record = *prev;
+    if(flags & TRACE_PC_ABSOLUTE) {
+        record->pc = fgetc(fp);
+        record->pc |= fgetc(fp) << 8;
+    } else {
+        record->pc += (int8_t)fgetc(fp);
+    }
+    if(flags & TRACE_OPCODE) { record->opcode = fgetc(fp); }
+    if(flags & TRACE_A)      { record->a = fgetc(fp); }
+    if(flags & TRACE_X)      { record->x = fgetc(fp); }
+    if(flags & TRACE_Y)      { record->y = fgetc(fp); }
+    if(flags & TRACE_P)      { record->p = fgetc(fp); }
+    if(flags & TRACE_SP)     { record->sp = fgetc(fp); }
+    if(flags & TRACE_SCANLINE) {
+        record->scanline = fgetc(fp);
+        record->scanline |= fgetc(fp) << 8;
+    }
+    do {
+        c = fgetc(fp);
+        if(c == EOF) { return 0; }
+        cycles |= (uint64_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while(c & 0x80);
+    record->cycle += cycles;
+
+    *prev = *record;
+    return 1;
+}
+
+#ifdef BEMU_CPU_TRACE
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* 写入 n 字节, fp 为 NULL 时使用 write 写入 fd (可以在信号处理函数中使用) */
+static void cpu_trace_output(FILE *fp, int fd, const uint8_t *buf, int n) {
+    if(fp != NULL) {
+        fwrite(buf, 1, n, fp);
+        return;
+    }
+    while(n > 0) {
+        ssize_t written = write(fd, buf, n);
+        if(written <= 0) { return; }
+        buf += written;
+        n -= (int)written;
+    }
+}
+
+/* 压缩 ring 中 [first, last) 范围内的记录并写入 fp (fp 为 NULL 时写入 fd) */
+static void cpu_trace_write(FILE *fp, int fd, struct cpu_trace_record *ring, uint64_t first, uint64_t last,
+                            struct cpu_trace_record *prev) {
+    uint8_t buf[16384];
+    int n = 0;
+    for(; first < last; first++) {
+        n += cpu_trace_encode(prev, &ring[first & (CPU_TRACE_RING_SIZE - 1)], buf + n);
+        if(n > (int)sizeof(buf) - CPU_TRACE_RECORD_MAX) {
+            cpu_trace_output(fp, fd, buf, n);
+            n = 0;
+        }
+    }
+    cpu_trace_output(fp, fd, buf, n);
+}
+
+/* 后台线程: 压缩已经交给它的记录并写入文件 */
+static void *cpu_trace_thread(void *arg) {
+    struct cpu_trace *t = arg;
+    struct cpu_trace_record prev;
+    uint64_t first, last;
+    memset(&prev, 0, sizeof(prev));
+
+    pthread_mutex_lock(&t->lock);
+    for(;;) {
+        while(t->published == t->tail && !t->stop) { pthread_cond_wait(&t->cond, &t->lock); }
+        if(t->published == t->tail) { break; }
+        first = t->tail;
+        last = t->published;
+        pthread_mutex_unlock(&t->lock);
+
+        cpu_trace_write(t->stream, -1, t->ring, first, last, &prev);
+
+        pthread_mutex_lock(&t->lock);
+        t->tail = last;
+        pthread_cond_broadcast(&t->cond);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+/* 初始化, 清空之前的记录, 并根据环境变量设置触发地址与输出文件 */
+void cpu_trace_init(struct nes_machine *m) {
+    struct cpu_trace *t;
+    const char *trigger = getenv("BEMU_TRACE_TRIGGER");
+    const char *path = getenv("BEMU_TRACE_FILE");
+
+    cpu_trace_exit(m);
+    t = calloc(1, sizeof(struct cpu_trace));
+    if(t == NULL) {
+        fprintf(stderr, "Trace: Out of memory\n");
+        exit(-1);
+    }
+    m->cpu_trace = t;
+    t->crash_fd = open(CPU_TRACE_DUMP_FILE, O_WRONLY | O_CREAT, 0644);  // 不清空之前保存的记录
+
+    if(trigger != NULL) {
+        t->trigger = strtol(trigger, NULL, 16);
+        t->trigger_enabled = 1;
+    }
+    if(path != NULL) {
+        t->stream = fopen(path, "wb");
+        if(t->stream == NULL) {
+            fprintf(stderr, "Trace: Unable to open %s\n", path);
+            return;
+        }
+        fwrite(CPU_TRACE_MAGIC, 1, 8, t->stream);
+        pthread_mutex_init(&t->lock, NULL);
+        pthread_cond_init(&t->cond, NULL);
+        if(pthread_create(&t->thread, NULL, cpu_trace_thread, t) != 0) {
+            fprintf(stderr, "Trace: Unable to create thread\n");
+            fclose(t->stream);
+            t->stream = NULL;
+        }
+    }
+}
+
+/* 写入剩余的记录, 结束后台线程, 释放内存 */
+void cpu_trace_exit(struct nes_machine *m) {
+    struct cpu_trace *t = m->cpu_trace;
+    if(t == NULL) { return; }
+    if(t->stream) {
+        pthread_mutex_lock(&t->lock);
+        t->published = t->head;
+        t->stop = 1;
+        pthread_cond_broadcast(&t->cond);
+        pthread_mutex_unlock(&t->lock);
+        pthread_join(t->thread, NULL);
+        pthread_mutex_destroy(&t->lock);
+        pthread_cond_destroy(&t->cond);
+        fclose(t->stream);
+    }
+    if(t->crash_fd >= 0) { close(t->crash_fd); }
+    free(t);
+    m->cpu_trace = NULL;
+}
+
+/* 将最近 CPU_TRACE_CHUNK 条记录交给后台线程, 并等待环形缓冲区中有足够的空间写入下一组记录 */
+void cpu_trace_publish(struct nes_machine *m) {
+    struct cpu_trace *t = m->cpu_trace;
+    pthread_mutex_lock(&t->lock);
+    t->published = t->head;
+    pthread_cond_broadcast(&t->cond);
+    while(t->head + CPU_TRACE_CHUNK - t->tail > CPU_TRACE_RING_SIZE) { pthread_cond_wait(&t->cond, &t->lock); }
+    pthread_mutex_unlock(&t->lock);
+}
+
+/* 执行到触发地址 */
+void cpu_trace_triggered(struct nes_machine *m) {
+    m->cpu_trace->trigger_enabled = 0;
+    if(cpu_trace_dump(m, CPU_TRACE_DUMP_FILE) == 0) {
+        fprintf(stderr, "Trace: $%04X reached, saved to %s\n", m->cpu_trace->trigger, CPU_TRACE_DUMP_FILE);
+    }
+}
+
+/* 将环形缓冲区中的记录保存到 path
+ * 输出:
+ *     0: 正常返回, -1: 文件无法写入
+ */
+int cpu_trace_dump(struct nes_machine *m, const char *path) {
+    struct cpu_trace *t = m->cpu_trace;
+    struct cpu_trace_record prev;
+    uint64_t first = t->head > CPU_TRACE_RING_SIZE ? t->head - CPU_TRACE_RING_SIZE : 0;
+    FILE *fp = fopen(path, "wb");
+    if(fp == NULL) { return -1; }
+    memset(&prev, 0, sizeof(prev));
+    fwrite(CPU_TRACE_MAGIC, 1, 8, fp);
+    cpu_trace_write(fp, -1, t->ring, first, t->head, &prev);
+    fclose(fp);
+    return 0;
+}
+
+/* 与 cpu_trace_dump 相同, 但写入预先打开的 CPU_TRACE_DUMP_FILE, 只调用 async-signal-safe 的函数,
+ * 用于 SIGSEGV 等信号的处理函数 (此时 malloc 与 stdio 的状态可能已经损坏)
+ * 输出:
+ *     0: 正常返回, -1: 文件没有打开
+ */
+int cpu_trace_crash_dump(struct nes_machine *m) {
+    struct cpu_trace *t = m->cpu_trace;
+    struct cpu_trace_record prev;
+    uint64_t first;
+    if(t == NULL || t->crash_fd < 0) { return -1; }
+    first = t->head > CPU_TRACE_RING_SIZE ? t->head - CPU_TRACE_RING_SIZE : 0;
+    if(lseek(t->crash_fd, 0, SEEK_SET) != 0 || ftruncate(t->crash_fd, 0) != 0) { return -1; }
+    memset(&prev, 0, sizeof(prev));
+    cpu_trace_output(NULL, t->crash_fd, (const uint8_t *)CPU_TRACE_MAGIC, 8);
+    cpu_trace_write(NULL, t->crash_fd, t->ring, first, t->head, &prev);
+    return 0;
+}
+
+#endif /* BEMU_CPU_TRACE */
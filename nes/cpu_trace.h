@@ -0,0 +1,84 @@
+#ifndef BEMU_CPU_TRACE_H
+#define BEMU_CPU_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "machine.h"
+
+/* 6502 指令跟踪, 编译时定义 BEMU_CPU_TRACE 后启用, 具体见 cpu_trace.c
+ * 未启用时, CPU_TRACE_INSTRUCTION 宏为空, 不产生任何代码
+ */
+
+#define CPU_TRACE_MAGIC      "BEMUTRC1"        // 跟踪文件开头的 8 字节
+#define CPU_TRACE_DUMP_FILE  "bemu_trace.bin"  // 环形缓冲区的保存位置
+#define CPU_TRACE_RING_SIZE  (1 << 16)         // 环形缓冲区中的记录数, 必须为 2 的幂
+#define CPU_TRACE_CHUNK      (1 << 12)         // 输出到文件时, 每次交给后台线程的记录数
+#define CPU_TRACE_RECORD_MAX 21                // 压缩后每条记录的最大长度
+
+/* 每条指令开始执行时的状态 */
+struct cpu_trace_record {
+    uint64_t cycle;     // CPU Cycle
+    uint16_t pc;
+    uint16_t scanline;  // PPU 扫描线
+    uint8_t opcode;
+    uint8_t a, x, y, p, sp;
+};
+
+/* 压缩与解压, 每条记录只保存与上一条记录 (prev) 不同的部分, prev 初始为全 0 */
+int cpu_trace_encode(struct cpu_trace_record *prev, const struct cpu_trace_record *record, uint8_t *out);
+int cpu_trace_read(FILE *fp, struct cpu_trace_record *prev, struct cpu_trace_record *record);
+
+#ifdef BEMU_CPU_TRACE
+
+#include <pthread.h>
+#include "cpu_internal.h"
+
+struct cpu_trace {
+    struct cpu_trace_record ring[CPU_TRACE_RING_SIZE];
+    uint64_t head;             // 已经写入的记录数
+    uint16_t trigger;          // 执行到该地址时保存环形缓冲区
+    int trigger_enabled;
+    int crash_fd;              // 预先打开的 CPU_TRACE_DUMP_FILE, 供 cpu_trace_crash_dump 在信号处理函数中使用
+
+    /* 输出到文件, 由后台线程压缩并写入 */
+    FILE *stream;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint64_t published;        // 已经交给后台线程的记录数
+    uint64_t tail;             // 后台线程已经写入文件的记录数
+    int stop;
+};
+
+void cpu_trace_init(struct nes_machine *m);
+void cpu_trace_exit(struct nes_machine *m);
+int cpu_trace_dump(struct nes_machine *m, const char *path);
+int cpu_trace_crash_dump(struct nes_machine *m);
+void cpu_trace_publish(struct nes_machine *m);
+void cpu_trace_triggered(struct nes_machine *m);
+
+/* 记录即将执行的 pc 处的指令 */
+static inline void cpu_trace_instruction(struct nes_machine *m, uint16_t pc, uint64_t cycle) {
+    struct cpu_trace *t = m->cpu_trace;
+    struct cpu_trace_record *r = &t->ring[t->head & (CPU_TRACE_RING_SIZE - 1)];
+    const struct memory_page *page = &m->memory_page_table[pc >> 8];
+    r->cycle = cycle;
+    r->pc = pc;
+    r->scanline = m->ppu.scanline;
+    r->opcode = page->read ? page->read[pc & 0xff] : 0;  // 不读取 PPU 等寄存器, 避免产生副作用
+    r->a = m->cpu.a;
+    r->x = m->cpu.x;
+    r->y = m->cpu.y;
+    r->p = cpu_get_p(m);
+    r->sp = m->cpu.sp;
+    t->head++;
+    if(t->trigger_enabled && pc == t->trigger) { cpu_trace_triggered(m); }
+    if(t->stream && (t->head & (CPU_TRACE_CHUNK - 1)) == 0) { cpu_trace_publish(m); }
+}
+
+#define CPU_TRACE_INSTRUCTION(m, pc, cycle) cpu_trace_instruction(m, pc, cycle)
+#else
+#define CPU_TRACE_INSTRUCTION(m, pc, cycle) ((void)0)
+#endif
+
+#endif //BEMU_CPU_TRACE_H
@@ -5,19 +5,19 @@
 #include <stdio.h>
 
 /* 根据不同的寻址方式输出不同的内容, 同时设置 pc 的变化量 */
-#define ACCUMULATOR(name)  printf("%s\t A\n", name);                                  pc_delta = 1;
-#define ABSOLUTE(name)     printf("%s\t $%02x%02x\n", name, opcode[2], opcode[1]);    pc_delta = 3;
-#define ABSOLUTE_X(name)   printf("%s\t $%02x%02x, X\n", name, opcode[2], opcode[1]); pc_delta = 3;
-#define ABSOLUTE_Y(name)   printf("%s\t $%02x%02x, Y\n", name, opcode[2], opcode[1]); pc_delta = 3;
-#define IMPLIED(name)      printf("%s\n", name);                                      pc_delta = 1;
-#define IMMEDIATE(name)    printf("%s\t #$%02x\n", name, opcode[1]);                  pc_delta = 2;
-#define INDIRECT(name)     printf("%s\t ($%02x%02x)\n", name, opcode[2], opcode[1]);  pc_delta = 3;
-#define INDIRECT_X(name)   printf("%s\t ($%02x, X)\n", name, opcode[1]);              pc_delta = 2;
-#define INDIRECT_Y(name)   printf("%s\t ($%02x), Y\n", name, opcode[1]);              pc_delta = 2;
-#define RELATIVE(name)     printf("%s\t $%02x\n", name, opcode[1]);                   pc_delta = 2;
-#define ZERO_PAGE(name)    printf("%s\t $%02x\n", name, opcode[1]);                   pc_delta = 2;
-#define ZERO_PAGE_X(name)  printf("%s\t $%02x, X\n", name, opcode[1]);                pc_delta = 2;
-#define ZERO_PAGE_Y(name)  printf("%s\t $%02x, Y\n", name, opcode[1]);                pc_delta = 2;
+#define ACCUMULATOR(name)  snprintf(buf, size, "%s\t A", name);                                  pc_delta = 1;
+#define ABSOLUTE(name)     snprintf(buf, size, "%s\t $%02x%02x", name, opcode[2], opcode[1]);    pc_delta = 3;
+#define ABSOLUTE_X(name)   snprintf(buf, size, "%s\t $%02x%02x, X", name, opcode[2], opcode[1]); pc_delta = 3;
+#define ABSOLUTE_Y(name)   snprintf(buf, size, "%s\t $%02x%02x, Y", name, opcode[2], opcode[1]); pc_delta = 3;
+#define IMPLIED(name)      snprintf(buf, size, "%s", name);                                      pc_delta = 1;
+#define IMMEDIATE(name)    snprintf(buf, size, "%s\t #$%02x", name, opcode[1]);                  pc_delta = 2;
+#define INDIRECT(name)     snprintf(buf, size, "%s\t ($%02x%02x)", name, opcode[2], opcode[1]);  pc_delta = 3;
+#define INDIRECT_X(name)   snprintf(buf, size, "%s\t ($%02x, X)", name, opcode[1]);              pc_delta = 2;
+#define INDIRECT_Y(name)   snprintf(buf, size, "%s\t ($%02x), Y", name, opcode[1]);              pc_delta = 2;
+#define RELATIVE(name)     snprintf(buf, size, "%s\t $%02x", name, opcode[1]);                   pc_delta = 2;
+#define ZERO_PAGE(name)    snprintf(buf, size, "%s\t $%02x", name, opcode[1]);                   pc_delta = 2;
+#define ZERO_PAGE_X(name)  snprintf(buf, size, "%s\t $%02x, X", name, opcode[1]);                pc_delta = 2;
+#define ZERO_PAGE_Y(name)  snprintf(buf, size, "%s\t $%02x, Y", name, opcode[1]);                pc_delta = 2;
 
 
 /* 反汇编, 并通过 printf() 打印
@@ -47,7 +47,21 @@ int disasm(uint8_t *prg_rom, int length) {
  *     指令的长度, -1 代表出错
  */
 int disasm_once(uint8_t *prg_rom, int pc) {
-    uint8_t *opcode = &prg_rom[pc];
+    char buf[32];
+    int pc_delta = disasm_format(&prg_rom[pc], buf, sizeof(buf));
+    printf("%s\n", buf);
+    return pc_delta;
+}
+
+/* 对单条指令进行反汇编, 结果写入 buf (不含换行)
+ * 输入:
+ *     opcode: 指向指令首字节的指针, 之后至少还有 2 字节可以读取
+ *     buf:    存放结果的缓冲区
+ *     size:   缓冲区的大小
+ * 输出:
+ *     指令的长度
+ */
+int disasm_format(const uint8_t *opcode, char *buf, size_t size) {
     int pc_delta = 1;
 
     switch(*opcode) {
@@ -307,7 +321,7 @@ int disasm_once(uint8_t *prg_rom, int pc) {
         case 0xFD: ABSOLUTE_X("SBC"); break;
         case 0xFE: ABSOLUTE_X("INC"); break;
         case 0xFF: ABSOLUTE_X("ISC"); break;
-        default: printf("op		$%02x", *opcode);
+        default: snprintf(buf, size, "op\t\t$%02x", *opcode);
     }
 
     return pc_delta;
@@ -1,11 +1,13 @@
 #ifndef BEMU_DISASSEMBLER_H
 #define BEMU_DISASSEMBLER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define DISASSEBLER_ERROR (-1)
 
 int disasm(uint8_t *prg_rom, int length);
 int disasm_once(uint8_t *prg_rom, int pc);
+int disasm_format(const uint8_t *opcode, char *buf, size_t size);
 
 #endif //BEMU_DISASSEMBLER_H
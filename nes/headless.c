@@ -0,0 +1,30 @@
+/* 无窗口的前端: 不依赖任何图形库, 不等待, 以最快速度运行
+ *
+ * 画面通过 ppu_set_rgb_output 绘制到 h->render, 每帧结束时 (frame_ready) 复制到 h->frame,
+ * 因此 nes_run 在任意扫描线返回时, h->frame 都是最后一帧完整的画面 (m->ppu_framebuffer 可能已经是下一帧的一部分).
+ * nes_run(m, n) 恰好产生 n 次 frame_ready. 用于没有显示器的测试与批量运行.
+ */
+
+#include "headless.h"
+#include "nes.h"
+#include <string.h>
+
+static void headless_frame_ready(void *user, struct nes_machine *m) {
+    struct headless *h = (struct headless *)user;
+    memcpy(h->frame, h->render, sizeof(h->frame));
+    h->frames++;
+    if(h->on_frame != NULL) { h->on_frame(h, m); }
+}
+
+static int headless_input(void *user, int button) {
+    struct headless *h = (struct headless *)user;
+    return (h->buttons >> button) & 1;
+}
+
+/* 将 h 设置为 m 的前端, 在 nes_init 之前或之后调用均可 */
+void headless_attach(struct nes_machine *m, struct headless *h, enum ppu_pixel_format format) {
+    struct nes_frontend frontend = { h, headless_frame_ready, headless_input, NULL, NULL };
+    h->frames = 0;
+    ppu_set_rgb_output(m, h->render, format);
+    nes_set_frontend(m, &frontend);
+}
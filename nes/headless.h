@@ -0,0 +1,19 @@
+#ifndef BEMU_HEADLESS_H
+#define BEMU_HEADLESS_H
+
+#include <stdint.h>
+#include "machine.h"
+#include "ppu_palette.h"
+
+/* 无窗口的前端, 画面与按键状态都在这个结构中 */
+struct headless {
+    uint32_t frame[240 * 256];  // 最近完成的一帧的画面, 格式由 headless_attach 指定 (RGB565 时只使用前一半)
+    uint32_t render[240 * 256]; // 正在绘制的画面, 每帧结束时复制到 frame
+    uint64_t frames;            // 已经完成的帧数
+    uint16_t buttons;           // 第 n 位为按键 n 的状态 (见 struct nes_frontend 的 input), 由调用者设置
+    void (*on_frame)(struct headless *h, struct nes_machine *m);  // 每帧结束时调用, 可以为 NULL
+};
+
+void headless_attach(struct nes_machine *m, struct headless *h, enum ppu_pixel_format format);
+
+#endif //BEMU_HEADLESS_H
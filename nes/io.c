@@ -2,27 +2,28 @@
  */
 
 #include "io.h"
-#include "emulator.h"
 
-static uint8_t prev_write;
-static int p = 10;
+void io_init(struct nes_machine *m) {
+    m->io.prev_write = 0;
+    m->io.p = 10;
+}
 
-uint8_t io_read(uint16_t address) {
+uint8_t io_read(struct nes_machine *m, uint16_t address) {
     // Joystick 1
     if (address == 0x4016) {
-        if (p++ < 9) {
-            return get_key_state(p);
+        if (m->io.p++ < 9 && m->frontend.input != NULL) {
+            return m->frontend.input(m->frontend.user, m->io.p);
         }
     }
     return 0;
 }
 
-void io_write(uint16_t address, uint8_t data) {
+void io_write(struct nes_machine *m, uint16_t address, uint8_t data) {
     if (address == 0x4016) {
-        if ((data & 1) == 0 && prev_write == 1) {
+        if ((data & 1) == 0 && m->io.prev_write == 1) {
             // strobe
-            p = 0;
+            m->io.p = 0;
         }
     }
-    prev_write = data & 1;
-}
\ No newline at end of file
+    m->io.prev_write = data & 1;
+}
@@ -2,8 +2,10 @@
 #define BEMU_IO_H
 
 #include <stdint.h>
+#include "machine.h"
 
-uint8_t io_read(uint16_t address);
-void io_write(uint16_t address, uint8_t data);
+void io_init(struct nes_machine *m);
+uint8_t io_read(struct nes_machine *m, uint16_t address);
+void io_write(struct nes_machine *m, uint16_t address, uint8_t data);
 
 #endif //BEMU_IO_H
@@ -0,0 +1,315 @@
+/* 模拟器的全部状态
+ *
+ * 一台 NES 的全部状态 (CPU, 内存, PPU, IO, 卡带等) 都保存在 struct nes_machine 中,
+ * cpu_*, ppu_*, memory_*, io_*, scheduler_* 等函数的第一个参数均为指向它的指针 m.
+ * 不同的 nes_machine 之间互不影响, 同一进程中可以同时运行多台 NES (每台在一个线程中).
+ *
+ * 各模块只在这里定义自己的状态, 具体的含义与用法见各模块的源文件.
+ */
+
+#ifndef BEMU_MACHINE_H
+#define BEMU_MACHINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/******** CPU (cpu.c) ********/
+
+/* CPU 寄存器
+ * 各个寄存器的名称已经在程序中给出
+ * 状态寄存器 p 中各个位的作用:
+ *    7  bit  0
+ *    ---- ----
+ *    NVsB DIZC
+ *    |||| ||||
+ *    |||| |||+- Carry: 进位标志. 加法有进位或减法**无**借位时置 1
+ *    |||| ||+-- Zero: 零标志. 运算结果为 0 时, 该位置 1
+ *    |||| |+--- Interrupt: 中断屏蔽标志. 为 0 的时候允许 IRQ 和 NMI, 为 1 的时候只允许 NMI
+ *    |||| +---- Decimal:  十进制标志置 1 后, ADC 和 SBC 指令使用十进制表示 (在 NES 中未被使用)
+ *    ||++------ B: 用于表示软件中断的状态等, 具体参考此处. http://wiki.nesdev.com/w/index.php/CPU_status_flag_behavior
+ *    |+-------- Overflow: 溢出标志. 有溢出时为 1, 无溢出时为 0
+ *    +--------- Negative: 负数标志. 无溢出时 1 表示结果为负, 有溢出是 1 表示结果为正
+ *
+ * N, Z, C, V 四个标志几乎每条指令都会修改, 因此不保存在 p 中, 而是分别保存在 n, z, c, v 中,
+ * 只在需要完整的状态寄存器时 (PHP, BRK, 中断, 调试信息等) 由 cpu_get_p 合成:
+ *   n: 最近一次影响 N 的结果, N 为其第 7 位
+ *   z: 最近一次影响 Z 的结果, 为 0 时 Z 为 1
+ *   c, v: C 与 V, 取值为 0 或 1
+ * p 中只有 I, D, B 与第 5 位有效.
+ */
+struct _cpu {
+    uint8_t  a;    // 累加寄存器 Accumulator
+    uint8_t  x;    // 变址寄存器 Index Register X
+    uint8_t  y;    // 变址寄存器 Index Register Y
+    uint8_t  sp;   // 堆栈指针   Stack Pointer
+    uint8_t  p;    // 状态寄存器 Status Register (I, D, B 与第 5 位)
+    uint16_t pc;   // 程序计数器 Program Counter
+    uint8_t  n;    // Negative
+    uint8_t  z;    // Zero
+    uint8_t  c;    // Carry
+    uint8_t  v;    // Overflow
+};
+
+/* 指令缓存中的一项 */
+struct cpu_decoded_instruction {
+    const void *handler;  // 指令对应的 handler, NULL 表示该项无效
+    uint16_t operand;     // 操作数
+    uint8_t cycles;       // 基本 Cycle 数
+    uint8_t length;       // 指令长度 (含操作码)
+};
+
+#define CPU_ICACHE_SIZE 0xa800  // 内部 RAM, Save RAM 与 PRG ROM 的大小之和
+
+struct cpu_jit;      // 见 cpu_jit.c
+struct cpu_profile;  // 见 cpu_profile.h
+struct cpu_trace;    // 见 cpu_trace.h
+
+/******** 内存 (memory.c) ********/
+
+struct nes_machine;
+
+/* 内存页表中的一项 */
+struct memory_page {
+    uint8_t *read;   // 该页对应的内存, NULL 表示通过 read_handler 读取
+    uint8_t *write;  // 同上, NULL 表示通过 write_handler 写入
+    uint8_t (*read_handler)(struct nes_machine *m, uint16_t address);
+    void (*write_handler)(struct nes_machine *m, uint16_t address, uint8_t data);
+};
+
+/******** PPU (ppu.c) ********/
+
+struct _ppu {
+    /* PPU 寄存器 */
+    uint8_t ppuctrl;     // 2000: PPU 控制寄存器，WRITE
+    uint8_t ppumask;     // 2001: PPU MASK 寄存器，WRITE
+    uint8_t ppustatus;   // 2002: PPU 状态寄存器，READ
+    uint8_t oamaddr;     // 2003: PPU OAM 地址，WRITE
+    uint8_t oamdata;     // 2004: PPU OAM 数据，READ/WRITE
+    uint16_t ppuscroll;  // 2005: PPU 滚动位置寄存器，WRITE x2
+    uint8_t ppuscroll_x, ppuscroll_y;  // 将 PPUSCROLL 寄存器分为 X 和 Y 两个方向
+    uint16_t ppuaddr;    // 2006: PPU 地址寄存器，WRITE x2
+    uint16_t ppudata;     // 2007: PPU 数据寄存器，READ/WRITE
+    uint8_t oamdma;      // 4104: OAM DMA 寄存器（高字节），WRITE
+
+    bool scroll_received_x;
+    bool addr_received_high_byte;
+    bool ready;
+
+    int mirroring;  // Nametable 镜像方式, 见 ppu_set_mirroring
+
+    int x, scanline;
+
+    /* 垂直滚动在一帧开始时 (扫描线 0 绘制前) 装入, 帧中写入 PPUSCROLL 的 Y 坐标在下一帧生效 */
+    uint8_t frame_scroll_y;
+    bool frame_nametable_y;  // PPUCTRL 第 1 位, 是否从下方的 Nametable 开始
+
+    /* 延迟绘制 (ppu_catch_up): 当前扫描线开始的时间 (主时钟), 以及画面已经绘制到的位置 */
+    uint64_t scanline_time;
+    int render_line, render_x;
+
+    bool sprite_hit_occured;
+    uint64_t sprite_hit_time;  // 预计发生 Sprite 0 hit 的时间 (主时钟), 在此之前修改状态时重新检查
+    uint8_t latch;
+    bool first_read_2007;
+    uint8_t addr_latch;
+};
+
+/******** IO (io.c) ********/
+
+struct _io {
+    uint8_t prev_write;
+    int p;
+};
+
+/******** 前端 (nes.c) ********/
+
+/* 显示, 输入, 声音与计时由前端通过回调提供, 核心不依赖任何平台的库.
+ * 回调的第一个参数均为 user, 为 NULL 的回调不调用. Allegro 的实现见 emulator.c, 无窗口的实现见 nes/headless.c
+ */
+struct nes_frontend {
+    void *user;
+    void (*frame_ready)(void *user, struct nes_machine *m);       // 一帧结束时 (第 262 条扫描线) 调用, 画面已经全部绘制完成
+    int (*input)(void *user, int button);                          // 手柄 1 的按键 button 是否按下 (1: A, 2: B, 3: SELECT, 4: START, 5 ~ 8: 上下左右)
+    void (*audio)(void *user, const int16_t *samples, int count);  // 声音输出, 目前没有实现 APU, 不会调用
+    void (*wait_frame)(void *user);                                // nes_run 在每帧之前调用, 等待到该帧开始的时刻, 为 NULL 时以最快速度运行
+};
+
+/******** 事件调度 (scheduler.c) ********/
+
+/* 事件类型, 每种事件同一时间最多只有一个等待处理 */
+enum scheduler_event {
+    SCHEDULER_EVENT_SCANLINE,      // PPU 扫描线
+    SCHEDULER_EVENT_NMI,           // 进入 VBlank 后产生的 NMI
+    SCHEDULER_EVENT_SPRITE_0_HIT,  // Sprite 0 hit
+    SCHEDULER_EVENT_MAPPER_IRQ,    // Mapper 产生的 IRQ
+    SCHEDULER_EVENT_APU_IRQ,       // APU 产生的 IRQ
+    SCHEDULER_EVENT_COUNT
+};
+
+struct scheduler_entry {
+    uint64_t time;
+    enum scheduler_event event;
+};
+
+struct _scheduler {
+    struct scheduler_entry heap[SCHEDULER_EVENT_COUNT];
+    int heap_size;
+    int heap_position[SCHEDULER_EVENT_COUNT];  // 事件在堆中的位置, -1 表示没有等待处理
+    void (*handler[SCHEDULER_EVENT_COUNT])(struct nes_machine *m);
+    uint64_t event_time;                       // 正在处理的事件的时间
+    int in_event;
+};
+
+/******** 卡带 (nes.c) ********/
+
+/* 存储游戏 ROM 中的信息 */
+struct _cartridge {
+    /**
+     * NES ROM 的 header
+     * 一共有 16 字节, 每个字节定义如下:
+     * 0-3 字节: 固定值, $4E $45 $53 $1A (前三字节即为 "NES")
+     * 4: PRG ROM 大小, 单位为 16KB 的倍数
+     * 5: CHR ROM 大小, 单位为 8KB 的倍数, 0 代表 8KB
+     * 6: Flag 6
+     * 7: Flag 7
+     * 8: PRG RAM 大小, 单位为 8KB 的倍数, 0 代表 8KB
+     * 9: Flag 9
+     * 10: Flag 10
+     * 11-15: 统一用 0 填充
+     * 对于任天堂第一方游戏, 无需考虑 Flag 6, Flag 7, Flag 9, Flag 10
+     *
+     * 参考资料: http://ewind.us/2015/nes-emu-3-rom-assembly/
+     *          http://wiki.nesdev.com/w/index.php/INES
+     */
+    uint8_t header[16];
+    int prg_rom_size; // PRG ROM 大小 (Byte)
+    int chr_rom_size; // CHR ROM 大小 (Byte)
+    int prg_ram_size; // PRG RAM 大小 (Byte)
+    uint8_t *prg_rom; // 指向 ROM 映像, 只读
+    uint8_t *chr_rom; // 同上, CHR RAM 时为单独分配的内存
+    bool chr_ram;     // header 中 CHR ROM 大小为 0 时, chr_rom 为 8KB 的 CHR RAM, 可以写入
+
+    /* 整个 ROM 文件的映像, 由 nes_load_rom* 装入, nes_exit 释放 */
+    const uint8_t *image;
+    size_t image_size;
+    enum { CARTRIDGE_IMAGE_NONE, CARTRIDGE_IMAGE_MMAP, CARTRIDGE_IMAGE_MALLOC, CARTRIDGE_IMAGE_BORROWED } image_type;
+};
+
+/******** Save RAM (sram.c) ********/
+
+/* 6000 ~ 7FFF 的 Save RAM, 卡带有电池时映射到 .sav 文件 */
+struct _sram {
+    uint8_t *data;            // 指向 buffer 或映射到内存的 .sav 文件
+    bool mapped;              // data 是否为映射到内存的文件
+    bool dirty;               // 上次写回之后是否被写入
+    int frames;               // dirty 之后经过的帧数
+    uint8_t buffer[0x2000];
+};
+
+/******** Mapper (mapper.c) ********/
+
+struct mapper;  // 见 mapper.h
+
+/* Mapper 寄存器, 不同的 Mapper 只使用其中的一部分 */
+struct _mapper {
+    const struct mapper *type;
+
+    /* UxROM, CNROM, MMC3: Bank 寄存器 (MMC3 为 R0 ~ R7) */
+    uint8_t bank[8];
+
+    /* MMC1 */
+    uint8_t shift;           // 串行写入的移位寄存器
+    uint8_t shift_count;
+    uint8_t control;
+    uint8_t chr_bank[2];
+    uint8_t prg_bank;
+
+    /* MMC3 */
+    uint8_t bank_select;
+    uint8_t irq_latch;
+    uint8_t irq_counter;
+    bool irq_reload;
+    bool irq_enabled;
+    bool irq;                // IRQ 信号, 写入 E000 前保持有效
+};
+
+/******** Tile 缓存 (ppu_tile.c) ********/
+
+/* Pattern Table (0000 ~ 1FFF) 中 512 个 tile 解码后的 8 行像素 (见 ppu_tile.h), 按需解码,
+ * 写入 CHR RAM 或切换 CHR Bank 时清除对应的 valid
+ */
+struct ppu_tile_decoder;
+struct _ppu_tile_cache {
+    const struct ppu_tile_decoder *decoder;  // 解码使用的实现, 由 ppu_tile_init 选择
+    uint64_t row[512][8];
+    uint64_t row_flip[512][8];  // 水平翻转, 垂直翻转只需倒序读取
+    uint8_t valid[512];
+};
+
+/******** Sprite 分组 (ppu.c) ********/
+
+/* 每条扫描线上的 Sprites (相当于 PPU 的 Secondary OAM), 由 OAM 一次生成, OAM 或 Sprite 大小改变后重新生成 */
+struct _ppu_sprite_lines {
+    uint8_t count[240];      // 每条扫描线上的 Sprite 数量, 最多 8 个
+    uint8_t sprite[240][8];  // Sprite 在 OAM 中的编号 (0 ~ 63), 按 OAM 中的顺序排列
+    bool overflow[240];      // 是否超过 8 个
+    bool dirty;              // OAM 或 Sprite 大小改变后为 true
+};
+
+/******** NES ********/
+
+/* 成员按访问频率排列: 每条指令都会访问的 CPU 寄存器, 页表与内部 RAM 放在最前面,
+ * 其次是每条扫描线访问的调度器, PPU 与 IO 寄存器, 较大的缓冲区放在最后
+ */
+struct nes_machine {
+    /* CPU */
+    struct _cpu cpu;
+    uint8_t additional_cycles;  // 对于某些寻址方式, 如果跨页访问, 需要多使用一个 CPU Cycle
+    uint16_t op_address;        // CPU 经过寻址后得到的地址和该地址对应的值 (仅用于 switch 实现)
+    uint8_t op_value;
+    uint64_t cpu_cycles;
+    int cpu_run_cycles;         // 当前 cpu_run 中已经执行 (包括正在执行的指令), 尚未计入 cpu_cycles 的 Cycle 数
+    int cpu_stall;              // 写入内存引起的 CPU 暂停 (OAM DMA), 由 cpu_run 在该指令执行后扣除
+
+    /* 内存 */
+    struct memory_page memory_page_table[256];
+    uint8_t interal_ram[0x0800];  // 0000 ~ 07FF
+
+    struct _scheduler scheduler;
+    uint64_t nes_frame_end;       // 当前帧结束时的主时钟
+    struct _ppu ppu;
+    struct _io io;
+    struct nes_frontend frontend;
+
+    /* 卡带 */
+    struct _cartridge cartridge;
+    struct _mapper mapper;
+    struct _sram sram;            // 6000 ~ 7FFF
+
+    /* PPU 内存, Pattern Table (0000 ~ 1FFF) 每 1KB 由 ppu_chr_bank 中的一个指针指向 CHR ROM, 切换 Bank 时只需修改指针 */
+    uint8_t *ppu_chr_bank[8];
+    struct _ppu_tile_cache ppu_tile_cache;
+    uint8_t ppu_sprram[0x100];
+    struct _ppu_sprite_lines ppu_sprite_lines;
+    uint8_t *ppu_nametable[4];  // 2000, 2400, 2800, 2C00 开始的 1KB 指向 ppu_ciram 中的位置
+    uint8_t ppu_ciram[0x1000];   // Nametable 内存, 前 2KB 为 NES 内置, 后 2KB 仅四屏的卡带使用
+    uint8_t ppu_palette[0x20];   // 3F00 ~ 3F1F
+    uint8_t ppu_palette_color[0x20];  // 调色板中实际显示的颜色编号 (处理镜像与灰度模式), 修改调色板或 PPUMASK 时更新
+    uint64_t ppu_background_mask[240][4];  // 每条扫描线背景不透明的像素 (第 x 个像素为第 x 位), 用于 Sprite 0 hit
+
+    /* 指令缓存与 JIT */
+    struct cpu_decoded_instruction cpu_icache[CPU_ICACHE_SIZE];
+    uint8_t cpu_icache_page_used[CPU_ICACHE_SIZE >> 8];
+    struct cpu_jit *cpu_jit;
+    struct cpu_profile *cpu_profile;  // 仅在定义 BEMU_CPU_PROFILE 时使用
+    struct cpu_trace *cpu_trace;      // 仅在定义 BEMU_CPU_TRACE 时使用
+
+    /* 画面 (256 x 240), 每个像素为颜色编号 (0 ~ 63), 见 ppu.c */
+    uint8_t ppu_framebuffer[240][256];
+    void *ppu_rgb_buffer;             // 不为 NULL 时, 同时输出 RGB 格式的画面
+    int ppu_rgb_format;               // enum ppu_pixel_format
+    uint32_t ppu_rgb_table[512];      // 颜色编号与色彩增强对应的像素值, 见 ppu_palette.c
+};
+
+#endif //BEMU_MACHINE_H
@@ -0,0 +1,287 @@
+/* Mapper: 卡带中的 Bank 切换电路
+ *
+ * 根据 iNES header 中的 Mapper 编号 (Flag 6 与 Flag 7 的高 4 位) 选择, 目前支持:
+ *   0: NROM, 1: MMC1 (SxROM), 2: UxROM, 3: CNROM, 4: MMC3 (TxROM)
+ *
+ * 切换 Bank 时不复制数据, 只修改指针:
+ *   PRG ROM 通过 memory_map 修改 CPU 内存页表 (8000 ~ FFFF) 中的指针,
+ *   CHR ROM 修改 m->ppu_chr_bank 中的指针, 每个指针对应 PPU 地址空间中的 1KB.
+ * 写入 8000 ~ FFFF 时由 mapper_write 交给对应的 Mapper 处理, 不会修改 ROM.
+ *
+ * 参考资料: http://wiki.nesdev.com/w/index.php/Mapper
+ */
+
+#include "mapper.h"
+#include "memory.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "ppu_tile.h"
+#include "scheduler.h"
+#include <stddef.h>
+#include <string.h>
+
+/******** Bank 切换 ********/
+
+/* 将 PRG ROM 中第 bank 个 size KB (8 或 16) 的 Bank 映射到 CPU 地址 address, 负数表示从最后一个 Bank 倒数 */
+static void mapper_map_prg(struct nes_machine *m, uint16_t address, int size, int bank) {
+    int banks = m->cartridge.prg_rom_size / (size * 1024);
+    bank = ((bank % banks) + banks) % banks;
+    memory_map(m, address >> 8, size * 4, m->cartridge.prg_rom + bank * size * 1024, NULL);
+}
+
+/* 将 CHR ROM 中第 bank 个 size KB (1, 2, 4 或 8) 的 Bank 映射到 PPU 地址 address */
+static void mapper_map_chr(struct nes_machine *m, uint16_t address, int size, int bank) {
+    int banks = m->cartridge.chr_rom_size / (size * 1024);
+    bool changed = false;
+    int i;
+    bank = ((bank % banks) + banks) % banks;
+    for(i = 0; i < size; i++) {
+        uint8_t *data = m->cartridge.chr_rom + (bank * size + i) * 1024;
+        if(m->ppu_chr_bank[(address >> 10) + i] == data) { continue; }
+        ppu_catch_up(m);
+        m->ppu_chr_bank[(address >> 10) + i] = data;
+        ppu_tile_cache_invalidate(m, address + i * 1024, 1024);
+        changed = true;
+    }
+    if(changed) { ppu_update_sprite_0_hit(m); }
+}
+
+/******** Mapper 0: NROM ********/
+
+/* PRG ROM 为 16KB 时, C000 ~ FFFF 是 8000 ~ BFFF 的镜像 */
+static void nrom_reset(struct nes_machine *m) {
+    mapper_map_prg(m, 0x8000, 16, 0);
+    mapper_map_prg(m, 0xc000, 16, 1);
+    mapper_map_chr(m, 0x0000, 8, 0);
+}
+
+static void nrom_write(struct nes_machine *m, uint16_t address, uint8_t data) {}
+
+/******** Mapper 1: MMC1 ********/
+
+/* 控制寄存器 (8000 ~ 9FFF):
+ *   第 0, 1 位: 镜像方式, 0: 单屏 (低), 1: 单屏 (高), 2: 垂直, 3: 水平
+ *   第 2, 3 位: PRG ROM Bank 模式, 0, 1: 32KB, 2: 8000 固定为第一个 Bank, 3: C000 固定为最后一个 Bank
+ *   第 4 位:    CHR ROM Bank 模式, 0: 8KB, 1: 两个 4KB
+ */
+static void mmc1_update(struct nes_machine *m) {
+    struct _mapper *mapper = &m->mapper;
+    int prg = mapper->prg_bank & 0x0f;
+
+    static const uint8_t mirroring[4] = {
+        PPU_MIRRORING_SINGLE_LOW, PPU_MIRRORING_SINGLE_HIGH, PPU_MIRRORING_VERTICAL, PPU_MIRRORING_HORIZONTAL
+    };
+    ppu_set_mirroring(m, mirroring[mapper->control & 3]);
+
+    switch((mapper->control >> 2) & 3) {
+        case 0: case 1:
+            mapper_map_prg(m, 0x8000, 16, prg & ~1);
+            mapper_map_prg(m, 0xc000, 16, prg | 1);
+            break;
+        case 2:
+            mapper_map_prg(m, 0x8000, 16, 0);
+            mapper_map_prg(m, 0xc000, 16, prg);
+            break;
+        case 3:
+            mapper_map_prg(m, 0x8000, 16, prg);
+            mapper_map_prg(m, 0xc000, 16, -1);
+            break;
+    }
+
+    if(mapper->control & 0x10) {
+        mapper_map_chr(m, 0x0000, 4, mapper->chr_bank[0]);
+        mapper_map_chr(m, 0x1000, 4, mapper->chr_bank[1]);
+    } else {
+        mapper_map_chr(m, 0x0000, 4, mapper->chr_bank[0] & ~1);
+        mapper_map_chr(m, 0x1000, 4, mapper->chr_bank[0] | 1);
+    }
+}
+
+static void mmc1_reset(struct nes_machine *m) {
+    m->mapper.shift = 0;
+    m->mapper.shift_count = 0;
+    m->mapper.control = 0x0c;
+    m->mapper.chr_bank[0] = 0;
+    m->mapper.chr_bank[1] = 0;
+    m->mapper.prg_bank = 0;
+    mmc1_update(m);
+}
+
+/* 寄存器通过串行方式写入: 每次写入数据的第 0 位, 第 5 次写入时根据地址写入对应的寄存器.
+ * 数据的第 7 位为 1 时清空移位寄存器, 并将 PRG ROM Bank 模式设为 3.
+ */
+static void mmc1_write(struct nes_machine *m, uint16_t address, uint8_t data) {
+    struct _mapper *mapper = &m->mapper;
+    if(data & 0x80) {
+        mapper->shift = 0;
+        mapper->shift_count = 0;
+        mapper->control |= 0x0c;
+        mmc1_update(m);
+        return;
+    }
+    mapper->shift |= (data & 1) << mapper->shift_count;
+    if(++mapper->shift_count < 5) { return; }
+
+    switch(address & 0xe000) {
+        case 0x8000: mapper->control = mapper->shift; break;
+        case 0xa000: mapper->chr_bank[0] = mapper->shift; break;
+        case 0xc000: mapper->chr_bank[1] = mapper->shift; break;
+        case 0xe000: mapper->prg_bank = mapper->shift; break;
+    }
+    mapper->shift = 0;
+    mapper->shift_count = 0;
+    mmc1_update(m);
+}
+
+/******** Mapper 2: UxROM ********/
+
+/* 8000 ~ BFFF 可以切换, C000 ~ FFFF 固定为最后一个 Bank */
+static void uxrom_reset(struct nes_machine *m) {
+    m->mapper.bank[0] = 0;
+    mapper_map_prg(m, 0x8000, 16, 0);
+    mapper_map_prg(m, 0xc000, 16, -1);
+    mapper_map_chr(m, 0x0000, 8, 0);
+}
+
+static void uxrom_write(struct nes_machine *m, uint16_t address, uint8_t data) {
+    m->mapper.bank[0] = data;
+    mapper_map_prg(m, 0x8000, 16, data);
+}
+
+/******** Mapper 3: CNROM ********/
+
+/* PRG ROM 与 NROM 相同, 切换 8KB 的 CHR ROM */
+static void cnrom_reset(struct nes_machine *m) {
+    m->mapper.bank[0] = 0;
+    nrom_reset(m);
+}
+
+static void cnrom_write(struct nes_machine *m, uint16_t address, uint8_t data) {
+    m->mapper.bank[0] = data;
+    mapper_map_chr(m, 0x0000, 8, data);
+}
+
+/******** Mapper 4: MMC3 ********/
+
+/* Bank Select (8000, 偶数地址):
+ *   第 0 ~ 2 位: 下一次写入 8001 时修改的寄存器 R0 ~ R7
+ *   第 6 位:     PRG ROM Bank 模式, 0: 8000 为 R6, C000 为倒数第二个 Bank; 1: 两者交换
+ *   第 7 位:     CHR ROM Bank 模式, 0: 0000 ~ 0FFF 为 2KB 的 R0, R1; 1: 与 1000 ~ 1FFF 的 1KB 的 R2 ~ R5 交换
+ * A000 ~ BFFF 固定为 R7, E000 ~ FFFF 固定为最后一个 Bank
+ */
+static void mmc3_update(struct nes_machine *m) {
+    struct _mapper *mapper = &m->mapper;
+    uint16_t chr_xor = (mapper->bank_select & 0x80) ? 0x1000 : 0;
+
+    if(mapper->bank_select & 0x40) {
+        mapper_map_prg(m, 0x8000, 8, -2);
+        mapper_map_prg(m, 0xc000, 8, mapper->bank[6]);
+    } else {
+        mapper_map_prg(m, 0x8000, 8, mapper->bank[6]);
+        mapper_map_prg(m, 0xc000, 8, -2);
+    }
+    mapper_map_prg(m, 0xa000, 8, mapper->bank[7]);
+    mapper_map_prg(m, 0xe000, 8, -1);
+
+    mapper_map_chr(m, 0x0000 ^ chr_xor, 2, mapper->bank[0] >> 1);
+    mapper_map_chr(m, 0x0800 ^ chr_xor, 2, mapper->bank[1] >> 1);
+    mapper_map_chr(m, 0x1000 ^ chr_xor, 1, mapper->bank[2]);
+    mapper_map_chr(m, 0x1400 ^ chr_xor, 1, mapper->bank[3]);
+    mapper_map_chr(m, 0x1800 ^ chr_xor, 1, mapper->bank[4]);
+    mapper_map_chr(m, 0x1c00 ^ chr_xor, 1, mapper->bank[5]);
+}
+
+static void mmc3_reset(struct nes_machine *m) {
+    struct _mapper *mapper = &m->mapper;
+    memset(mapper->bank, 0, sizeof(mapper->bank));
+    mapper->bank[1] = 2;
+    mapper->bank[2] = 4;
+    mapper->bank[3] = 5;
+    mapper->bank[4] = 6;
+    mapper->bank[5] = 7;
+    mapper->bank[7] = 1;
+    mapper->bank_select = 0;
+    mapper->irq_latch = 0;
+    mapper->irq_counter = 0;
+    mapper->irq_reload = false;
+    mapper->irq_enabled = false;
+    mapper->irq = false;
+    mmc3_update(m);
+}
+
+/* 寄存器由地址的第 13, 14 位与第 0 位选择 */
+static void mmc3_write(struct nes_machine *m, uint16_t address, uint8_t data) {
+    struct _mapper *mapper = &m->mapper;
+    switch(address & 0xe001) {
+        case 0x8000: mapper->bank_select = data; mmc3_update(m); break;
+        case 0x8001: mapper->bank[mapper->bank_select & 7] = data; mmc3_update(m); break;
+        case 0xa000:  // 四屏的卡带不使用
+            if(m->ppu.mirroring != PPU_MIRRORING_FOUR_SCREEN) {
+                ppu_set_mirroring(m, (data & 1) ? PPU_MIRRORING_HORIZONTAL : PPU_MIRRORING_VERTICAL);
+            }
+            break;
+        case 0xa001: break;  // PRG RAM 写保护, 不模拟
+        case 0xc000: mapper->irq_latch = data; break;
+        case 0xc001: mapper->irq_counter = 0; mapper->irq_reload = true; break;
+        case 0xe000: mapper->irq_enabled = false; mapper->irq = false; break;
+        case 0xe001: mapper->irq_enabled = true; break;
+    }
+}
+
+/* 扫描线计数器: 计数为 0 或者写入过 C001 时重新装入 C000 的值, 否则减 1, 减到 0 时产生 IRQ */
+static void mmc3_scanline(struct nes_machine *m) {
+    struct _mapper *mapper = &m->mapper;
+    if(mapper->irq_counter == 0 || mapper->irq_reload) {
+        mapper->irq_counter = mapper->irq_latch;
+        mapper->irq_reload = false;
+    } else {
+        mapper->irq_counter--;
+    }
+    if(mapper->irq_counter == 0 && mapper->irq_enabled) { mapper->irq = true; }
+}
+
+/******** Mapper 接口 ********/
+
+static const struct mapper mapper_table[] = {
+    { 0, "NROM",  nrom_reset,  nrom_write,  NULL },
+    { 1, "MMC1",  mmc1_reset,  mmc1_write,  NULL },
+    { 2, "UxROM", uxrom_reset, uxrom_write, NULL },
+    { 3, "CNROM", cnrom_reset, cnrom_write, NULL },
+    { 4, "MMC3",  mmc3_reset,  mmc3_write,  mmc3_scanline },
+};
+
+/* iNES header 中的 Mapper 编号: Flag 6 的高 4 位为低 4 位, Flag 7 的高 4 位为高 4 位 */
+int mapper_number(struct nes_machine *m) {
+    return (m->cartridge.header[6] >> 4) | (m->cartridge.header[7] & 0xf0);
+}
+
+/* 查找 Mapper, 返回 NULL 表示不支持 */
+const struct mapper *mapper_find(int number) {
+    size_t i;
+    for(i = 0; i < sizeof(mapper_table) / sizeof(mapper_table[0]); i++) {
+        if(mapper_table[i].number == number) { return &mapper_table[i]; }
+    }
+    return NULL;
+}
+
+/* 扫描线计数事件, 在每条渲染的扫描线的第 260 个 PPU 周期 (PPU 地址线 A12 上升沿) 处理 */
+static void mapper_scanline(struct nes_machine *m) {
+    m->mapper.type->scanline(m);
+    if(m->mapper.irq) { cpu_irq(m); }
+}
+
+/* 初始化, 需要在 memory_init 之后调用 */
+void mapper_init(struct nes_machine *m) {
+    memset(&m->mapper, 0, sizeof(m->mapper));
+    m->mapper.type = mapper_find(mapper_number(m));
+    ppu_set_mirroring(m, (m->cartridge.header[6] & 8) ? PPU_MIRRORING_FOUR_SCREEN : (m->cartridge.header[6] & 1));
+    m->mapper.type->reset(m);
+    if(m->mapper.type->scanline) {
+        scheduler_register(m, SCHEDULER_EVENT_MAPPER_IRQ, mapper_scanline);
+    }
+}
+
+/* 写入 8000 ~ FFFF */
+void mapper_write(struct nes_machine *m, uint16_t address, uint8_t data) {
+    m->mapper.type->write(m, address, data);
+}
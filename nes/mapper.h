@@ -0,0 +1,21 @@
+#ifndef BEMU_MAPPER_H
+#define BEMU_MAPPER_H
+
+#include <stdint.h>
+#include "machine.h"
+
+/* Mapper 的类型, 根据 iNES header 中的 Mapper 编号选择 */
+struct mapper {
+    int number;
+    const char *name;
+    void (*reset)(struct nes_machine *m);                               // 设置初始的 Bank
+    void (*write)(struct nes_machine *m, uint16_t address, uint8_t data);  // 写入 8000 ~ FFFF
+    void (*scanline)(struct nes_machine *m);                            // 扫描线计数, NULL 表示没有
+};
+
+int mapper_number(struct nes_machine *m);
+const struct mapper *mapper_find(int number);
+void mapper_init(struct nes_machine *m);
+void mapper_write(struct nes_machine *m, uint16_t address, uint8_t data);
+
+#endif //BEMU_MAPPER_H
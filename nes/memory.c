@@ -66,74 +66,106 @@
 
 
 #include "memory.h"
+#include "cpu.h"
 #include "ppu.h"
 #include "io.h"
+#include "mapper.h"
+#include "sram.h"
+#include <stddef.h>
 
-uint8_t *prg_rom_ptr;
-uint8_t *chr_rom_ptr;
-int prg_rom_size;
+/* 内存页表 (m->memory_page_table)
+ * 以地址的高 8 位为索引, 每页 256 字节.
+ * 内部 RAM, Save RAM 与 PRG ROM 所在的页直接指向对应的内存, 读取时只需一次查表;
+ * PPU 寄存器, APU 与 IO 寄存器所在的页, 以及需要额外处理的写入 (PRG ROM, 由 Mapper 处理) 通过 handler 访问.
+ * 切换 Bank 时只需修改页表中的指针 (见 mapper.c).
+ */
+
+static void memory_write_io(struct nes_machine *m, uint16_t address, uint8_t data);
 
-uint8_t interal_ram[0x0800];  // 0000 ~ 07FF
-uint8_t save_ram[0x2000];     // 6000 ~ 7FFF
+/* 将 CPU 地址 first_page << 8 开始的 pages 页映射到 read 与 write 指向的内存
+ * 某页指向的内存改变时, 使该页的指令缓存失效
+ */
+void memory_map(struct nes_machine *m, int first_page, int pages, uint8_t *read, uint8_t *write) {
+    int i;
+    for(i = 0; i < pages; i++) {
+        struct memory_page *page = &m->memory_page_table[first_page + i];
+        uint8_t *old = page->read;
+        page->read  = read  ? read  + (i << 8) : NULL;
+        page->write = write ? write + (i << 8) : NULL;
+        if(page->read != old) { cpu_icache_invalidate_page(m, first_page + i); }
+    }
+}
 
-void memory_init(uint8_t *prg_rom, int prg_rom_length) {
-    prg_rom_ptr = prg_rom;
-    prg_rom_size = prg_rom_length;
+/* 设置 first_page << 8 开始的 pages 页的 handler */
+static void memory_map_handler(struct nes_machine *m, int first_page, int pages,
+                               uint8_t (*read_handler)(struct nes_machine *, uint16_t),
+                               void (*write_handler)(struct nes_machine *, uint16_t, uint8_t)) {
+    int i;
+    for(i = 0; i < pages; i++) {
+        m->memory_page_table[first_page + i].read_handler  = read_handler;
+        m->memory_page_table[first_page + i].write_handler = write_handler;
+    }
 }
 
-uint8_t memory_read_byte(uint16_t address) {
-    switch(address >> 13) {
-        case 0:                        // 0000 ~ 1FFF, 内部 RAM
-            return interal_ram[address % 0x0800];
-        case 1:                        // 2000 ~ 3FFF, PPU 寄存器
-            return ppu_io_read(address);
-        case 2:                        // APU 与 IO 寄存器
-            return io_read(address);
-        case 3:                        // Save RAM
-            return save_ram[address - 0x6000];
-        default:                       // PRG ROM
-            return prg_rom_ptr[(address - 0x8000) % prg_rom_size];
+/* 初始化页表, 8000 ~ FFFF 的 PRG ROM 由 mapper_init 映射 */
+void memory_init(struct nes_machine *m) {
+    int i;
+
+    /* 0000 ~ 1FFF, 内部 RAM 及其镜像 */
+    for(i = 0; i < 0x20; i += 0x08) {
+        memory_map(m, i, 0x08, m->interal_ram, m->interal_ram);
     }
+    /* 2000 ~ 3FFF, PPU 寄存器 */
+    memory_map(m, 0x20, 0x20, NULL, NULL);
+    memory_map_handler(m, 0x20, 0x20, ppu_io_read, ppu_io_write);
+    /* 4000 ~ 5FFF, APU 与 IO 寄存器 */
+    memory_map(m, 0x40, 0x20, NULL, NULL);
+    memory_map_handler(m, 0x40, 0x20, io_read, memory_write_io);
+    /* 6000 ~ 7FFF, Save RAM, 映射到文件时第一次写入通过 handler 记录 (见 sram.c) */
+    memory_map(m, 0x60, 0x20, m->sram.data, m->sram.mapped ? NULL : m->sram.data);
+    memory_map_handler(m, 0x60, 0x20, NULL, sram_write);
+    /* 8000 ~ FFFF, PRG ROM, 写入时交给 Mapper 处理 */
+    memory_map_handler(m, 0x80, 0x80, NULL, mapper_write);
 }
 
-uint16_t memory_read_word(uint16_t address) {
-    return memory_read_byte(address) + (memory_read_byte(address + 1) << 8);
+void memory_write_byte(struct nes_machine *m, uint16_t address, uint8_t data) {
+    const struct memory_page *page = &m->memory_page_table[address >> 8];
+    if(page->write) {                  // 内部 RAM 与 Save RAM
+        page->write[address & 0xff] = data;
+        cpu_icache_invalidate(m, address);
+    } else {
+        page->write_handler(m, address, data);
+    }
 }
 
-void memory_write_byte(uint16_t address, uint8_t data) {
-    int i; uint16_t tmp;
-    /* DMA 传输 */
-    if (address == 0x4014) {
-        for(i = 0; i < 256; i++) {
-            tmp = (0x100 * data) + i;
-            if((tmp >> 13) == 0) {
-                ppu_sprram_write(interal_ram[tmp % 0x0800]);
-            } else {
-                ppu_sprram_write(prg_rom_ptr[(address - 0x8000) % prg_rom_size]);
-            }
+/* OAM DMA: 将 CPU 地址 page << 8 开始的 256 字节复制到 OAM, CPU 暂停 513 个 Cycle (奇数 Cycle 开始时为 514 个)
+ * 直接映射到内存的页整页复制, PPU 与 IO 寄存器所在的页逐字节通过 handler 读取
+ */
+static void memory_oam_dma(struct nes_machine *m, uint8_t page) {
+    const struct memory_page *source = &m->memory_page_table[page];
+    uint8_t buf[0x100];
+    int i;
+    if(source->read) {
+        ppu_oam_dma(m, source->read);
+    } else {
+        for(i = 0; i < 0x100; i++) {
+            buf[i] = source->read_handler(m, (page << 8) | i);
         }
-        return;
+        ppu_oam_dma(m, buf);
     }
+    m->cpu_stall += 513;
+}
 
-    switch(address >> 13) {
-        case 0:                        // 0000 ~ 1FFF, 内部 RAM
-            interal_ram[address % 0x0800] = data;
-            break;
-        case 1:                        // 2000 ~ 3FFF, PPU 寄存器
-            ppu_io_write(address, data);
-            break;
-        case 2:                        // APU 与 IO 寄存器
-            io_write(address, data);
-            break;
-        case 3:                        // Save RAM
-            save_ram[address - 0x6000] = data;
-            break;
-        default:                       // PRG ROM
-            prg_rom_ptr[(address - 0x8000) % prg_rom_size] = data;
+/* APU 与 IO 寄存器 */
+static void memory_write_io(struct nes_machine *m, uint16_t address, uint8_t data) {
+    if(address == 0x4014) {
+        memory_oam_dma(m, data);
+        return;
     }
+    io_write(m, address, data);
 }
 
-void memory_write_word(uint16_t address, uint16_t data) {
-    memory_write_byte(address, data & 0xFF);
-    memory_write_byte(address + 1, data >> 8);
+void memory_write_word(struct nes_machine *m, uint16_t address, uint16_t data) {
+    memory_write_byte(m, address, data & 0xFF);
+    memory_write_byte(m, address + 1, data >> 8);
 }
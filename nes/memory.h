@@ -2,11 +2,31 @@
 #define BEMU_MEMORY_H
 
 #include <stdint.h>
+#include "machine.h"
+#include "cpu.h"
 
-void memory_init(uint8_t *prg_rom, int prg_rom_length);
-uint8_t memory_read_byte(uint16_t address);
-uint16_t memory_read_word(uint16_t address);
-void memory_write_byte(uint16_t address, uint8_t data);
-void memory_write_word(uint16_t address, uint16_t data);
+void memory_init(struct nes_machine *m);
+void memory_map(struct nes_machine *m, int first_page, int pages, uint8_t *read, uint8_t *write);
+void memory_write_byte(struct nes_machine *m, uint16_t address, uint8_t data);
+void memory_write_word(struct nes_machine *m, uint16_t address, uint16_t data);
+
+static inline uint8_t memory_read_byte(struct nes_machine *m, uint16_t address) {
+    const struct memory_page *page = &m->memory_page_table[address >> 8];
+    return page->read ? page->read[address & 0xff] : page->read_handler(m, address);
+}
+
+static inline uint16_t memory_read_word(struct nes_machine *m, uint16_t address) {
+    return memory_read_byte(m, address) + (memory_read_byte(m, address + 1) << 8);
+}
+
+/* 零页与栈 (0000 ~ 01FF) 一定位于内部 RAM 中, 不经过页表直接访问 */
+static inline uint8_t memory_read_ram(struct nes_machine *m, uint16_t address) {
+    return m->interal_ram[address & 0x07ff];
+}
+
+static inline void memory_write_ram(struct nes_machine *m, uint16_t address, uint8_t data) {
+    m->interal_ram[address & 0x07ff] = data;
+    cpu_icache_invalidate(m, address);
+}
 
 #endif //BEMU_MEMORY_H
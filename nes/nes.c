@@ -2,79 +2,264 @@
  */
 
 #include "nes.h"
+#include "scheduler.h"
+#include "io.h"
+#include "mapper.h"
+#include "sram.h"
+#include "cpu_jit.h"
+#include "cpu_profile.h"
+#include "cpu_trace.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-struct _cartridge cartridge;
+/* 创建一台 NES, 全部状态初始化为 0 */
+struct nes_machine *nes_create() {
+    struct nes_machine *m = (struct nes_machine *)calloc(1, sizeof(struct nes_machine));
+    if(m != NULL) { sram_reset(m); }
+    return m;
+}
 
-int nes_load_rom(char *rom) {
-    FILE *fp;
+/* 释放 nes_create 创建的 NES */
+void nes_destroy(struct nes_machine *m) {
+    if(m == NULL) { return; }
+    nes_exit(m);
+    free(m);
+}
 
-    /* 打开 NES ROM 文件 */
-    fp = fopen(rom,"r");
-    if(fp == NULL) {
-        return ERR_FILE_NOT_EXIST;
+/* 释放 ROM 映像与 CHR RAM, 写回 Save RAM */
+static void nes_unload_rom(struct nes_machine *m) {
+    struct _cartridge *c = &m->cartridge;
+    sram_close(m);
+    switch(c->image_type) {
+        case CARTRIDGE_IMAGE_MMAP:   munmap((void *)c->image, c->image_size); break;
+        case CARTRIDGE_IMAGE_MALLOC: free((void *)c->image); break;
+        default: break;
     }
+    if(c->chr_ram) { free(c->chr_rom); }
+    c->image = NULL;
+    c->image_size = 0;
+    c->image_type = CARTRIDGE_IMAGE_NONE;
+    c->prg_rom = NULL;
+    c->chr_rom = NULL;
+    c->chr_ram = false;
+}
+
+/* 从内存中的 ROM 映像装入, PRG ROM 与 CHR ROM 直接指向映像中的数据, 不进行复制
+ * type 表示 nes_exit 时如何释放 data, 出错时也由本函数释放
+ */
+static int nes_load_rom_image(struct nes_machine *m, const uint8_t *data, size_t size, int type) {
+    struct _cartridge *c = &m->cartridge;
+    size_t offset = 16;
+
+    nes_unload_rom(m);
+    c->image = data;
+    c->image_size = size;
+    c->image_type = type;
 
     /* 读取 NES ROM 的 Header */
-    if(fread(cartridge.header, sizeof(uint8_t), 16, fp) != 16) {
+    if(size < 16 || memcmp(data, "NES\x1a", 4) != 0) {
+        nes_unload_rom(m);
         return ERR_NES_FILE_HEADER_READ_FAILED;
-    } else {
-        /* 读取 ROM 信息 */
-        cartridge.prg_rom_size = 16 * 1024 * cartridge.header[4];
-        cartridge.chr_rom_size = 8  * 1024 * cartridge.header[5];
-        cartridge.prg_ram_size = 8  * 1024 * cartridge.header[8];
-        if(cartridge.chr_rom_size == 0) { cartridge.chr_rom_size = 8 * 1024; }
-        if(cartridge.prg_ram_size == 0) { cartridge.prg_ram_size = 8 * 1024; }
-
     }
+    memcpy(c->header, data, 16);
 
-    /* 分配内存 */
-    cartridge.prg_rom = (uint8_t *)malloc((size_t)cartridge.prg_rom_size);
-    cartridge.chr_rom = (uint8_t *)malloc((size_t)cartridge.chr_rom_size);
-    if(cartridge.prg_rom == NULL || cartridge.chr_rom == NULL) {
-        return ERR_MEMORY_ALLOCATE_FAILED;
+    /* 读取 ROM 信息 */
+    c->prg_rom_size = 16 * 1024 * c->header[4];
+    c->chr_rom_size = 8  * 1024 * c->header[5];
+    c->prg_ram_size = 8  * 1024 * c->header[8];
+    c->chr_ram = (c->chr_rom_size == 0);
+    if(c->chr_rom_size == 0) { c->chr_rom_size = 8 * 1024; }
+    if(c->prg_ram_size == 0) { c->prg_ram_size = 8 * 1024; }
+    if(c->prg_rom_size == 0) {
+        nes_unload_rom(m);
+        return ERR_NES_FILE_HEADER_READ_FAILED;
+    }
+    if(mapper_find(mapper_number(m)) == NULL) {
+        nes_unload_rom(m);
+        return ERR_MAPPER_NOT_SUPPORTED;
     }
+    if(c->header[6] & 0x04) { offset += 512; }  // 跳过 Trainer
 
-    /* 装入 PRG ROM 与 CHR ROM */
-    if(fread(cartridge.prg_rom, sizeof(uint8_t), (size_t)cartridge.prg_rom_size, fp) != (size_t)cartridge.prg_rom_size) {
+    /* PRG ROM 与 CHR ROM, CHR RAM 需要单独分配 */
+    if(size < offset + c->prg_rom_size) {
+        nes_unload_rom(m);
         return ERR_PRG_ROM_LOAD_FAILED;
     }
-    if(fread(cartridge.chr_rom, sizeof(uint8_t), (size_t)cartridge.chr_rom_size, fp) != (size_t)cartridge.chr_rom_size) {
-        return ERR_CHR_ROM_LOAD_FAILED;
+    c->prg_rom = (uint8_t *)data + offset;
+    offset += c->prg_rom_size;
+    if(c->chr_ram) {
+        c->chr_rom = (uint8_t *)calloc((size_t)c->chr_rom_size, 1);
+        if(c->chr_rom == NULL) {
+            c->chr_ram = false;
+            nes_unload_rom(m);
+            return ERR_MEMORY_ALLOCATE_FAILED;
+        }
+    } else {
+        if(size < offset + c->chr_rom_size) {
+            nes_unload_rom(m);
+            return ERR_CHR_ROM_LOAD_FAILED;
+        }
+        c->chr_rom = (uint8_t *)data + offset;
+    }
+    return 0;
+}
+
+/* 卡带有电池时, 将 Save RAM 映射到与 ROM 同名的 .sav 文件 */
+static void nes_open_save_ram(struct nes_machine *m, const char *rom) {
+    const char *slash = strrchr(rom, '/');
+    const char *dot = strrchr(rom, '.');
+    char path[4096];
+    int length = (dot != NULL && (slash == NULL || dot > slash)) ? (int)(dot - rom) : (int)strlen(rom);
+
+    if(!(m->cartridge.header[6] & 0x02)) { return; }
+    snprintf(path, sizeof(path), "%.*s.sav", length, rom);
+    if(sram_open(m, path) != 0) {
+        fprintf(stderr, "Unable to open save file %s, the game will not be saved\n", path);
     }
+}
+
+/* 从文件装入 NES ROM
+ * 文件以只读方式映射到内存 (mmap), 多台 NES 装入同一个 ROM 时共享物理内存. 无法映射时 (如管道) 读入内存
+ */
+int nes_load_rom(struct nes_machine *m, const char *rom) {
+    struct stat st;
+    void *data;
+    FILE *fp;
+    int fd, result;
 
-    /* 关闭 NES ROM */
+    fd = open(rom, O_RDONLY);
+    if(fd < 0) {
+        return ERR_FILE_NOT_EXIST;
+    }
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data != MAP_FAILED) {
+            close(fd);
+            result = nes_load_rom_image(m, data, (size_t)st.st_size, CARTRIDGE_IMAGE_MMAP);
+            if(result == 0) { nes_open_save_ram(m, rom); }
+            return result;
+        }
+    }
+
+    fp = fdopen(fd, "rb");
+    if(fp == NULL) {
+        close(fd);
+        return ERR_FILE_NOT_EXIST;
+    }
+    result = nes_load_rom_stream(m, fp);
     fclose(fp);
+    if(result == 0) { nes_open_save_ram(m, rom); }
+    return result;
+}
 
-    return 0;
+/* 从已经打开的文件中读入 NES ROM, 不关闭 fp */
+int nes_load_rom_stream(struct nes_machine *m, FILE *fp) {
+    uint8_t *data = NULL, *tmp;
+    size_t size = 0, capacity = 0, n;
+
+    for(;;) {
+        if(size == capacity) {
+            capacity = capacity ? capacity * 2 : 256 * 1024;
+            tmp = (uint8_t *)realloc(data, capacity);
+            if(tmp == NULL) {
+                free(data);
+                return ERR_MEMORY_ALLOCATE_FAILED;
+            }
+            data = tmp;
+        }
+        n = fread(data + size, 1, capacity - size, fp);
+        if(n == 0) { break; }
+        size += n;
+    }
+    if(ferror(fp)) {
+        free(data);
+        return ERR_NES_FILE_HEADER_READ_FAILED;
+    }
+    return nes_load_rom_image(m, data, size, CARTRIDGE_IMAGE_MALLOC);
+}
+
+/* 从内存中装入 NES ROM, 不复制数据, 在 nes_exit 之前 data 必须保持有效且不被修改 */
+int nes_load_rom_buffer(struct nes_machine *m, const uint8_t *data, size_t size) {
+    return nes_load_rom_image(m, data, size, CARTRIDGE_IMAGE_BORROWED);
 }
 
-void nes_print_rom_metadata() {
+void nes_print_rom_metadata(struct nes_machine *m) {
     /* 显示 ROM 信息 */
     printf("ROM Metadata: =============================\n");
-    printf("Sinature: %c%c%c\n", cartridge.header[0], cartridge.header[1], cartridge.header[2]);
-    printf("PRG ROM Size: %d KB\n", cartridge.prg_rom_size / 1024);
-    printf("CHR ROM Size: %d KB\n", cartridge.chr_rom_size / 1024);
-    printf("PRG RAM Size: %d KB\n", cartridge.prg_ram_size / 1024);
+    printf("Sinature: %c%c%c\n", m->cartridge.header[0], m->cartridge.header[1], m->cartridge.header[2]);
+    printf("PRG ROM Size: %d KB\n", m->cartridge.prg_rom_size / 1024);
+    printf("CHR ROM Size: %d KB\n", m->cartridge.chr_rom_size / 1024);
+    printf("PRG RAM Size: %d KB\n", m->cartridge.prg_ram_size / 1024);
+    printf("Mapper: %d (%s)\n", mapper_number(m), mapper_find(mapper_number(m))->name);
+    printf("Battery: %s\n", (m->cartridge.header[6] & 0x02) ? "Yes" : "No");
     printf("==============================================\n\n");
 }
 
-void nes_exit() {
+void nes_exit(struct nes_machine *m) {
+#ifdef BEMU_CPU_PROFILE
+    cpu_profile_exit(m);  // 报告中的反汇编需要读取 PRG ROM, 因此在释放内存之前保存
+#endif
+#ifdef BEMU_CPU_TRACE
+    cpu_trace_exit(m);
+#endif
     /* 释放内存 */
-    free(cartridge.prg_rom);
-    free(cartridge.chr_rom);
-    cartridge.prg_rom = NULL;
-    cartridge.chr_rom = NULL;
+    nes_unload_rom(m);
+#ifdef BEMU_CPU_JIT
+    cpu_jit_exit(m);
+#endif
+}
+
+/* 扫描线事件: PPU 处理一条扫描线, 并安排下一条扫描线
+ * 渲染时, 在扫描线的第 260 个 PPU 周期处理 Mapper 的扫描线计数 (MMC3)
+ */
+static void nes_scanline(struct nes_machine *m) {
+    uint64_t time = scheduler_clock(m);
+    ppu_run(m, 1);
+    if(m->mapper.type->scanline && m->ppu.scanline < 240 && (ppu_show_background(m) || ppu_show_sprites(m))) {
+        scheduler_schedule(m, SCHEDULER_EVENT_MAPPER_IRQ, time + 260 * SCHEDULER_PPU_CLOCK_DIVIDER);
+    }
+    if(m->mapper.irq) { cpu_irq(m); }  // IRQ 信号一直有效, 直到中断屏蔽标志为 0 时被响应
+    scheduler_schedule(m, SCHEDULER_EVENT_SCANLINE, time + SCHEDULER_SCANLINE_CYCLES);
+}
+
+void nes_init(struct nes_machine *m) {
+    scheduler_init(m);
+    scheduler_register(m, SCHEDULER_EVENT_SCANLINE, nes_scanline);
+    scheduler_register(m, SCHEDULER_EVENT_NMI, cpu_interrupt);
+
+    memory_init(m);
+    io_init(m);
+    ppu_init(m);
+    mapper_init(m);
+    cpu_init(m);
+
+    m->nes_frame_end = 0;
+    scheduler_schedule(m, SCHEDULER_EVENT_SCANLINE, 0);
 }
 
-void nes_init() {
-    memory_init(cartridge.prg_rom, cartridge.prg_rom_size);
+/* 运行一帧 (262 条扫描线) */
+void nes_run_frame(struct nes_machine *m) {
+    m->nes_frame_end += SCHEDULER_FRAME_CYCLES;
+    scheduler_run(m, m->nes_frame_end);
+    sram_frame(m);
+}
 
-    /* 将 CHR ROM 装入 PPU 内存 */
-    ppu_copy(0x0000, cartridge.chr_rom, 0x2000);
+/* 设置前端, frontend 的内容会被复制, 为 NULL 时清除 (不显示画面, 没有输入) */
+void nes_set_frontend(struct nes_machine *m, const struct nes_frontend *frontend) {
+    if(frontend != NULL) { m->frontend = *frontend; }
+    else { memset(&m->frontend, 0, sizeof(m->frontend)); }
+}
 
-    ppu_init();
-    ppu_set_mirroring(cartridge.header[6] & 1);
-    cpu_init();
+/* 运行 frames 帧, frames 小于 0 时一直运行. 每帧之前由前端的 wait_frame 控制速度 */
+void nes_run(struct nes_machine *m, long frames) {
+    long i;
+    for(i = 0; frames < 0 || i < frames; i++) {
+        if(m->frontend.wait_frame != NULL) { m->frontend.wait_frame(m->frontend.user); }
+        nes_run_frame(m);
+    }
 }
@@ -4,71 +4,27 @@
  */
 
 #include "ppu.h"
+#include "ppu_tile.h"
 #include "cpu.h"
 #include "nes.h"
-#include "emulator.h"
+#include "scheduler.h"
 #include <string.h>
 #include "stdio.h"
 
-/* 像素缓冲区，存储 PPU 最终生成的图像，供外部调用
- * bg:  背景
- * bbg: 背景后的 Sprites
- * fg:  背景前的 Sprites
- */
-PixelBuf bg, bbg, fg;
-
-/* PPU 内存 */
-uint8_t ppu_sprram[0x100];
-uint8_t ppu_ram[0x4000];
-
-/* 画面渲染相关 */
-/* For sprite-0-hit checks*/
-uint8_t ppu_screen_background[264][248];
-/* Precalculated tile high and low bytes addition for pattern tables */
-uint8_t ppu_l_h_addition_table[256][256][8];
-uint8_t ppu_l_h_addition_flip_table[256][256][8];
-
-bool ppu_sprite_hit_occured = false;
-uint8_t ppu_latch;
-bool ppu_2007_first_read;
-uint8_t ppu_addr_latch;
-
-struct _ppu {
-    /* PPU 寄存器 */
-    uint8_t ppuctrl;     // 2000: PPU 控制寄存器，WRITE
-    uint8_t ppumask;     // 2001: PPU MASK 寄存器，WRITE
-    uint8_t ppustatus;   // 2002: PPU 状态寄存器，READ
-    uint8_t oamaddr;     // 2003: PPU OAM 地址，WRITE
-    uint8_t oamdata;     // 2004: PPU OAM 数据，READ/WRITE
-    uint16_t ppuscroll;  // 2005: PPU 滚动位置寄存器，WRITE x2
-    uint8_t ppuscroll_x, ppuscroll_y;  // 将 PPUSCROLL 寄存器分为 X 和 Y 两个方向
-    uint16_t ppuaddr;    // 2006: PPU 地址寄存器，WRITE x2
-    uint16_t ppudata;     // 2007: PPU 数据寄存器，READ/WRITE
-    uint8_t oamdma;      // 4104: OAM DMA 寄存器（高字节），WRITE
-
-    bool scroll_received_x;
-    bool addr_received_high_byte;
-    bool ready;
-
-    int mirroring, mirroring_xor;
-
-    int x, scanline;
-} ppu;
-
 /* 显示 PPU 寄存器等信息 */
-void ppu_debugger() {
+void ppu_debugger(struct nes_machine *m) {
     printf("PPU REGISTERS:\n");
-    printf("PPUCTRL:   %x\n", ppu.ppuctrl);
-    printf("PPUMASK:   %x\n", ppu.ppumask);
-    printf("PPUSTATUS: %x\n", ppu.ppustatus);
-    printf("OAMADDR:   %x\n", ppu.oamaddr);
-    printf("OAMDATA:   %x\n", ppu.oamdata);
-    printf("PPUSCROLL: %x\n", ppu.ppuscroll);
-    printf(" (X: %x, Y: %x)\n", ppu.ppuscroll_x, ppu.ppuscroll_y);
-    printf("PPUADDR:   %x\n", ppu.ppuaddr);
-    printf("PPUDATA:   %x\n", ppu.ppudata);
+    printf("PPUCTRL:   %x\n", m->ppu.ppuctrl);
+    printf("PPUMASK:   %x\n", m->ppu.ppumask);
+    printf("PPUSTATUS: %x\n", m->ppu.ppustatus);
+    printf("OAMADDR:   %x\n", m->ppu.oamaddr);
+    printf("OAMDATA:   %x\n", m->ppu.oamdata);
+    printf("PPUSCROLL: %x\n", m->ppu.ppuscroll);
+    printf(" (X: %x, Y: %x)\n", m->ppu.ppuscroll_x, m->ppu.ppuscroll_y);
+    printf("PPUADDR:   %x\n", m->ppu.ppuaddr);
+    printf("PPUDATA:   %x\n", m->ppu.ppudata);
     printf("\n");
-    printf("PPU SCANLINE: %x\n\n", ppu.scanline);
+    printf("PPU SCANLINE: %x\n\n", m->ppu.scanline);
 }
 
 
@@ -84,8 +40,8 @@ void ppu_debugger() {
  * 10: 0x2800
  * 11: 0x2c00
  */
-uint16_t ppu_base_nametable_address() {
-    switch(ppu.ppuctrl & 0x3) {
+uint16_t ppu_base_nametable_address(struct nes_machine *m) {
+    switch(m->ppu.ppuctrl & 0x3) {
         case 0: return 0x2000;
         case 1: return 0x2400;
         case 2: return 0x2800;
@@ -98,25 +54,25 @@ uint16_t ppu_base_nametable_address() {
  * 0: 自动增 1
  * 1: 自动增 32
  */
-uint8_t ppu_vram_address_increment() { return (ppu.ppuctrl & 0x04) ? 32 : 1; }
+uint8_t ppu_vram_address_increment(struct nes_machine *m) { return (m->ppu.ppuctrl & 0x04) ? 32 : 1; }
 
 /* 第 3 位：Sprite Pattern Table 首地址
  * 0: VRAM 0x0000
  * 1: VRAM 0x1000
  */
-uint16_t ppu_sprite_pattern_table_address() { return (ppu.ppuctrl & 0x08) ? 0x1000 : 0x0000; }
+uint16_t ppu_sprite_pattern_table_address(struct nes_machine *m) { return (m->ppu.ppuctrl & 0x08) ? 0x1000 : 0x0000; }
 
 /* 第 4 位：背景 Pattern Table 首地址
  * 0: VRAM 0x0000
  * 1: VRAM 0x1000
  */
-uint16_t ppu_background_pattern_table_address() { return (ppu.ppuctrl & 0x10) ? 0x1000 : 0x0000; }
+uint16_t ppu_background_pattern_table_address(struct nes_machine *m) { return (m->ppu.ppuctrl & 0x10) ? 0x1000 : 0x0000; }
 
 /* 第 5 位：Sprite 大小
  * 0: 8x8
  * 1: 8x16
  */
-uint8_t ppu_sprite_height() { return (ppu.ppuctrl & 0x20) ? 16 : 8; }
+uint8_t ppu_sprite_height(struct nes_machine *m) { return (m->ppu.ppuctrl & 0x20) ? 16 : 8; }
 
 /* 第 6 位：PPU 主从模式选择，NES 中没有使用 */
 
@@ -124,7 +80,7 @@ uint8_t ppu_sprite_height() { return (ppu.ppuctrl & 0x20) ? 16 : 8; }
  * 0: Disabled
  * 1: Enabled
  */
-bool ppu_generate_nmi() { return (ppu.ppuctrl & 0x80) ? true : false; }
+bool ppu_generate_nmi(struct nes_machine *m) { return (m->ppu.ppuctrl & 0x80) ? true : false; }
 
 /* PPUMASK ***/
 
@@ -132,75 +88,75 @@ bool ppu_generate_nmi() { return (ppu.ppuctrl & 0x80) ? true : false; }
  * 0: 彩色模式
  * 1: 灰度模式
  */
-bool ppu_render_grayscale() { return (ppu.ppumask & 0x01) ? true : false; }
+bool ppu_render_grayscale(struct nes_machine *m) { return (m->ppu.ppumask & 0x01) ? true : false; }
 
 /* 第 1 位：背景切除
  * 0: 切除左边 8 个像素列
  * 1: 不切除
  */
-bool ppu_show_background_in_leftmost_8px() { return (ppu.ppumask & 0x02) ? true : false; }
+bool ppu_show_background_in_leftmost_8px(struct nes_machine *m) { return (m->ppu.ppumask & 0x02) ? true : false; }
 
 /* 第 2 位：主角切除
  * 0: 切除左边 8 个像素列
  * 1: 不切除
  */
-bool ppu_show_sprites_in_leftmost_8px() { return (ppu.ppumask & 0x04) ? true : false; }
+bool ppu_show_sprites_in_leftmost_8px(struct nes_machine *m) { return (m->ppu.ppumask & 0x04) ? true : false; }
 
 /* 第 3 位：背景可见
  * 0: 不显示
  * 1: 显示
  */
-bool ppu_show_background() { return (ppu.ppumask & 0x08) ? true : false; }
+bool ppu_show_background(struct nes_machine *m) { return (m->ppu.ppumask & 0x08) ? true : false; }
 
 /* 第 4 位：主角可见
  * 0: 不显示
  * 1: 显示
  */
-bool ppu_show_sprites() { return (ppu.ppumask & 0x10) ? true : false; }
+bool ppu_show_sprites(struct nes_machine *m) { return (m->ppu.ppumask & 0x10) ? true : false; }
 
 /* 第 5 ~ 7 位：色彩增强 */
-bool ppu_intensify_red() { return (ppu.ppumask & 0x20) ? true : false; }
-bool ppu_intensify_green() { return (ppu.ppumask & 0x40) ? true : false; }
-bool ppu_intensify_blue() { return (ppu.ppumask & 0x80) ? true : false; }
+bool ppu_intensify_red(struct nes_machine *m) { return (m->ppu.ppumask & 0x20) ? true : false; }
+bool ppu_intensify_green(struct nes_machine *m) { return (m->ppu.ppumask & 0x40) ? true : false; }
+bool ppu_intensify_blue(struct nes_machine *m) { return (m->ppu.ppumask & 0x80) ? true : false; }
 
-void ppu_set_render_grayscale(bool val) {
-    if(val) { ppu.ppumask |= 0x01;  }
-    else    { ppu.ppumask &= ~0x01; }
+void ppu_set_render_grayscale(struct nes_machine *m, bool val) {
+    if(val) { m->ppu.ppumask |= 0x01;  }
+    else    { m->ppu.ppumask &= ~0x01; }
 }
 
-void ppu_set_show_background_in_leftmost_8px(bool val) {
-    if(val) { ppu.ppumask |= 0x01;  }
-    else    { ppu.ppumask &= ~0x01; }
+void ppu_set_show_background_in_leftmost_8px(struct nes_machine *m, bool val) {
+    if(val) { m->ppu.ppumask |= 0x01;  }
+    else    { m->ppu.ppumask &= ~0x01; }
 }
 
-void ppu_set_show_sprites_in_leftmost_8px(bool val) {
-    if(val) { ppu.ppumask |= 0x01;  }
-    else    { ppu.ppumask &= ~0x01; }
+void ppu_set_show_sprites_in_leftmost_8px(struct nes_machine *m, bool val) {
+    if(val) { m->ppu.ppumask |= 0x01;  }
+    else    { m->ppu.ppumask &= ~0x01; }
 }
 
-void ppu_set_show_background(bool val) {
-    if(val) { ppu.ppumask |= 0x01;  }
-    else    { ppu.ppumask &= ~0x01; }
+void ppu_set_show_background(struct nes_machine *m, bool val) {
+    if(val) { m->ppu.ppumask |= 0x01;  }
+    else    { m->ppu.ppumask &= ~0x01; }
 }
 
-void ppu_set_show_sprites(bool val) {
-    if(val) { ppu.ppumask |= 0x01;  }
-    else    { ppu.ppumask &= ~0x01; }
+void ppu_set_show_sprites(struct nes_machine *m, bool val) {
+    if(val) { m->ppu.ppumask |= 0x01;  }
+    else    { m->ppu.ppumask &= ~0x01; }
 }
 
-void ppu_set_intensify_red(bool val) {
-    if(val) { ppu.ppumask |= 0x01;  }
-    else    { ppu.ppumask &= ~0x01; }
+void ppu_set_intensify_red(struct nes_machine *m, bool val) {
+    if(val) { m->ppu.ppumask |= 0x01;  }
+    else    { m->ppu.ppumask &= ~0x01; }
 }
 
-void ppu_set_intensify_green(bool val) {
-    if(val) { ppu.ppumask |= 0x01;  }
-    else    { ppu.ppumask &= ~0x01; }
+void ppu_set_intensify_green(struct nes_machine *m, bool val) {
+    if(val) { m->ppu.ppumask |= 0x01;  }
+    else    { m->ppu.ppumask &= ~0x01; }
 }
 
-void ppu_set_intensify_blue(bool val) {
-    if(val) { ppu.ppumask |= 0x01;  }
-    else    { ppu.ppumask &= ~0x01; }
+void ppu_set_intensify_blue(struct nes_machine *m, bool val) {
+    if(val) { m->ppu.ppumask |= 0x01;  }
+    else    { m->ppu.ppumask &= ~0x01; }
 }
 
 /* PPUSTATUS ***/
@@ -208,34 +164,34 @@ void ppu_set_intensify_blue(bool val) {
 /* 第 5 位：Sprite Overflow
  * 同一个 Scanline 上出现超过 8 个 Sprites，该位会置一
  */
-bool ppu_sprite_overflow() { return (ppu.ppustatus & 0x20) ? 1 : 0; }
+bool ppu_sprite_overflow(struct nes_machine *m) { return (m->ppu.ppustatus & 0x20) ? 1 : 0; }
 
 /* 第 6 位：Hit Flag
  * 当 Sprite 0 的非 0 像素与背景的非零像素重叠时置 1（Set when a nonzero pixel of sprite 0 overlaps a nonzero background pixel;）
  * cleared at dot 1 of the pre-render line
  */
-bool ppu_sprite_0_hit() { return (ppu.ppustatus & 0x40) ? 1 : 0; }
+bool ppu_sprite_0_hit(struct nes_machine *m) { return (m->ppu.ppustatus & 0x40) ? 1 : 0; }
 
 /* 第 7 位：Vblank 标志
  * 0: 没有进行 Vblank
  * 1: 正在进行 Vblank
  * cleared after reading $2002 and at dot 1 of the pre-render line
  */
-bool ppu_in_vblank() { return (ppu.ppustatus & 0x80) ? 1 : 0; }
+bool ppu_in_vblank(struct nes_machine *m) { return (m->ppu.ppustatus & 0x80) ? 1 : 0; }
 
-void ppu_set_sprite_overflow(bool val) {
-    if(val) { ppu.ppustatus |= 0x20;  }
-    else    { ppu.ppustatus &= ~0x20; }
+void ppu_set_sprite_overflow(struct nes_machine *m, bool val) {
+    if(val) { m->ppu.ppustatus |= 0x20;  }
+    else    { m->ppu.ppustatus &= ~0x20; }
 }
 
-void ppu_set_sprite_0_hit(bool val) {
-    if(val) { ppu.ppustatus |= 0x40;  }
-    else    { ppu.ppustatus &= ~0x40; }
+void ppu_set_sprite_0_hit(struct nes_machine *m, bool val) {
+    if(val) { m->ppu.ppustatus |= 0x40;  }
+    else    { m->ppu.ppustatus &= ~0x40; }
 }
 
-void ppu_set_in_vblank(bool val) {
-    if(val) { ppu.ppustatus |= 0x80;  }
-    else    { ppu.ppustatus &= ~0x80; }
+void ppu_set_in_vblank(struct nes_machine *m, bool val) {
+    if(val) { m->ppu.ppustatus |= 0x80;  }
+    else    { m->ppu.ppustatus &= ~0x80; }
 }
 
 /******** PPU 内存操作 ********/
@@ -286,189 +242,403 @@ void ppu_set_in_vblank(bool val) {
  */
 
 
-uint16_t ppu_get_real_ram_address(uint16_t address) {
-    if(address < 0x3f00) { return address; }
-    else if(address < 0x4000) {
-        /* Palettes (调色板) 内存 */
-        address = 0x3f00 | (address & 0x1f); // 地址 $3F20-$3FFF 是地址 3F00-$3F1F 的镜像
-        if(address == 0x3f10 || address == 0x3f14 || address == 0x3f18 || address == 0x3f1c) {
-            // 地址 $3F10/$3F14/$3F18/$3F1C 是地址 $3F00/$3F04/$3F08/$3F0C 的镜像
-            return address - 0x10;
-        } else {
-            return address;
-        }
-    }
-    return 0xffff;  // 地址错误
+/* 调色板 (3F00 ~ 3FFF) 在 m->ppu_palette 中的位置 */
+static int ppu_palette_index(uint16_t address) {
+    int index = address & 0x1f;                     // 地址 $3F20-$3FFF 是地址 3F00-$3F1F 的镜像
+    if((index & 0x13) == 0x10) { index &= 0x0f; }  // 地址 $3F10/$3F14/$3F18/$3F1C 是地址 $3F00/$3F04/$3F08/$3F0C 的镜像
+    return index;
 }
 
-uint8_t ppu_ram_read(uint16_t address) {
-    return ppu_ram[ppu_get_real_ram_address(address)];
+/* 更新 m->ppu_palette_color, 灰度模式时只保留颜色编号的第 4, 5 位 (即每一行的第一个颜色) */
+static void ppu_update_palette(struct nes_machine *m) {
+    uint8_t mask = ppu_render_grayscale(m) ? 0x30 : 0x3f;
+    int i;
+    for(i = 0; i < 0x20; i++) { m->ppu_palette_color[i] = m->ppu_palette[ppu_palette_index(i)] & mask; }
 }
 
-void ppu_ram_write(uint16_t address, uint8_t data) {
-    ppu_ram[ppu_get_real_ram_address(address)] = data;
+/* Pattern Table (0000 ~ 1FFF) 通过 Mapper 设置的 m->ppu_chr_bank 访问 CHR ROM,
+ * Nametable (2000 ~ 3EFF, 3000 以上为镜像) 通过 m->ppu_nametable 中的 4 个指针访问 (见 ppu_set_mirroring)
+ */
+uint8_t ppu_ram_read(struct nes_machine *m, uint16_t address) {
+    address &= 0x3fff;
+    if(address < 0x2000) { return m->ppu_chr_bank[address >> 10][address & 0x3ff]; }
+    if(address < 0x3f00) { return m->ppu_nametable[(address >> 10) & 3][address & 0x3ff]; }
+    return m->ppu_palette[ppu_palette_index(address)];
 }
 
-/******** 图像渲染 ********/
-
-void ppu_draw_background_scanline(bool mirror) {
-    int tile_x;
-    for(tile_x = (ppu_show_background_in_leftmost_8px() ? 0 : 1); tile_x < 32; tile_x++) {
-        /* 跳过屏幕外的像素 */
-        if(((tile_x << 3) - ppu.ppuscroll_x + (mirror ? 256 : 0)) > 256) continue;
+/* 只有 CHR RAM 可以写入 */
+void ppu_ram_write(struct nes_machine *m, uint16_t address, uint8_t data) {
+    address &= 0x3fff;
+    if(address < 0x2000) {
+        if(m->cartridge.chr_ram) {
+            m->ppu_chr_bank[address >> 10][address & 0x3ff] = data;
+            ppu_tile_cache_write(m, address);
+        }
+        return;
+    }
+    if(address < 0x3f00) { m->ppu_nametable[(address >> 10) & 3][address & 0x3ff] = data; }
+    else {
+        m->ppu_palette[ppu_palette_index(address)] = data;
+        ppu_update_palette(m);
+    }
+}
 
-        /* 通过 tile 在屏幕上的位置，获取 tile 在内存中的地址 */
-        int tile_y = ppu.scanline >> 3;
-        int tile_index = ppu_ram_read(ppu_base_nametable_address() + tile_x + (tile_y << 5) + (mirror ? 0x400 : 0));
-        uint16_t tile_address = ppu_background_pattern_table_address() + 16 * tile_index;
+/******** 图像渲染 ********/
 
-        /* */
-        int y_in_tile = ppu.scanline & 0x7;
-        uint8_t l = ppu_ram_read(tile_address + y_in_tile);
-        uint8_t h = ppu_ram_read(tile_address + y_in_tile + 8);
+/* 画面直接写入 m->ppu_framebuffer, 每个像素为一个字节的颜色编号 (0 ~ 63, 见 ppu.h 中的 palette).
+ * 每条扫描线先填充背景色 ($3F00), 再依次绘制背景与 Sprites, 绘制 Sprites 时处理优先级:
+ *   - OAM 中靠前的 Sprite 优先, 其不透明的像素会挡住之后的 Sprites (即使它位于背景之后)
+ *   - 位于背景之后的 Sprite 只在背景透明 (颜色 0) 的位置显示, 背景不透明的像素记录在 m->ppu_background_mask 中
+ * 设置了 RGB 输出时 (ppu_set_rgb_output), 每条扫描线绘制完成后通过 m->ppu_rgb_table 查表转换, 写入调用者提供的缓冲区.
+ * 调色板中的颜色编号 (包括灰度模式) 预先计算在 m->ppu_palette_color 中, 绘制时不再访问 PPU 地址空间.
+ *
+ * 绘制是延迟进行的 (ppu_catch_up): m->ppu.render_line, render_x 记录已经绘制到的位置,
+ * 只有在 CPU 写入 PPU 寄存器, OAM DMA, Mapper 切换 CHR Bank 或镜像方式时, 以及一帧的可见部分结束时,
+ * 才将画面一次绘制到当前的位置. 没有在画面中途修改状态的帧在第 240 条扫描线一次绘制完成,
+ * 在画面中途修改滚动位置等时, 修改之前与之后的像素分别使用修改之前与之后的状态绘制.
+ */
 
+/* 绘制一条扫描线的背景, mask 中记录背景不透明的像素
+ *
+ * 四个 Nametable 排列为 512 x 480 的画面, 屏幕左上角位于 (PPUSCROLL X + PPUCTRL 第 0 位 * 256,
+ * PPUSCROLL Y + PPUCTRL 第 1 位 * 240), 超出右边或下边时回到另一侧 (由镜像方式决定实际使用的 Nametable).
+ * 精细滚动 (X 的低 3 位) 不为 0 时, 一条扫描线覆盖 33 个 tile, 每个 tile 只读取一次 Nametable 与属性表.
+ * 垂直滚动为 240 ~ 255 时, 先显示属性表中的数据, 之后回到同一个 Nametable 的顶部 (与实际的 PPU 相同).
+ */
+static void ppu_draw_background_scanline(struct nes_machine *m, int scanline, uint8_t *row, uint64_t *mask) {
+    uint16_t pattern = ppu_background_pattern_table_address(m) >> 4;
+    uint16_t nametable = (m->ppu.ppuctrl & 1) ? 0x400 : 0;
+    int scroll_x = m->ppu.ppuscroll_x;
+    int y = scanline + m->ppu.frame_scroll_y;
+    int left = ppu_show_background_in_leftmost_8px(m) ? 0 : 8;
+    int coarse_y, fine_y, tile;
+
+    if(m->ppu.frame_nametable_y) { nametable |= 0x800; }
+    if(m->ppu.frame_scroll_y < 240 && y >= 240) {
+        y -= 240;
+        nametable ^= 0x800;
+    } else {
+        y &= 0xff;
+    }
+    coarse_y = y >> 3;
+    fine_y = y & 7;
+
+    for(tile = 0; tile < 33; tile++) {
+        int coarse_x = ((scroll_x >> 3) + tile) & 0x3f;  // 0 ~ 63, 32 及以上为右边的 Nametable
+        const uint8_t *base = m->ppu_nametable[(nametable ^ ((coarse_x & 0x20) ? 0x400 : 0)) >> 10];
+        int tile_x = coarse_x & 0x1f;
+        int screen_x = (tile << 3) - (scroll_x & 7);
         int x;
-        for(x = 0; x < 8; x++) {
-            uint8_t color = ppu_l_h_addition_table[l][h][x];
-
-            if(color != 0) {  // 颜色 0 为透明
-                uint16_t attribute_address = (ppu_base_nametable_address() + (mirror ? 0x400 : 0) + 0x3c0 + (tile_x >> 2) + (ppu.scanline >> 5) * 8);
-                bool top = (ppu.scanline % 32) < 16;
-                bool left = (tile_x % 32) < 16;
-
-                uint8_t palette_attribute = ppu_ram_read(attribute_address);
 
-                if(!top) { palette_attribute >>= 4; }
-                if(!left) { palette_attribute >>= 2;}
-                palette_attribute &= 3;
+        uint8_t tile_index = base[(coarse_y << 5) + tile_x];
+        uint64_t pixels = ppu_tile_rows(m, pattern + tile_index, false)[fine_y];
 
-                uint16_t palette_address = 0x3f00 + (palette_attribute << 2);
-                int idx = ppu_ram_read(palette_address + color);
+        /* 每个属性字节对应 4 x 4 个 tile, 每 2 位对应其中的 2 x 2 个 tile */
+        uint8_t attribute = base[0x3c0 + ((coarse_y >> 2) << 3) + (tile_x >> 2)];
+        const uint8_t *palette = &m->ppu_palette_color[((attribute >> (((coarse_y & 2) << 1) | (tile_x & 2))) & 3) << 2];
 
-                ppu_screen_background[(tile_x << 3) + x][ppu.scanline] = color;
-
-                pixelbuf_add(bg, (tile_x << 3) + x - ppu.ppuscroll_x + (mirror ? 256 : 0), ppu.scanline + 1, idx);
+        for(x = 0; x < 8; x++, screen_x++) {
+            int color = PPU_TILE_PIXEL(pixels, x);
+            if(screen_x < left || screen_x >= SCREEN_WIDTH) { continue; }
+            if(color != 0) {  // 颜色 0 为透明
+                row[screen_x] = palette[color];
+                mask[screen_x >> 6] |= 1ULL << (screen_x & 63);
             }
         }
     }
 }
 
-void ppu_draw_sprite_scanline() {
-    int scanline_sprite_count = 0;
-    int n;
-    for(n = 0; n < 0x100; n += 4) {
-        uint8_t sprite_x = ppu_sprram[n + 3];
-        uint8_t sprite_y = ppu_sprram[n];
-
-        /* 跳过不在 Scanline 上的 Sprite */
-        if(sprite_y > ppu.scanline || sprite_y + ppu_sprite_height() < ppu.scanline) { continue; }
-
-        scanline_sprite_count++;
+/* 将 OAM 中的 Sprites 按扫描线分组, Sprite 的图像比 OAM 中的 Y 坐标晚一条扫描线显示,
+ * 每条扫描线只保留 OAM 中最靠前的 8 个, 超过时设置 overflow
+ */
+static void ppu_evaluate_sprites(struct nes_machine *m) {
+    struct _ppu_sprite_lines *lines = &m->ppu_sprite_lines;
+    int height = ppu_sprite_height(m);
+    int n, y;
+
+    memset(lines->count, 0, sizeof(lines->count));
+    memset(lines->overflow, 0, sizeof(lines->overflow));
+    for(n = 0; n < 64; n++) {
+        int top = m->ppu_sprram[n << 2] + 1;
+        for(y = top; y < top + height && y < SCREEN_HEIGHT; y++) {
+            if(lines->count[y] < 8) { lines->sprite[y][lines->count[y]++] = n; }
+            else { lines->overflow[y] = true; }
+        }
+    }
+    lines->dirty = false;
+}
 
-        /* 每行不能出现超过 8 个 Sprites */
-        if(scanline_sprite_count > 8) { ppu_set_sprite_overflow(true); }
+/* Sprite 0 的不透明像素与背景的不透明像素重叠时, 在扫描到第一个重叠的像素时设置 Sprite 0 hit 标志.
+ * 将 Sprite 0 的一行转换为与 mask 相同的 256 位掩码, 两者按位与的最低位即为发生的位置.
+ * 第 255 个像素, 以及左边 8 个像素被切除时的 0 ~ 7 不会发生. 只检查 from_x 及之后的像素.
+ */
+static void ppu_check_sprite_0_hit(struct nes_machine *m, uint64_t pixels, int sprite_x, const uint64_t *mask, int from_x) {
+    uint64_t sprite[4] = { 0, 0, 0, 0 };
+    uint64_t bits = 0;
+    int x;
 
-        bool vflip = ppu_sprram[n + 2] & 0x80;
-        bool hflip = ppu_sprram[n + 2] & 0x40;
+    for(x = 0; x < 8; x++) {
+        if(PPU_TILE_PIXEL(pixels, x) != 0) { bits |= 1ULL << x; }
+    }
+    sprite[sprite_x >> 6] = bits << (sprite_x & 63);
+    if((sprite_x & 63) > 56 && sprite_x < 192) { sprite[(sprite_x >> 6) + 1] = bits >> (64 - (sprite_x & 63)); }
+
+    sprite[3] &= ~(1ULL << 63);
+    if(!ppu_show_background_in_leftmost_8px(m) || !ppu_show_sprites_in_leftmost_8px(m)) { sprite[0] &= ~0xffULL; }
+
+    for(x = 0; x < 4; x++) {
+        int skip = from_x - (x << 6);
+        uint64_t hit;
+        if(skip >= 64) { continue; }
+        if(skip > 0) { sprite[x] &= ~0ULL << skip; }
+        hit = sprite[x] & mask[x];
+        if(hit) {
+            int screen_x = (x << 6) + __builtin_ctzll(hit);
+            m->ppu.sprite_hit_time = m->ppu.scanline_time + screen_x * SCHEDULER_PPU_CLOCK_DIVIDER;
+            scheduler_schedule(m, SCHEDULER_EVENT_SPRITE_0_HIT, m->ppu.sprite_hit_time);
+            m->ppu.sprite_hit_occured = true;
+            return;
+        }
+    }
+}
 
-        uint16_t tile_address = ppu_sprite_pattern_table_address() + 16 * ppu_sprram[n + 1];
-        int y_in_tile = ppu.scanline & 0x7;
-        uint8_t l = ppu_ram_read(tile_address + (vflip ? (7 - y_in_tile) : y_in_tile));
-        uint8_t h = ppu_ram_read(tile_address + (vflip ? (7 - y_in_tile) : y_in_tile) + 8);
+/* 第 n 个 Sprite 在扫描线 scanline 上的一行像素 */
+static uint64_t ppu_sprite_row(struct nes_machine *m, int n, int scanline) {
+    uint8_t tile_index = m->ppu_sprram[(n << 2) + 1];
+    uint8_t attribute = m->ppu_sprram[(n << 2) + 2];
+    int y_in_sprite = scanline - m->ppu_sprram[n << 2] - 1;
+    int tile;
+
+    /* 8x16 的 Sprite 由 tile 编号的第 0 位选择 Pattern Table, 上半部分为偶数编号的 tile, 下半部分为下一个 tile */
+    if(ppu_sprite_height(m) == 16) {
+        if(attribute & 0x80) { y_in_sprite = 15 - y_in_sprite; }
+        tile = ((tile_index & 1) << 8) + (tile_index & 0xfe) + (y_in_sprite >> 3);
+    } else {
+        if(attribute & 0x80) { y_in_sprite = 7 - y_in_sprite; }
+        tile = (ppu_sprite_pattern_table_address(m) >> 4) + tile_index;
+    }
+    return ppu_tile_rows(m, tile, attribute & 0x40)[y_in_sprite & 7];
+}
 
-        uint8_t palette_attribute = ppu_sprram[n + 2] & 0x3;
-        uint16_t palette_address = 0x3f10 + (palette_attribute << 2);
+/* 绘制一条扫描线的 Sprites */
+static void ppu_draw_sprite_scanline(struct nes_machine *m, int scanline, uint8_t *row, const uint64_t *mask) {
+    struct _ppu_sprite_lines *lines = &m->ppu_sprite_lines;
+    uint8_t drawn[SCREEN_WIDTH];  // 已经有 Sprite 不透明像素的位置
+    int i;
+
+    if(lines->dirty) { ppu_evaluate_sprites(m); }
+
+    memset(drawn, 0, sizeof(drawn));
+    for(i = 0; i < lines->count[scanline]; i++) {
+        int n = lines->sprite[scanline][i];
+        uint8_t sprite_x = m->ppu_sprram[(n << 2) + 3];
+        uint8_t attribute = m->ppu_sprram[(n << 2) + 2];
+        bool behind = attribute & 0x20;
+        const uint8_t *palette = &m->ppu_palette_color[0x10 | ((attribute & 0x3) << 2)];
+        uint64_t pixels = ppu_sprite_row(m, n, scanline);
         int x;
         for(x = 0; x < 8; x++) {
-            int color = hflip ? ppu_l_h_addition_flip_table[l][h][x] : ppu_l_h_addition_table[l][h][x];
+            int color = PPU_TILE_PIXEL(pixels, x);
+            int screen_x = sprite_x + x;
 
             /* color 0 为透明 */
-            if(color != 0) {
-                int screen_x = sprite_x + x;
-                int idx = ppu_ram_read(palette_address + color);
-
+            if(color != 0 && screen_x < SCREEN_WIDTH) {
                 // http://wiki.nesdev.com/w/index.php/PPU_sprite_priority
-                if(ppu_sprram[n + 2] & 0x20) { // 位于背景之后
-                    pixelbuf_add(bbg, screen_x, sprite_y + y_in_tile + 1, idx);
-                } else {                       // 位于背景之前
-                    pixelbuf_add(fg, screen_x, sprite_y + y_in_tile + 1, idx);
-                }
-
-                /* 检查是否发生 sprite 0 hit, 并更新寄存器 */
-                if(ppu_show_background() && !ppu_sprite_hit_occured && n == 0 && ppu_screen_background[screen_x][sprite_y + y_in_tile] == color) {
-                    ppu_set_sprite_0_hit(true);
-                    ppu_sprite_hit_occured = true;
+                if(!drawn[screen_x]) {
+                    drawn[screen_x] = 1;
+                    if(!behind || !((mask[screen_x >> 6] >> (screen_x & 63)) & 1)) {
+                        row[screen_x] = palette[color];
+                    }
                 }
             }
         }
     }
 }
 
+/* 绘制第 scanline 条扫描线中 x0 ~ x1-1 的像素, 只绘制一部分时先绘制到临时缓冲区 */
+static void ppu_draw_scanline(struct nes_machine *m, int scanline, int x0, int x1) {
+    uint8_t buffer[SCREEN_WIDTH];
+    uint8_t *row = (x0 == 0 && x1 == SCREEN_WIDTH) ? m->ppu_framebuffer[scanline] : buffer;
+    uint64_t *mask = m->ppu_background_mask[scanline];
+    int x;
+
+    memset(row, m->ppu_palette_color[0], SCREEN_WIDTH);
+    memset(mask, 0, sizeof(m->ppu_background_mask[0]));
+    if(ppu_show_background(m)) { ppu_draw_background_scanline(m, scanline, row, mask); }
+    if(ppu_show_sprites(m)) { ppu_draw_sprite_scanline(m, scanline, row, mask); }
+    if(row == buffer) { memcpy(m->ppu_framebuffer[scanline] + x0, buffer + x0, x1 - x0); }
+
+    /* PPUMASK 的色彩增强位选择 m->ppu_rgb_table 中的一组 */
+    if(m->ppu_rgb_buffer != NULL) {
+        const uint32_t *table = m->ppu_rgb_table + ((m->ppu.ppumask >> 5) << 6);
+        if(m->ppu_rgb_format == PPU_PIXEL_RGB565) {
+            uint16_t *rgb = (uint16_t *)m->ppu_rgb_buffer + scanline * SCREEN_WIDTH;
+            for(x = x0; x < x1; x++) { rgb[x] = (uint16_t)table[row[x]]; }
+        } else {
+            uint32_t *rgb = (uint32_t *)m->ppu_rgb_buffer + scanline * SCREEN_WIDTH;
+            for(x = x0; x < x1; x++) { rgb[x] = table[row[x]]; }
+        }
+    }
+}
+
+/* 当前在扫描线上的位置 (0 ~ 256), 即当前扫描线开始之后经过的 PPU Cycle 数 */
+static int ppu_scanline_x(struct nes_machine *m) {
+    int64_t cycles = (int64_t)(scheduler_clock(m) - m->ppu.scanline_time) / SCHEDULER_PPU_CLOCK_DIVIDER;
+    return cycles < 0 ? 0 : (cycles > SCREEN_WIDTH ? SCREEN_WIDTH : (int)cycles);
+}
+
+/* 将画面绘制到当前的位置 (ppu_scanline_x),
+ * 在修改影响画面的状态 (PPU 寄存器, OAM, CHR Bank, 镜像方式) 之前调用, 这样之前的像素使用修改之前的状态绘制.
+ */
+void ppu_catch_up(struct nes_machine *m) {
+    int scanline = m->ppu.scanline, x = 0;
+
+    if(m->ppu.render_line >= SCREEN_HEIGHT || scanline < 0) { return; }
+    if(scanline >= SCREEN_HEIGHT) {
+        scanline = SCREEN_HEIGHT;
+    } else {
+        x = ppu_scanline_x(m);
+    }
+
+    while(m->ppu.render_line < scanline || (m->ppu.render_line == scanline && m->ppu.render_x < x)) {
+        int end = m->ppu.render_line < scanline ? SCREEN_WIDTH : x;
+        ppu_draw_scanline(m, m->ppu.render_line, m->ppu.render_x, end);
+        if(end == SCREEN_WIDTH) {
+            m->ppu.render_line++;
+            m->ppu.render_x = 0;
+        } else {
+            m->ppu.render_x = end;
+        }
+    }
+}
+
+/* 根据当前的状态检查当前扫描线 from_x 及之后的像素是否会发生 Sprite 0 hit.
+ * Sprite 0 hit 需要在扫描线上按时设置, 不能等到绘制时, 因此需要单独绘制一次该扫描线的背景.
+ */
+static void ppu_predict_sprite_0_hit(struct nes_machine *m, int from_x) {
+    struct _ppu_sprite_lines *lines = &m->ppu_sprite_lines;
+    int scanline = m->ppu.scanline;
+    uint8_t row[SCREEN_WIDTH];
+    uint64_t *mask = m->ppu_background_mask[scanline];
+
+    if(m->ppu.sprite_hit_occured || !ppu_show_background(m) || !ppu_show_sprites(m)) { return; }
+    if(lines->dirty) { ppu_evaluate_sprites(m); }
+    if(lines->count[scanline] == 0 || lines->sprite[scanline][0] != 0) { return; }
+    memset(mask, 0, sizeof(m->ppu_background_mask[0]));
+    ppu_draw_background_scanline(m, scanline, row, mask);
+    ppu_check_sprite_0_hit(m, ppu_sprite_row(m, 0, scanline), m->ppu_sprram[3], mask, from_x);
+}
+
+/* 扫描线开始时, 根据该扫描线的 Sprites 设置 Sprite overflow 标志, 并检查是否会发生 Sprite 0 hit */
+static void ppu_evaluate_scanline(struct nes_machine *m) {
+    struct _ppu_sprite_lines *lines = &m->ppu_sprite_lines;
+
+    if(!ppu_show_sprites(m)) { return; }
+    if(lines->dirty) { ppu_evaluate_sprites(m); }
+    if(lines->overflow[m->ppu.scanline]) { ppu_set_sprite_overflow(m, true); }
+    ppu_predict_sprite_0_hit(m, 0);
+}
+
+/* 在扫描线中途修改影响 Sprite 0 hit 的状态 (PPU 寄存器, OAM, CHR Bank, 镜像方式) 之后调用,
+ * 取消还没有发生的 Sprite 0 hit, 并根据修改之后的状态重新检查该扫描线剩余的部分
+ */
+void ppu_update_sprite_0_hit(struct nes_machine *m) {
+    if(m->ppu.scanline < 0 || m->ppu.scanline >= SCREEN_HEIGHT) { return; }
+    if(m->ppu.sprite_hit_occured) {
+        if(m->ppu.sprite_hit_time <= scheduler_clock(m)) { return; }
+        scheduler_cancel(m, SCHEDULER_EVENT_SPRITE_0_HIT);
+        m->ppu.sprite_hit_occured = false;
+    }
+    ppu_predict_sprite_0_hit(m, ppu_scanline_x(m));
+}
+
+/* 设置 RGB 输出: 画面按 format 转换后写入 buffer (256 x 240, RGB565 时每个像素 2 字节, 其他为 4 字节),
+ * buffer 为 NULL 时不输出. 与 m->ppu_framebuffer 不同, RGB 输出包含色彩增强的效果.
+ */
+void ppu_set_rgb_output(struct nes_machine *m, void *buffer, enum ppu_pixel_format format) {
+    m->ppu_rgb_buffer = buffer;
+    m->ppu_rgb_format = format;
+    ppu_palette_build(m->ppu_rgb_table, format);
+}
+
 
 /******** PPU Lifecycle ********/
 
-void ppu_cycle() {
-    // 这样更符合实际情况: if(!ppu.ready && cpu_clock() > 29658) { ppu.ready = true; }
+/* Sprite 0 hit 事件 */
+static void ppu_sprite_0_hit_event(struct nes_machine *m) {
+    ppu_set_sprite_0_hit(m, true);
+}
+
+/* 处理一条扫描线, 由 SCHEDULER_EVENT_SCANLINE 事件调用
+ * 每帧 262 条扫描线: 0 ~ 239 为可见部分, 240 ~ 260 为 VBlank, 第 261 条 (pre-render) 记为 -1
+ */
+void ppu_cycle(struct nes_machine *m) {
+    // 这样更符合实际情况: if(!m->ppu.ready && cpu_clock(m) > 29658) { m->ppu.ready = true; }
     // http://wiki.nesdev.com/w/index.php/PPU_power_up_state
-    if(!ppu.ready && cpu_clock() > 1) { ppu.ready = true; }
-    ppu.scanline++;
-    if(ppu_show_background()) {
-        ppu_draw_background_scanline(false);
-        ppu_draw_background_scanline(true);
+    if(!m->ppu.ready && cpu_clock(m) > 1) { m->ppu.ready = true; }
+    m->ppu.scanline++;
+    m->ppu.scanline_time = scheduler_clock(m);
+    if(m->ppu.scanline == 0) {
+        m->ppu.frame_scroll_y = m->ppu.ppuscroll_y;
+        m->ppu.frame_nametable_y = (m->ppu.ppuctrl & 2) ? true : false;
+        m->ppu.render_line = 0;
+        m->ppu.render_x = 0;
+    }
+    if(m->ppu.scanline < SCREEN_HEIGHT) {
+        ppu_evaluate_scanline(m);
+    } else if(m->ppu.scanline == SCREEN_HEIGHT) {
+        ppu_catch_up(m);  // 绘制这一帧剩余的部分
     }
-    if(ppu_show_sprites()) { ppu_draw_sprite_scanline(); }
-    if(ppu.scanline == 241) {
-        ppu_set_in_vblank(true);
-        ppu_set_sprite_0_hit(false);
-        cpu_interrupt();
-    } else if(ppu.scanline == 262) {
-        ppu.scanline = -1;
-        ppu_sprite_hit_occured = false;
-        ppu_set_in_vblank(false);
+    if(m->ppu.scanline == 241) {
+        ppu_set_in_vblank(m, true);
+        ppu_set_sprite_0_hit(m, false);
+        scheduler_cancel(m, SCHEDULER_EVENT_SPRITE_0_HIT);
+        scheduler_schedule(m, SCHEDULER_EVENT_NMI, scheduler_clock(m));
+    } else if(m->ppu.scanline == 261) {
+        m->ppu.scanline = -1;
+        m->ppu.sprite_hit_occured = false;
+        ppu_set_in_vblank(m, false);
+        ppu_set_sprite_overflow(m, false);
         /* 一帧画面扫描结束，刷新屏幕 */
-        emu_update_screen();
+        if(m->frontend.frame_ready != NULL) { m->frontend.frame_ready(m->frontend.user, m); }
     }
 }
 
-void ppu_run(int cycles) {
+void ppu_run(struct nes_machine *m, int cycles) {
     while(cycles-- > 0) {
-        ppu_cycle();
+        ppu_cycle(m);
     }
 }
 
-void ppu_copy(uint16_t address, uint8_t *source, int length) {
-    memcpy(&ppu_ram[address], source, length);
-}
-
-uint8_t ppu_io_read(uint16_t address) {
+uint8_t ppu_io_read(struct nes_machine *m, uint16_t address) {
     uint8_t data; uint16_t value;
-    ppu.ppuaddr &= 0x3fff;
+    m->ppu.ppuaddr &= 0x3fff;
     switch(address & 7) {
         case 2:
-            value = ppu.ppustatus;
-            ppu_set_in_vblank(false);
-            ppu_set_sprite_0_hit(false);
-            ppu.scroll_received_x = 0;
-            ppu.ppuscroll = 0;
-            ppu.addr_received_high_byte = 0;
-            ppu_latch = value;
-            ppu_addr_latch = 0;
-            ppu_2007_first_read = true;
+            value = m->ppu.ppustatus;
+            ppu_set_in_vblank(m, false);
+            ppu_set_sprite_0_hit(m, false);
+            m->ppu.scroll_received_x = 0;
+            m->ppu.ppuscroll = 0;
+            m->ppu.addr_received_high_byte = 0;
+            m->ppu.latch = value;
+            m->ppu.addr_latch = 0;
+            m->ppu.first_read_2007 = true;
             return value;
         case 4:
-            return ppu_latch = ppu_sprram[ppu.oamaddr];
+            return m->ppu.latch = m->ppu_sprram[m->ppu.oamaddr];
         case 7:
-            if(ppu.ppuaddr < 0x3f00) {
-                data = ppu_ram_read(ppu.ppuaddr);
-                ppu_latch = 0;
+            if(m->ppu.ppuaddr < 0x3f00) {
+                data = ppu_ram_read(m, m->ppu.ppuaddr);
+                m->ppu.latch = 0;
             } else {
-                data = ppu_ram_read(ppu.ppuaddr);
-                ppu_latch = 0;
+                data = ppu_ram_read(m, m->ppu.ppuaddr);
+                m->ppu.latch = 0;
             }
-            if(ppu_2007_first_read) {
-                ppu_2007_first_read = false;
+            if(m->ppu.first_read_2007) {
+                m->ppu.first_read_2007 = false;
             } else {
-                ppu.ppuaddr += ppu_vram_address_increment();
+                m->ppu.ppuaddr += ppu_vram_address_increment(m);
             }
             return data;
         default:
@@ -476,67 +646,93 @@ uint8_t ppu_io_read(uint16_t address) {
     }
 }
 
-void ppu_io_write(uint16_t address, uint8_t data) {
+void ppu_io_write(struct nes_machine *m, uint16_t address, uint8_t data) {
+    ppu_catch_up(m);
     address &= 7;
-    ppu_latch = data;
-    ppu.ppuaddr &= 0x3fff;
+    m->ppu.latch = data;
+    m->ppu.ppuaddr &= 0x3fff;
     switch(address) {
-        case 0: if(ppu.ready) { ppu.ppuctrl = data; } break;
-        case 1: if(ppu.ready) { ppu.ppumask = data; } break;
-        case 3: ppu.oamaddr = data; break;
-        case 4: ppu_sprram[ppu.oamaddr++] = data; break;
+        case 0:
+            if(!m->ppu.ready) { return; }
+            if((m->ppu.ppuctrl ^ data) & 0x20) { m->ppu_sprite_lines.dirty = true; }
+            m->ppu.ppuctrl = data;
+            break;
+        case 1:
+            if(!m->ppu.ready) { break; }
+            m->ppu.ppumask = data;
+            ppu_update_palette(m);
+            break;
+        case 3: m->ppu.oamaddr = data; break;
+        case 4: m->ppu_sprram[m->ppu.oamaddr++] = data; m->ppu_sprite_lines.dirty = true; break;
         case 5:
-            if(ppu.scroll_received_x) { ppu.ppuscroll_y = data; }
-            else { ppu.ppuscroll_x = data; }
-            ppu.scroll_received_x ^= 1;
+            if(m->ppu.scroll_received_x) { m->ppu.ppuscroll_y = data; }
+            else { m->ppu.ppuscroll_x = data; }
+            m->ppu.scroll_received_x ^= 1;
             break;
         case 6:
-            if(!ppu.ready) { return; }
-            if(ppu.addr_received_high_byte) { ppu.ppuaddr = (ppu_addr_latch << 8) + data; }
-            else { ppu_addr_latch = data; }
-            ppu.addr_received_high_byte ^= 1;
-            ppu_2007_first_read = true;
+            if(!m->ppu.ready) { return; }
+            if(m->ppu.addr_received_high_byte) { m->ppu.ppuaddr = (m->ppu.addr_latch << 8) + data; }
+            else { m->ppu.addr_latch = data; }
+            m->ppu.addr_received_high_byte ^= 1;
+            m->ppu.first_read_2007 = true;
             break;
         case 7:
-            if(ppu.ppuaddr > 0x1fff || ppu.ppuaddr < 0x4000) {
-                ppu_ram_write(ppu.ppuaddr ^ ppu.mirroring_xor, data);
-                ppu_ram_write(ppu.ppuaddr, data);
-            } else {
-                ppu_ram_write(ppu.ppuaddr, data);
-            }
-    }
-    ppu_latch = data;
-}
-
-void ppu_init() {
-    ppu.ppuctrl = 0; ppu.ppumask = 0; ppu.ppustatus = 0; ppu.oamaddr = 0;
-    ppu.ppuscroll = 0; ppu.ppuscroll_x = 0; ppu.ppuscroll_y = 0; ppu.ppuaddr = 0;
-    ppu.ppustatus |= 0xa0;
-    ppu.ppudata = 0;
-    ppu_2007_first_read = 0;
-
-    ppu.ready = false;
-
-    int l, h, x;
-    for(h = 0; h < 0x100; h++) {
-        for(l = 0; l < 0x100; l++) {
-            for(x = 0; x < 8; x++) {
-                ppu_l_h_addition_table[l][h][x] = (((h >> (7 - x)) & 1) << 1) | ((l >> (7 - x)) & 1);
-                ppu_l_h_addition_flip_table[l][h][x] = (((h >> x) & 1) << 1) | ((l >> x) & 1);
-            }
-        }
+            ppu_ram_write(m, m->ppu.ppuaddr, data);
+            m->ppu.ppuaddr += ppu_vram_address_increment(m);
+            break;
     }
+    m->ppu.latch = data;
+    ppu_update_sprite_0_hit(m);
 }
 
-void ppu_sprram_write(uint8_t data) {
-    ppu_sprram[ppu.oamaddr++] = data;
+void ppu_init(struct nes_machine *m) {
+    m->ppu.ppuctrl = 0; m->ppu.ppumask = 0; m->ppu.ppustatus = 0; m->ppu.oamaddr = 0;
+    m->ppu.ppuscroll = 0; m->ppu.ppuscroll_x = 0; m->ppu.ppuscroll_y = 0; m->ppu.ppuaddr = 0;
+    m->ppu.frame_scroll_y = 0; m->ppu.frame_nametable_y = false;
+    m->ppu.render_line = (m->ppu.scanline >= 0 && m->ppu.scanline < SCREEN_HEIGHT) ? m->ppu.scanline + 1 : SCREEN_HEIGHT;
+    m->ppu.render_x = 0;
+    m->ppu.ppustatus |= 0xa0;
+    m->ppu.ppudata = 0;
+    m->ppu.first_read_2007 = 0;
+
+    m->ppu.ready = false;
+
+    scheduler_register(m, SCHEDULER_EVENT_SPRITE_0_HIT, ppu_sprite_0_hit_event);
+    ppu_tile_init(m);
+    ppu_tile_cache_invalidate(m, 0x0000, 0x2000);
+    m->ppu_sprite_lines.dirty = true;
+    ppu_update_palette(m);
 }
 
-void ppu_set_background_color(uint8_t color) {
-    set_bg_color(color);
+/* OAM DMA, 从 OAMADDR 开始写入 256 字节, 超过 FF 后回到 00, 完成后 OAMADDR 不变 */
+void ppu_oam_dma(struct nes_machine *m, const uint8_t *data) {
+    int n = 0x100 - m->ppu.oamaddr;
+    ppu_catch_up(m);
+    memcpy(&m->ppu_sprram[m->ppu.oamaddr], data, n);
+    memcpy(m->ppu_sprram, data + n, 0x100 - n);
+    m->ppu_sprite_lines.dirty = true;
+    ppu_update_sprite_0_hit(m);
 }
 
-void ppu_set_mirroring(uint8_t mirroring) {
-    ppu.mirroring = mirroring;
-    ppu.mirroring_xor = 0x400 << mirroring;
+/* 设置 Nametable 镜像方式, 只修改 m->ppu_nametable 中的指针, 不复制数据
+ * m->ppu_ciram 的 0 ~ 7FF 为 NES 内置的 2KB, 800 ~ FFF 为四屏时卡带中的 2KB
+ *   水平: 2000 = 2400, 2800 = 2C00
+ *   垂直: 2000 = 2800, 2400 = 2C00
+ *   单屏: 4 个 Nametable 相同, 为内置内存的前 1KB 或后 1KB
+ *   四屏: 4 个 Nametable 各不相同
+ */
+void ppu_set_mirroring(struct nes_machine *m, uint8_t mirroring) {
+    static const uint8_t layout[5][4] = {
+        { 0, 0, 1, 1 },  // PPU_MIRRORING_HORIZONTAL
+        { 0, 1, 0, 1 },  // PPU_MIRRORING_VERTICAL
+        { 0, 0, 0, 0 },  // PPU_MIRRORING_SINGLE_LOW
+        { 1, 1, 1, 1 },  // PPU_MIRRORING_SINGLE_HIGH
+        { 0, 1, 2, 3 },  // PPU_MIRRORING_FOUR_SCREEN
+    };
+    int i;
+    bool changed = m->ppu.mirroring != mirroring;
+    if(changed) { ppu_catch_up(m); }
+    m->ppu.mirroring = mirroring;
+    for(i = 0; i < 4; i++) { m->ppu_nametable[i] = m->ppu_ciram + layout[mirroring][i] * 0x400; }
+    if(changed) { ppu_update_sprite_0_hit(m); }
 }
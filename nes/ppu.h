@@ -3,54 +3,33 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include "machine.h"
+#include "ppu_palette.h"
 
-/* 存储像素的坐标和颜色 */
-struct Pixel {
-    int x, y;
-    int color;
-};
-typedef struct Pixel Pixel;
-
-/* PixelBuf, 存储 PPU 最终生成的图像信息，供 Allegro 之类的多媒体库使用 */
-struct PixelBuf {
-    Pixel buf[264*264];
-    int size;
-};
-typedef struct PixelBuf PixelBuf;
-
-extern PixelBuf bg, bbg, fg;  // 背景，背景后的 Sprite，背景前的 Sprite
-
-void ppu_init();
-uint8_t ppu_io_read(uint16_t address);
-void ppu_io_write(uint16_t address, uint8_t data);
-void ppu_sprram_write(uint8_t data);
-void ppu_set_mirroring(uint8_t mirroring);
-void ppu_copy(uint16_t address, uint8_t *source, int length);
-void ppu_run(int cycles);
-uint8_t ppu_ram_read(uint16_t address);
-bool ppu_show_background();
-bool ppu_show_sprites();
-bool ppu_generate_nmi();
+/* Nametable 镜像方式, 水平与垂直与 iNES header 中 Flag 6 的第 0 位相同 */
+#define PPU_MIRRORING_HORIZONTAL  0
+#define PPU_MIRRORING_VERTICAL    1
+#define PPU_MIRRORING_SINGLE_LOW  2
+#define PPU_MIRRORING_SINGLE_HIGH 3
+#define PPU_MIRRORING_FOUR_SCREEN 4  // iNES header 中 Flag 6 的第 3 位为 1
 
-void ppu_debugger();
+void ppu_init(struct nes_machine *m);
+uint8_t ppu_io_read(struct nes_machine *m, uint16_t address);
+void ppu_io_write(struct nes_machine *m, uint16_t address, uint8_t data);
+void ppu_oam_dma(struct nes_machine *m, const uint8_t *data);
+void ppu_set_mirroring(struct nes_machine *m, uint8_t mirroring);
+void ppu_run(struct nes_machine *m, int cycles);
+void ppu_catch_up(struct nes_machine *m);
+void ppu_update_sprite_0_hit(struct nes_machine *m);
+uint8_t ppu_ram_read(struct nes_machine *m, uint16_t address);
+bool ppu_show_background(struct nes_machine *m);
+bool ppu_show_sprites(struct nes_machine *m);
+bool ppu_generate_nmi(struct nes_machine *m);
 
+void ppu_set_rgb_output(struct nes_machine *m, void *buffer, enum ppu_pixel_format format);
 
-/* 清除 Pixel 缓冲区 */
-#define pixelbuf_clean(bf) \
-	do { \
-		(bf).size = 0; \
-	} while(0)
+void ppu_debugger(struct nes_machine *m);
 
-/* 在 Pixel 缓冲区添加新像素 */
-#define pixelbuf_add(bf, xa, ya, ca) \
-	do { \
-		if ((xa) < SCREEN_WIDTH && (ya) < SCREEN_HEIGHT) { \
-			(bf).buf[(bf).size].x = (xa); \
-			(bf).buf[(bf).size].y = (ya); \
-			(bf).buf[(bf).size].color = (ca); \
-			(bf).size++; \
-		} \
-	} while(0)
 
 typedef struct _rgb {
 	int r;
@@ -0,0 +1,42 @@
+/* 颜色编号到 RGB 的转换表
+ *
+ * PPUMASK 的第 5 ~ 7 位 (色彩增强, 红/绿/蓝) 使其他两个颜色分量变暗, 每设置一位,
+ * 其余两个分量乘以 PPU_PALETTE_ATTENUATION / 256 (约 0.816), 颜色 $xE, $xF (黑色) 不受影响.
+ * 灰度模式 (PPUMASK 第 0 位) 与实际的 PPU 相同, 在读取调色板时只保留颜色编号的第 4, 5 位 (见 ppu.c),
+ * 因此不需要单独的表.
+ *
+ * 8 种色彩增强与 64 种颜色的组合在 ppu_set_rgb_output 时一次计算完成,
+ * 之后每个像素的转换只需要查一次表.
+ */
+
+#include "ppu_palette.h"
+#include "ppu.h"
+
+#define PPU_PALETTE_ATTENUATION 209
+
+/* 按照 format 转换一个颜色 */
+static uint32_t ppu_palette_pack(int r, int g, int b, enum ppu_pixel_format format) {
+    switch(format) {
+        case PPU_PIXEL_BGRA8888: return ((uint32_t)b << 24) | ((uint32_t)g << 16) | ((uint32_t)r << 8) | 0xff;
+        case PPU_PIXEL_RGB565:   return ((uint32_t)(r >> 3) << 11) | ((uint32_t)(g >> 2) << 5) | (uint32_t)(b >> 3);
+        case PPU_PIXEL_ARGB8888:
+        default:                 return 0xff000000 | ((uint32_t)r << 16) | ((uint32_t)g << 8) | (uint32_t)b;
+    }
+}
+
+/* 计算转换表, table 至少有 PPU_PALETTE_TABLE_SIZE 项, RGB565 时每项的低 16 位有效 */
+void ppu_palette_build(uint32_t *table, enum ppu_pixel_format format) {
+    int emphasis, color, i;
+    for(emphasis = 0; emphasis < 8; emphasis++) {
+        for(color = 0; color < 64; color++) {
+            int rgb[3] = { palette[color].r, palette[color].g, palette[color].b };
+            if((color & 0x0e) != 0x0e) {
+                for(i = 0; i < 3; i++) {
+                    int others = emphasis & ~(1 << i);  // 增强其他分量的位数
+                    for(; others; others &= others - 1) { rgb[i] = rgb[i] * PPU_PALETTE_ATTENUATION >> 8; }
+                }
+            }
+            table[(emphasis << 6) | color] = ppu_palette_pack(rgb[0], rgb[1], rgb[2], format);
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef BEMU_PPU_PALETTE_H
+#define BEMU_PPU_PALETTE_H
+
+#include <stdint.h>
+
+/* RGB 输出的像素格式 (均为 CPU 字节序下的整数值) */
+enum ppu_pixel_format {
+    PPU_PIXEL_ARGB8888,  // uint32_t: 0xAARRGGBB
+    PPU_PIXEL_BGRA8888,  // uint32_t: 0xBBGGRRAA
+    PPU_PIXEL_RGB565,    // uint16_t: RRRRRGGG GGGBBBBB
+};
+
+/* 颜色编号 (0 ~ 63) 与 PPUMASK 第 5 ~ 7 位 (色彩增强) 的组合数, 表中的位置为 (PPUMASK >> 5) << 6 | 颜色编号 */
+#define PPU_PALETTE_TABLE_SIZE 512
+
+void ppu_palette_build(uint32_t *table, enum ppu_pixel_format format);
+
+#endif //BEMU_PPU_PALETTE_H
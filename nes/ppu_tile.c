@@ -0,0 +1,186 @@
+/* Tile 解码: 将 Pattern Table 中一行的两个位平面合成为 8 个像素
+ *
+ * 每个 tile 的一行由低位平面 l 与高位平面 h 两个字节组成, 第 x 个像素的颜色为
+ * (h 的第 7-x 位) << 1 | (l 的第 7-x 位). 结果的 8 个像素放在一个 uint64_t 中 (见 ppu_tile.h).
+ *
+ * 有以下几种实现, ppu_tile_init 根据 CPU 支持的指令集选择, 保存在每台 NES 的 m->ppu_tile_cache.decoder 中:
+ *   scalar: 逐位计算, 作为参考实现, 其他实现的结果必须与之相同
+ *   table:  每个字节对应一个 uint64_t 的表 (正向与水平翻转各 2KB), 不依赖特定的 CPU
+ *   sse2:   将 l, h 分别复制到 8 个字节中, 与每个像素对应的位比较
+ *   bmi2:   使用 PDEP 指令将 l, h 的每一位分散到对应的字节中 (AMD Zen 2 及之前的 CPU 上 PDEP 很慢, 不使用)
+ * x86-64 上优先使用 bmi2, 其次为 table (比 sse2 略快); 32 位 x86 上 uint64_t 需要两个寄存器, 优先使用 sse2.
+ * 设置环境变量 BEMU_TILE_DECODER (上述名称之一) 可以指定使用的实现, 用于对比运行结果.
+ *
+ * 绘制时不直接解码, 而是读取 m->ppu_tile_cache 中解码后的结果 (ppu_tile_rows), 每个 tile 在第一次使用时解码.
+ * 以下情况下清除对应 tile 的 valid, 下次使用时重新解码:
+ *   - 写入 CHR RAM (ppu_tile_cache_write), 同一块 CHR RAM 可能被映射到多个位置, 全部清除
+ *   - Mapper 切换 CHR Bank (ppu_tile_cache_invalidate), 指针不变时不清除
+ */
+
+#include "ppu_tile.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/******** scalar ********/
+
+static uint64_t ppu_tile_decode_scalar(uint8_t l, uint8_t h) {
+    uint64_t row = 0;
+    int x;
+    for(x = 0; x < 8; x++) {
+        row |= (uint64_t)((((h >> (7 - x)) & 1) << 1) | ((l >> (7 - x)) & 1)) << (x << 3);
+    }
+    return row;
+}
+
+static uint64_t ppu_tile_decode_flip_scalar(uint8_t l, uint8_t h) {
+    uint64_t row = 0;
+    int x;
+    for(x = 0; x < 8; x++) {
+        row |= (uint64_t)((((h >> x) & 1) << 1) | ((l >> x) & 1)) << (x << 3);
+    }
+    return row;
+}
+
+/******** table ********/
+
+/* ppu_tile_spread[b] 的第 x 个字节为 b 的第 7-x 位, ppu_tile_spread_flip[b] 的第 x 个字节为 b 的第 x 位 */
+#define TILE_BIT(b, bit, x) ((uint64_t)(((b) >> (bit)) & 1) << ((x) << 3))
+#define TILE_SPREAD(b) (TILE_BIT(b, 7, 0) | TILE_BIT(b, 6, 1) | TILE_BIT(b, 5, 2) | TILE_BIT(b, 4, 3) | \
+                        TILE_BIT(b, 3, 4) | TILE_BIT(b, 2, 5) | TILE_BIT(b, 1, 6) | TILE_BIT(b, 0, 7))
+#define TILE_SPREAD_FLIP(b) (TILE_BIT(b, 0, 0) | TILE_BIT(b, 1, 1) | TILE_BIT(b, 2, 2) | TILE_BIT(b, 3, 3) | \
+                             TILE_BIT(b, 4, 4) | TILE_BIT(b, 5, 5) | TILE_BIT(b, 6, 6) | TILE_BIT(b, 7, 7))
+#define TILE_4(f, b)   f(b), f((b) + 1), f((b) + 2), f((b) + 3)
+#define TILE_16(f, b)  TILE_4(f, b), TILE_4(f, (b) + 4), TILE_4(f, (b) + 8), TILE_4(f, (b) + 12)
+#define TILE_64(f, b)  TILE_16(f, b), TILE_16(f, (b) + 16), TILE_16(f, (b) + 32), TILE_16(f, (b) + 48)
+#define TILE_256(f)    TILE_64(f, 0), TILE_64(f, 64), TILE_64(f, 128), TILE_64(f, 192)
+
+static const uint64_t ppu_tile_spread[256] = { TILE_256(TILE_SPREAD) };
+static const uint64_t ppu_tile_spread_flip[256] = { TILE_256(TILE_SPREAD_FLIP) };
+
+static uint64_t ppu_tile_decode_table(uint8_t l, uint8_t h) {
+    return ppu_tile_spread[l] | (ppu_tile_spread[h] << 1);
+}
+
+static uint64_t ppu_tile_decode_flip_table(uint8_t l, uint8_t h) {
+    return ppu_tile_spread_flip[l] | (ppu_tile_spread_flip[h] << 1);
+}
+
+/******** sse2 / bmi2 ********/
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PPU_TILE_X86
+#include <immintrin.h>
+
+/* 低 8 字节为 l, 高 8 字节为 h, 与 bits 中每个像素对应的位比较, 再将 h 的结果 (2) 与 l 的结果 (1) 合并 */
+__attribute__((target("sse2")))
+static inline uint64_t ppu_tile_sse2(uint8_t l, uint8_t h, __m128i bits) {
+    uint64_t row;
+    __m128i v = _mm_unpacklo_epi64(_mm_set1_epi8((char)l), _mm_set1_epi8((char)h));
+    v = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+    v = _mm_and_si128(v, _mm_set_epi8(2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1));
+    v = _mm_or_si128(v, _mm_srli_si128(v, 8));
+    _mm_storel_epi64((__m128i *)&row, v);
+    return row;
+}
+
+__attribute__((target("sse2")))
+static uint64_t ppu_tile_decode_sse2(uint8_t l, uint8_t h) {
+    return ppu_tile_sse2(l, h, _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 1, 2, 4, 8, 16, 32, 64, (char)128));
+}
+
+__attribute__((target("sse2")))
+static uint64_t ppu_tile_decode_flip_sse2(uint8_t l, uint8_t h) {
+    return ppu_tile_sse2(l, h, _mm_set_epi8((char)128, 64, 32, 16, 8, 4, 2, 1, (char)128, 64, 32, 16, 8, 4, 2, 1));
+}
+
+#ifdef __x86_64__
+#define PPU_TILE_BMI2
+
+/* PDEP 将 l 的第 x 位放到第 x 个字节, 即水平翻转的结果, 交换字节顺序即为正向的结果 */
+__attribute__((target("bmi2")))
+static uint64_t ppu_tile_decode_flip_bmi2(uint8_t l, uint8_t h) {
+    return _pdep_u64(l, 0x0101010101010101ULL) | _pdep_u64(h, 0x0202020202020202ULL);
+}
+
+__attribute__((target("bmi2")))
+static uint64_t ppu_tile_decode_bmi2(uint8_t l, uint8_t h) {
+    return __builtin_bswap64(ppu_tile_decode_flip_bmi2(l, h));
+}
+#endif /* __x86_64__ */
+
+#endif /* PPU_TILE_X86 */
+
+/******** 选择实现 ********/
+
+static const struct ppu_tile_decoder ppu_tile_table[] = {
+    { "scalar", ppu_tile_decode_scalar, ppu_tile_decode_flip_scalar },
+    { "table",  ppu_tile_decode_table,  ppu_tile_decode_flip_table },
+#ifdef PPU_TILE_X86
+    { "sse2",   ppu_tile_decode_sse2,   ppu_tile_decode_flip_sse2 },
+#endif
+#ifdef PPU_TILE_BMI2
+    { "bmi2",   ppu_tile_decode_bmi2,   ppu_tile_decode_flip_bmi2 },
+#endif
+};
+
+/* 查找实现, 返回 NULL 表示不存在或当前 CPU 不支持 */
+const struct ppu_tile_decoder *ppu_tile_find(const char *name) {
+    size_t i;
+#ifdef PPU_TILE_X86
+    __builtin_cpu_init();
+#endif
+    for(i = 0; i < sizeof(ppu_tile_table) / sizeof(ppu_tile_table[0]); i++) {
+        if(strcmp(ppu_tile_table[i].name, name) != 0) { continue; }
+#ifdef PPU_TILE_X86
+        if(strcmp(name, "sse2") == 0 && !__builtin_cpu_supports("sse2")) { return NULL; }
+        if(strcmp(name, "bmi2") == 0 && !__builtin_cpu_supports("bmi2")) { return NULL; }
+#endif
+        return &ppu_tile_table[i];
+    }
+    return NULL;
+}
+
+/* 根据环境变量 BEMU_TILE_DECODER 或 CPU 支持的指令集选择实现 */
+void ppu_tile_init(struct nes_machine *m) {
+    const char *name = getenv("BEMU_TILE_DECODER");
+    const struct ppu_tile_decoder *decoder = name != NULL ? ppu_tile_find(name) : NULL;
+
+#ifdef PPU_TILE_X86
+    __builtin_cpu_init();
+    if(decoder == NULL && !__builtin_cpu_is("amd")) { decoder = ppu_tile_find("bmi2"); }
+#endif
+#if defined(PPU_TILE_X86) && !defined(__x86_64__)
+    if(decoder == NULL) { decoder = ppu_tile_find("sse2"); }
+#endif
+    if(decoder == NULL) { decoder = ppu_tile_find("table"); }
+    m->ppu_tile_cache.decoder = decoder;
+}
+
+/******** Tile 缓存 ********/
+
+/* 解码第 tile 个 tile */
+void ppu_tile_cache_fill(struct nes_machine *m, int tile) {
+    const uint8_t *data = m->ppu_chr_bank[tile >> 6] + ((tile & 0x3f) << 4);
+    const struct ppu_tile_decoder *decoder = m->ppu_tile_cache.decoder;
+    int y;
+    for(y = 0; y < 8; y++) {
+        m->ppu_tile_cache.row[tile][y] = decoder->decode(data[y], data[y + 8]);
+        m->ppu_tile_cache.row_flip[tile][y] = decoder->decode_flip(data[y], data[y + 8]);
+    }
+    m->ppu_tile_cache.valid[tile] = 1;
+}
+
+/* 清除 Pattern Table 中 address 开始 size 字节范围内的 tile */
+void ppu_tile_cache_invalidate(struct nes_machine *m, uint16_t address, int size) {
+    memset(&m->ppu_tile_cache.valid[address >> 4], 0, ((address + size - 1) >> 4) - (address >> 4) + 1);
+}
+
+/* 写入 CHR RAM 的 address 之后调用, 清除映射到同一块内存的所有位置的 tile */
+void ppu_tile_cache_write(struct nes_machine *m, uint16_t address) {
+    const uint8_t *bank = m->ppu_chr_bank[address >> 10];
+    int i;
+    for(i = 0; i < 8; i++) {
+        if(m->ppu_chr_bank[i] == bank) { m->ppu_tile_cache.valid[(i << 6) | ((address >> 4) & 0x3f)] = 0; }
+    }
+}
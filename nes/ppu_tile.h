@@ -0,0 +1,33 @@
+#ifndef BEMU_PPU_TILE_H
+#define BEMU_PPU_TILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "machine.h"
+
+/* Tile 的一行: 低位平面 l 与高位平面 h 合成的 8 个像素 (0 ~ 3),
+ * 第 x 个像素位于第 8x ~ 8x+7 位, 通过 PPU_TILE_PIXEL 取出
+ */
+#define PPU_TILE_PIXEL(row, x) ((int)(((row) >> ((x) << 3)) & 0xff))
+
+/* Tile 解码的实现, 由 ppu_tile_init 根据 CPU 支持的指令集选择 */
+struct ppu_tile_decoder {
+    const char *name;
+    uint64_t (*decode)(uint8_t l, uint8_t h);       // 第 0 个像素为 l, h 的第 7 位
+    uint64_t (*decode_flip)(uint8_t l, uint8_t h);  // 水平翻转, 第 0 个像素为 l, h 的第 0 位
+};
+
+const struct ppu_tile_decoder *ppu_tile_find(const char *name);
+void ppu_tile_init(struct nes_machine *m);
+
+void ppu_tile_cache_fill(struct nes_machine *m, int tile);
+void ppu_tile_cache_invalidate(struct nes_machine *m, uint16_t address, int size);
+void ppu_tile_cache_write(struct nes_machine *m, uint16_t address);
+
+/* Pattern Table 地址为 tile * 16 的 tile 解码后的 8 行, 第 y 行为 [y] */
+static inline const uint64_t *ppu_tile_rows(struct nes_machine *m, int tile, bool hflip) {
+    if(!m->ppu_tile_cache.valid[tile]) { ppu_tile_cache_fill(m, tile); }
+    return hflip ? m->ppu_tile_cache.row_flip[tile] : m->ppu_tile_cache.row[tile];
+}
+
+#endif //BEMU_PPU_TILE_H
@@ -0,0 +1,114 @@
+/* 事件调度
+ *
+ * 以主时钟为统一的时间基准, 将接下来需要处理的事件 (扫描线, NMI, Sprite 0 hit, IRQ 等)
+ * 按时间顺序保存在优先队列 (二叉堆) 中.
+ * 运行时 CPU 一直执行到下一个事件的时间, 然后处理该事件, 事件处理函数可以继续添加新的事件.
+ *
+ * 主时钟由 CPU 实际执行的 Cycle 数换算得到, 指令执行超出的部分会计入之后的时间, 不会产生累积误差.
+ */
+
+#include "scheduler.h"
+#include "cpu.h"
+#include <stddef.h>
+
+static void scheduler_swap(struct _scheduler *s, int i, int j) {
+    struct scheduler_entry tmp = s->heap[i];
+    s->heap[i] = s->heap[j];
+    s->heap[j] = tmp;
+    s->heap_position[s->heap[i].event] = i;
+    s->heap_position[s->heap[j].event] = j;
+}
+
+static void scheduler_sift_up(struct _scheduler *s, int i) {
+    while(i > 0 && s->heap[(i - 1) / 2].time > s->heap[i].time) {
+        scheduler_swap(s, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void scheduler_sift_down(struct _scheduler *s, int i) {
+    for(;;) {
+        int smallest = i, l = 2 * i + 1, r = 2 * i + 2;
+        if(l < s->heap_size && s->heap[l].time < s->heap[smallest].time) { smallest = l; }
+        if(r < s->heap_size && s->heap[r].time < s->heap[smallest].time) { smallest = r; }
+        if(smallest == i) { return; }
+        scheduler_swap(s, i, smallest);
+        i = smallest;
+    }
+}
+
+/* 初始化, 清除全部事件 */
+void scheduler_init(struct nes_machine *m) {
+    struct _scheduler *s = &m->scheduler;
+    int i;
+    s->heap_size = 0;
+    s->in_event = 0;
+    for(i = 0; i < SCHEDULER_EVENT_COUNT; i++) {
+        s->heap_position[i] = -1;
+        s->handler[i] = NULL;
+    }
+}
+
+/* 当前的主时钟, 处理事件时为该事件的时间 */
+uint64_t scheduler_clock(struct nes_machine *m) {
+    const struct _scheduler *s = &m->scheduler;
+    if(s->in_event) { return s->event_time; }
+    return cpu_clock(m) * SCHEDULER_CPU_CLOCK_DIVIDER;
+}
+
+/* 设置事件的处理函数 */
+void scheduler_register(struct nes_machine *m, enum scheduler_event event, void (*handler)(struct nes_machine *m)) {
+    m->scheduler.handler[event] = handler;
+}
+
+/* 在主时钟到达 time 时处理 event, 如果该事件已经在等待处理, 修改其时间 */
+void scheduler_schedule(struct nes_machine *m, enum scheduler_event event, uint64_t time) {
+    struct _scheduler *s = &m->scheduler;
+    int i = s->heap_position[event];
+    if(i < 0) {
+        i = s->heap_size++;
+        s->heap[i].event = event;
+        s->heap_position[event] = i;
+    }
+    s->heap[i].time = time;
+    scheduler_sift_up(s, i);
+    scheduler_sift_down(s, s->heap_position[event]);
+}
+
+/* 取消等待处理的事件 */
+void scheduler_cancel(struct nes_machine *m, enum scheduler_event event) {
+    struct _scheduler *s = &m->scheduler;
+    int i = s->heap_position[event];
+    if(i < 0) { return; }
+    scheduler_swap(s, i, --s->heap_size);
+    s->heap_position[event] = -1;
+    if(i < s->heap_size) {
+        scheduler_sift_up(s, i);
+        scheduler_sift_down(s, i);
+    }
+}
+
+/* 运行到主时钟到达 time */
+void scheduler_run(struct nes_machine *m, uint64_t time) {
+    struct _scheduler *s = &m->scheduler;
+    for(;;) {
+        uint64_t now = scheduler_clock(m);
+        uint64_t next = time;
+
+        /* 处理已经到达的事件 */
+        if(s->heap_size > 0 && s->heap[0].time <= now) {
+            struct scheduler_entry entry = s->heap[0];
+            scheduler_cancel(m, entry.event);
+            s->event_time = entry.time;
+            s->in_event = 1;
+            if(s->handler[entry.event]) { s->handler[entry.event](m); }
+            s->in_event = 0;
+            continue;
+        }
+        if(now >= time) { return; }
+
+        /* CPU 执行到下一个事件 */
+        if(s->heap_size > 0 && s->heap[0].time < next) { next = s->heap[0].time; }
+        cpu_run(m, (int)((next - now + SCHEDULER_CPU_CLOCK_DIVIDER - 1) / SCHEDULER_CPU_CLOCK_DIVIDER));
+    }
+}
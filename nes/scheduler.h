@@ -0,0 +1,22 @@
+#ifndef BEMU_SCHEDULER_H
+#define BEMU_SCHEDULER_H
+
+#include <stdint.h>
+#include "machine.h"
+
+/* 时钟关系 (NTSC), 以主时钟 (21.477272 MHz) 的周期为单位 */
+#define SCHEDULER_CPU_CLOCK_DIVIDER 12                                     // CPU 时钟 = 主时钟 / 12
+#define SCHEDULER_PPU_CLOCK_DIVIDER 4                                      // PPU 时钟 = 主时钟 / 4
+#define SCHEDULER_SCANLINE_CYCLES   (341 * SCHEDULER_PPU_CLOCK_DIVIDER)    // 每条扫描线 341 个 PPU 周期
+#define SCHEDULER_FRAME_CYCLES      (262 * SCHEDULER_SCANLINE_CYCLES)      // 每帧 262 条扫描线
+
+/* 事件类型 (enum scheduler_event) 在 machine.h 中定义 */
+
+void scheduler_init(struct nes_machine *m);
+uint64_t scheduler_clock(struct nes_machine *m);
+void scheduler_register(struct nes_machine *m, enum scheduler_event event, void (*handler)(struct nes_machine *m));
+void scheduler_schedule(struct nes_machine *m, enum scheduler_event event, uint64_t time);
+void scheduler_cancel(struct nes_machine *m, enum scheduler_event event);
+void scheduler_run(struct nes_machine *m, uint64_t time);
+
+#endif //BEMU_SCHEDULER_H
@@ -0,0 +1,88 @@
+/* 电池供电的 Save RAM (6000 ~ 7FFF)
+ *
+ * iNES header 中 Flag 6 的第 1 位为 1 时, 卡带中的 Save RAM 由电池供电, 关机后内容不会丢失.
+ * 此时 Save RAM 直接映射到 ROM 旁边的 .sav 文件 (mmap, MAP_SHARED), 写入 Save RAM 即写入文件.
+ *
+ * 为了在不影响写入速度的前提下及时写回磁盘, 使用 dirty 标志:
+ *   - 写回之后, 页表中 Save RAM 的 write 指针为 NULL, 下一次写入通过 sram_write 设置 dirty 标志,
+ *     并恢复 write 指针, 之后的写入与内部 RAM 相同, 不需要额外的操作
+ *   - dirty 之后经过 SRAM_SYNC_FRAMES 帧, 由 sram_frame 调用 msync (MS_ASYNC) 写回
+ *   - sram_close (nes_exit) 时调用 msync (MS_SYNC), 等待写回完成
+ */
+
+#include "sram.h"
+#include "memory.h"
+#include "cpu.h"
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* 不使用文件, Save RAM 指向 m->sram.buffer */
+void sram_reset(struct nes_machine *m) {
+    m->sram.data = m->sram.buffer;
+    m->sram.mapped = false;
+    m->sram.dirty = false;
+    m->sram.frames = 0;
+}
+
+/* 写回之后, 使下一次写入经过 sram_write */
+static void sram_protect(struct nes_machine *m) {
+    memory_map(m, 0x60, 0x20, m->sram.data, m->sram.mapped ? NULL : m->sram.data);
+}
+
+/* 将 Save RAM 映射到文件 path, 文件不存在时创建
+ * 输出:
+ *     0: 正常返回, -1: 文件无法打开, 此时继续使用 m->sram.buffer
+ */
+int sram_open(struct nes_machine *m, const char *path) {
+    struct stat st;
+    void *data;
+    int fd;
+
+    sram_close(m);
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if(fd < 0) { return -1; }
+    /* 只扩展过短的文件, 不截断已有的较大的 .sav */
+    if(fstat(fd, &st) != 0 || (st.st_size < SRAM_SIZE && ftruncate(fd, SRAM_SIZE) != 0)) {
+        close(fd);
+        return -1;
+    }
+    data = mmap(NULL, SRAM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) { return -1; }
+
+    m->sram.data = data;
+    m->sram.mapped = true;
+    sram_protect(m);
+    return 0;
+}
+
+/* 写回并解除文件映射, 页表中的 Save RAM 改为指向 m->sram.buffer */
+void sram_close(struct nes_machine *m) {
+    if(m->sram.mapped) {
+        if(m->sram.dirty) { msync(m->sram.data, SRAM_SIZE, MS_SYNC); }
+        munmap(m->sram.data, SRAM_SIZE);
+    }
+    sram_reset(m);
+    memory_map(m, 0x60, 0x20, m->sram.buffer, m->sram.buffer);
+}
+
+/* 写回之后的第一次写入, 设置 dirty 标志, 之后的写入不再经过该函数 */
+void sram_write(struct nes_machine *m, uint16_t address, uint8_t data) {
+    m->sram.data[address - 0x6000] = data;
+    cpu_icache_invalidate(m, address);
+    m->sram.dirty = true;
+    m->sram.frames = 0;
+    memory_map(m, 0x60, 0x20, m->sram.data, m->sram.data);
+}
+
+/* 每帧结束时调用, dirty 之后经过 SRAM_SYNC_FRAMES 帧时写回 */
+void sram_frame(struct nes_machine *m) {
+    if(!m->sram.dirty || ++m->sram.frames < SRAM_SYNC_FRAMES) { return; }
+    msync(m->sram.data, SRAM_SIZE, MS_ASYNC);
+    m->sram.dirty = false;
+    m->sram.frames = 0;
+    sram_protect(m);
+}
@@ -0,0 +1,16 @@
+#ifndef BEMU_SRAM_H
+#define BEMU_SRAM_H
+
+#include <stdint.h>
+#include "machine.h"
+
+#define SRAM_SIZE        0x2000
+#define SRAM_SYNC_FRAMES 60      // Save RAM 被写入后, 最多经过多少帧写回文件
+
+void sram_reset(struct nes_machine *m);
+int sram_open(struct nes_machine *m, const char *path);
+void sram_close(struct nes_machine *m);
+void sram_write(struct nes_machine *m, uint16_t address, uint8_t data);
+void sram_frame(struct nes_machine *m);
+
+#endif //BEMU_SRAM_H
@@ -0,0 +1,80 @@
+/* headless: 不打开窗口, 以最快速度运行 NES ROM, 用于没有显示器的测试与性能测量
+ *
+ * 用法: headless nes_rom_file [frames] [output.ppm]
+ * 运行 frames 帧 (默认为 600) 后显示速度与最后完成的一帧画面的校验值 (FNV-1a),
+ * 指定 output.ppm 时将最后一帧画面保存为 PPM 图像.
+ * 使用 BEMU_CPU_JIT 编译时, 设置环境变量 BEMU_CPU_JIT=0 只使用解释器, 比较两次运行的校验值即可检查 JIT 的结果.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "nes/nes.h"
+#include "nes/headless.h"
+
+/* 最后完成的一帧画面 (ARGB8888) 的 FNV-1a 校验值, 用于比较不同版本的运行结果 */
+static uint32_t frame_hash(const uint32_t *frame) {
+    uint32_t hash = 2166136261u;
+    int i;
+    for(i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) { hash = (hash ^ frame[i]) * 16777619u; }
+    return hash;
+}
+
+/* 保存 ARGB8888 格式的画面, 返回 0 表示成功 */
+static int save_ppm(const char *path, const uint32_t *frame) {
+    FILE *fp = fopen(path, "wb");
+    int i;
+    if(fp == NULL) { return -1; }
+    fprintf(fp, "P6\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+    for(i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
+        fputc((frame[i] >> 16) & 0xff, fp);
+        fputc((frame[i] >> 8) & 0xff, fp);
+        fputc(frame[i] & 0xff, fp);
+    }
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    static struct headless h;
+    struct nes_machine *m;
+    struct timespec start, end;
+    long frames = 600;
+    double seconds;
+    int tmp;
+
+    if(argc < 2 || argc > 4) {
+        printf("Usage: %s nes_rom_file [frames] [output.ppm]\n", argv[0]);
+        return 0;
+    }
+    if(argc >= 3) { frames = atol(argv[2]); }
+
+    m = nes_create();
+    if(m == NULL) {
+        printf("Out of memory\n");
+        return 1;
+    }
+    tmp = nes_load_rom(m, argv[1]);
+    if(tmp != 0) {
+        printf("NES rom load failed, error code: %d\n", tmp);
+        nes_destroy(m);
+        return tmp;
+    }
+    nes_init(m);
+    headless_attach(m, &h, PPU_PIXEL_ARGB8888);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    nes_run(m, frames);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("%llu frames in %.3f s, %.1f fps\n", (unsigned long long)h.frames, seconds,
+           seconds > 0 ? h.frames / seconds : 0.0);
+    printf("CPU: %s\n", m->cpu_jit != NULL ? "JIT" : "interpreter");
+    printf("Frame hash: %08x\n", frame_hash(h.frame));
+    if(argc == 4 && save_ppm(argv[3], h.frame) != 0) {
+        printf("Failed to save %s\n", argv[3]);
+    }
+
+    nes_destroy(m);
+    return 0;
+}
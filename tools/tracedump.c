@@ -0,0 +1,72 @@
+/* tracedump: 将 bEMU 的指令跟踪文件 (见 nes/cpu_trace.c) 转换为文本
+ *
+ * 用法: tracedump trace_file [nes_rom_file]
+ * 指定 NES ROM 时, PRG ROM 中的指令通过反汇编器显示, 否则只显示操作码.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nes/cpu_trace.h"
+#include "nes/disassembler.h"
+
+static uint8_t *prg_rom;
+static int prg_rom_size;
+
+/* 读入 NES ROM 中的 PRG ROM, 返回 0 表示成功 */
+static int load_prg_rom(const char *path) {
+    uint8_t header[16];
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL) { return -1; }
+    if(fread(header, 1, 16, fp) != 16 || memcmp(header, "NES\x1a", 4) != 0) {
+        fclose(fp);
+        return -1;
+    }
+    if(header[6] & 0x04) { fseek(fp, 512, SEEK_CUR); }  // 跳过 Trainer
+    prg_rom_size = 16 * 1024 * header[4];
+    prg_rom = calloc(prg_rom_size + 2, 1);  // disasm_once 可能读取最后一条指令之后的 2 字节
+    if(prg_rom == NULL || prg_rom_size == 0 || fread(prg_rom, 1, prg_rom_size, fp) != (size_t)prg_rom_size) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    struct cpu_trace_record prev, record;
+    char magic[8];
+    FILE *fp;
+
+    if(argc != 2 && argc != 3) {
+        printf("Usage: %s trace_file [nes_rom_file]\n", argv[0]);
+        return 0;
+    }
+    fp = fopen(argv[1], "rb");
+    if(fp == NULL || fread(magic, 1, 8, fp) != 8 || memcmp(magic, CPU_TRACE_MAGIC, 8) != 0) {
+        printf("%s is not a bEMU trace file\n", argv[1]);
+        return 1;
+    }
+    if(argc == 3 && load_prg_rom(argv[2]) != 0) {
+        printf("NES rom load failed: %s\n", argv[2]);
+        return 1;
+    }
+
+    memset(&prev, 0, sizeof(prev));
+    while(cpu_trace_read(fp, &prev, &record)) {
+        int offset = (record.pc - 0x8000) % (prg_rom_size ? prg_rom_size : 1);
+        printf("%04X  A:%02X X:%02X Y:%02X P:%02X SP:%02X  CYC:%-10llu SL:%-3d  ",
+               record.pc, record.a, record.x, record.y, record.p, record.sp,
+               (unsigned long long)record.cycle, (int16_t)record.scanline);
+        /* 切换 Bank 后 ROM 中的内容可能与执行时不同, 此时只显示操作码 */
+        if(prg_rom != NULL && record.pc >= 0x8000 && prg_rom[offset] == record.opcode) {
+            disasm_once(prg_rom, offset);
+        } else {
+            printf("op\t $%02x\n", record.opcode);
+        }
+    }
+
+    fclose(fp);
+    free(prg_rom);
+    return 0;
+}